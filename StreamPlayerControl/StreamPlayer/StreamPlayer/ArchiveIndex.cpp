@@ -0,0 +1,170 @@
+#include "archiveindex.h"
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+using namespace FFmpeg;
+using namespace FFmpeg::Facade;
+
+ArchiveIndex::ArchiveIndex(string const& fileName, bool writable)
+	: fileHandle_(INVALID_HANDLE_VALUE), mappingHandle_(nullptr), viewPtr_(nullptr),
+	capacity_(0), writable_(writable)
+{
+	// Readers allow the writer and the retention to go on while the index is mapped.
+	fileHandle_ = ::CreateFileA(fileName.c_str(),
+		writable_ ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ,
+		writable_ ? FILE_SHARE_READ | FILE_SHARE_DELETE : FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		nullptr, writable_ ? CREATE_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+	if (fileHandle_ == INVALID_HANDLE_VALUE)
+		throw runtime_error("CreateFile() failed");
+
+	uint64_t fileSize = sizeof(Header) + InitialCapacity * sizeof(Record);
+	if (!writable_)
+	{
+		LARGE_INTEGER size;
+		if (!::GetFileSizeEx(fileHandle_, &size) || size.QuadPart < static_cast<LONGLONG>(sizeof(Header)))
+		{
+			::CloseHandle(fileHandle_);
+			throw runtime_error("invalid archive index");
+		}
+
+		fileSize = size.QuadPart;
+	}
+
+	try
+	{
+		Map(fileSize);
+	}
+	catch (runtime_error&)
+	{
+		::CloseHandle(fileHandle_);
+		throw;
+	}
+
+	if (writable_)
+	{
+		HeaderPtr()->magic = Magic;
+		HeaderPtr()->version = Version;
+		HeaderPtr()->count = 0;
+	}
+	else if (HeaderPtr()->magic != Magic || HeaderPtr()->version != Version)
+	{
+		Unmap();
+		::CloseHandle(fileHandle_);
+		throw runtime_error("invalid archive index");
+	}
+}
+
+void ArchiveIndex::Append(Record const& record)
+{
+	const uint32_t count = Count();
+	if (count == capacity_)
+	{
+		// A writable mapping extends the file, the index is preallocated in doubling steps.
+		Unmap();
+		Map(sizeof(Header) + 2ULL * capacity_ * sizeof(Record));
+	}
+
+	Records()[count] = record;
+	HeaderPtr()->count = count + 1;
+}
+
+void ArchiveIndex::Flush()
+{
+	::FlushViewOfFile(viewPtr_, 0);
+	::FlushFileBuffers(fileHandle_);
+}
+
+uint32_t ArchiveIndex::Count() const
+{
+	return min(static_cast<uint32_t>(HeaderPtr()->count), capacity_);
+}
+
+bool ArchiveIndex::FindKeyframe(int64_t timestamp, Record &record) const
+{
+	Record const *beginPtr = Records();
+	Record const *endPtr = beginPtr + Count();
+
+	Record const *recordPtr = upper_bound(beginPtr, endPtr, timestamp,
+		[](int64_t value, Record const& r) { return value < r.timestamp; });
+
+	// Step back to the last keyframe at or before the timestamp.
+	while (recordPtr != beginPtr)
+	{
+		--recordPtr;
+		if (recordPtr->flags & KeyframeFlag)
+		{
+			record = *recordPtr;
+			return true;
+		}
+	}
+
+	// The timestamp precedes the segment, start at its first keyframe.
+	for (; recordPtr != endPtr; ++recordPtr)
+	{
+		if (recordPtr->flags & KeyframeFlag)
+		{
+			record = *recordPtr;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+string ArchiveIndex::SegmentFileName(string const& directory, int64_t segmentId)
+{
+	return directory + "\\" + to_string(segmentId) + ".ts";
+}
+
+string ArchiveIndex::IndexFileName(string const& directory, int64_t segmentId)
+{
+	return directory + "\\" + to_string(segmentId) + ".idx";
+}
+
+void ArchiveIndex::Map(uint64_t fileSize)
+{
+	mappingHandle_ = ::CreateFileMappingA(fileHandle_, nullptr,
+		writable_ ? PAGE_READWRITE : PAGE_READONLY,
+		static_cast<DWORD>(fileSize >> 32), static_cast<DWORD>(fileSize), nullptr);
+
+	if (mappingHandle_ == nullptr)
+		throw runtime_error("CreateFileMapping() failed");
+
+	viewPtr_ = static_cast<uint8_t *>(::MapViewOfFile(mappingHandle_,
+		writable_ ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0));
+
+	if (viewPtr_ == nullptr)
+	{
+		::CloseHandle(mappingHandle_);
+		mappingHandle_ = nullptr;
+		throw runtime_error("MapViewOfFile() failed");
+	}
+
+	capacity_ = static_cast<uint32_t>((fileSize - sizeof(Header)) / sizeof(Record));
+}
+
+void ArchiveIndex::Unmap()
+{
+	if (viewPtr_ != nullptr)
+	{
+		::UnmapViewOfFile(viewPtr_);
+		viewPtr_ = nullptr;
+	}
+
+	if (mappingHandle_ != nullptr)
+	{
+		::CloseHandle(mappingHandle_);
+		mappingHandle_ = nullptr;
+	}
+}
+
+ArchiveIndex::~ArchiveIndex()
+{
+	if (writable_)
+		Flush();
+
+	Unmap();
+	::CloseHandle(fileHandle_);
+}
@@ -0,0 +1,116 @@
+#ifndef FFMPEG_FACADE_ARCHIVEINDEX_H
+#define FFMPEG_FACADE_ARCHIVEINDEX_H
+
+#include <cstdint>
+#include <string>
+#include <boost/noncopyable.hpp>
+
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+
+namespace FFmpeg
+{
+	namespace Facade
+	{
+		/// <summary>
+		/// An ArchiveIndex class is a memory-mapped sidecar index of an archive segment file.
+		/// Every record points at a packet of the segment, records are appended in time order,
+		/// so a timestamp is found by a binary search without reading the segment.
+		/// </summary>
+		class ArchiveIndex : private boost::noncopyable
+		{
+		public:
+			/// <summary>
+			/// The record is a keyframe, decoding can start at its offset.
+			/// </summary>
+			static const uint32_t KeyframeFlag = 1;
+
+			struct Record
+			{
+				// The arrival time of the packet, in milliseconds since the Unix epoch.
+				int64_t timestamp;
+				// The offset of the packet in the segment file, in bytes.
+				int64_t offset;
+				// The segment identifier, the same as the segment start time.
+				int64_t segmentId;
+				uint32_t flags;
+				uint32_t reserved;
+			};
+
+			/// <summary>
+			/// Initializes a new instance of the ArchiveIndex class.
+			/// </summary>
+			/// <param name="fileName">The index file.</param>
+			/// <param name="writable">true to create a new index for appending, false to open an existing one read-only.</param>
+			ArchiveIndex(std::string const& fileName, bool writable);
+
+			/// <summary>
+			/// Appends a record, the index file grows as needed.
+			/// </summary>
+			void Append(Record const& record);
+
+			/// <summary>
+			/// Writes the appended records to the disk.
+			/// </summary>
+			void Flush();
+
+			/// <summary>
+			/// Gets the number of records.
+			/// </summary>
+			uint32_t Count() const;
+
+			/// <summary>
+			/// Finds the last keyframe at or before a timestamp, or the first keyframe
+			/// if the timestamp precedes the segment.
+			/// </summary>
+			/// <returns>true if the segment has a keyframe.</returns>
+			bool FindKeyframe(int64_t timestamp, Record &record) const;
+
+			/// <summary>
+			/// Gets the segment file name of a given segment.
+			/// </summary>
+			static std::string SegmentFileName(std::string const& directory, int64_t segmentId);
+
+			/// <summary>
+			/// Gets the index file name of a given segment.
+			/// </summary>
+			static std::string IndexFileName(std::string const& directory, int64_t segmentId);
+
+			/// <summary>
+			/// Releases all resources used by the index.
+			/// </summary>
+			~ArchiveIndex();
+
+		private:
+			struct Header
+			{
+				uint32_t magic;
+				uint32_t version;
+				// Written after the record it counts, the volatile store keeps the order
+				// for readers that map the index while it is being written.
+				volatile LONG count;
+				uint32_t reserved;
+			};
+
+			static const uint32_t Magic = 0x58494557; // "WEIX"
+			static const uint32_t Version = 1;
+			static const uint32_t InitialCapacity = 4096;
+
+			void Map(uint64_t fileSize);
+
+			void Unmap();
+
+			Header *HeaderPtr() const { return reinterpret_cast<Header *>(viewPtr_); }
+
+			Record *Records() const { return reinterpret_cast<Record *>(viewPtr_ + sizeof(Header)); }
+
+			HANDLE fileHandle_;
+			HANDLE mappingHandle_;
+			uint8_t *viewPtr_;
+			uint32_t capacity_;
+			bool writable_;
+		};
+	}
+}
+
+#endif // FFMPEG_FACADE_ARCHIVEINDEX_H
@@ -0,0 +1,97 @@
+#include "archivereader.h"
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+
+#include "archiveindex.h"
+
+using namespace std;
+using namespace FFmpeg;
+using namespace FFmpeg::Facade;
+
+ArchiveReader::ArchiveReader(string const& directory)
+	: directory_(directory)
+{
+	Refresh();
+}
+
+bool ArchiveReader::Seek(int64_t timestamp, Position &position)
+{
+	if (segmentIds_.empty())
+		return false;
+
+	auto it = upper_bound(segmentIds_.begin(), segmentIds_.end(), timestamp);
+	size_t segmentNum = it == segmentIds_.begin() ? 0 : (it - segmentIds_.begin()) - 1;
+
+	// A segment without keyframes (e.g. the one just created) is skipped.
+	for (; segmentNum < segmentIds_.size(); ++segmentNum)
+	{
+		if (FindInSegment(segmentNum, timestamp, position))
+			return true;
+	}
+
+	return false;
+}
+
+bool ArchiveReader::NextSegment(int64_t segmentId, Position &position)
+{
+	// Pick up the segments written since the last look.
+	Refresh();
+
+	auto it = upper_bound(segmentIds_.begin(), segmentIds_.end(), segmentId);
+	for (; it != segmentIds_.end(); ++it)
+	{
+		if (FindInSegment(it - segmentIds_.begin(), *it, position))
+			return true;
+	}
+
+	return false;
+}
+
+void ArchiveReader::Refresh()
+{
+	segmentIds_.clear();
+
+	WIN32_FIND_DATAA findData;
+	HANDLE findHandle = ::FindFirstFileA((directory_ + "\\*.idx").c_str(), &findData);
+	if (findHandle == INVALID_HANDLE_VALUE)
+		return;
+
+	do
+	{
+		char *endPtr = nullptr;
+		const int64_t segmentId = _strtoi64(findData.cFileName, &endPtr, 10);
+		if (endPtr != findData.cFileName && _stricmp(endPtr, ".idx") == 0)
+			segmentIds_.push_back(segmentId);
+	} while (::FindNextFileA(findHandle, &findData));
+
+	::FindClose(findHandle);
+
+	sort(segmentIds_.begin(), segmentIds_.end());
+}
+
+bool ArchiveReader::FindInSegment(size_t segmentNum, int64_t timestamp, Position &position) const
+{
+	const int64_t segmentId = segmentIds_[segmentNum];
+
+	try
+	{
+		ArchiveIndex index(ArchiveIndex::IndexFileName(directory_, segmentId), false);
+
+		ArchiveIndex::Record record;
+		if (!index.FindKeyframe(timestamp, record))
+			return false;
+
+		position.segmentId = segmentId;
+		position.segmentFileName = ArchiveIndex::SegmentFileName(directory_, segmentId);
+		position.offset = record.offset;
+		position.timestamp = record.timestamp;
+
+		return true;
+	}
+	catch (runtime_error&)
+	{
+		// The segment has been evicted or its index is damaged.
+		return false;
+	}
+}
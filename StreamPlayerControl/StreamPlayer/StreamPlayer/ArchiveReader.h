@@ -0,0 +1,61 @@
+#ifndef FFMPEG_FACADE_ARCHIVEREADER_H
+#define FFMPEG_FACADE_ARCHIVEREADER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <boost/noncopyable.hpp>
+
+namespace FFmpeg
+{
+	namespace Facade
+	{
+		/// <summary>
+		/// An ArchiveReader class locates recorded footage in an archive directory.
+		/// </summary>
+		class ArchiveReader : private boost::noncopyable
+		{
+		public:
+			struct Position
+			{
+				int64_t segmentId;
+				std::string segmentFileName;
+				// The offset of the keyframe to start decoding at, in bytes.
+				int64_t offset;
+				// The arrival time of the keyframe, in milliseconds since the Unix epoch.
+				int64_t timestamp;
+			};
+
+			/// <summary>
+			/// Initializes a new instance of the ArchiveReader class.
+			/// </summary>
+			/// <param name="directory">The archive directory.</param>
+			explicit ArchiveReader(std::string const& directory);
+
+			/// <summary>
+			/// Finds the nearest keyframe at or before a timestamp.
+			/// </summary>
+			/// <param name="timestamp">The time to seek to, in milliseconds since the Unix epoch.</param>
+			/// <param name="position">The position to start decoding at.</param>
+			/// <returns>true if the archive has footage at or after the timestamp.</returns>
+			bool Seek(int64_t timestamp, Position &position);
+
+			/// <summary>
+			/// Finds the start of the segment that follows a given one.
+			/// </summary>
+			/// <returns>true if there is a following segment.</returns>
+			bool NextSegment(int64_t segmentId, Position &position);
+
+		private:
+			void Refresh();
+
+			bool FindInSegment(size_t segmentNum, int64_t timestamp, Position &position) const;
+
+			std::string directory_;
+			// Segment identifiers are segment start times, kept sorted.
+			std::vector<int64_t> segmentIds_;
+		};
+	}
+}
+
+#endif // FFMPEG_FACADE_ARCHIVEREADER_H
@@ -0,0 +1,242 @@
+#include "archivewriter.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <stdexcept>
+
+#include "archiveindex.h"
+#include "muxer.h"
+
+using namespace std;
+using namespace FFmpeg;
+using namespace FFmpeg::Facade;
+
+namespace
+{
+	// The preallocation of the first segment, the following ones reserve the size of the previous one.
+	const uint64_t DefaultSegmentBytes = 32 * 1024 * 1024;
+}
+
+ArchiveWriter::ArchiveWriter()
+	: maxAgeHours_(0), quotaBytes_(0), segmentHandle_(INVALID_HANDLE_VALUE),
+	ioCtxPtr_(nullptr), segmentId_(0), segmentBytes_(0), totalBytes_(0) {}
+
+void ArchiveWriter::Start(string const& directory, uint32_t segmentSeconds,
+	uint32_t maxAgeHours, uint64_t quotaBytes)
+{
+	Stop();
+
+	directory_ = directory;
+	maxAgeHours_ = maxAgeHours;
+	quotaBytes_ = quotaBytes;
+
+	::CreateDirectoryA(directory_.c_str(), nullptr);
+	ScanDirectory();
+
+	Recorder::Start(directory_, segmentSeconds > 0 ? segmentSeconds : 60, 0);
+}
+
+unique_ptr<Muxer> ArchiveWriter::CreateSegment(AVCodecContext const *codecCtxPtr,
+	AVRational timeBase, int64_t wallClockMs)
+{
+	segmentId_ = wallClockMs;
+
+	const string segmentFileName = ArchiveIndex::SegmentFileName(directory_, segmentId_);
+	segmentHandle_ = ::CreateFileA(segmentFileName.c_str(), GENERIC_READ | GENERIC_WRITE,
+		FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+	if (segmentHandle_ == INVALID_HANDLE_VALUE)
+		throw runtime_error("CreateFile() failed");
+
+	// Reserve the expected size up front so that the segment stays contiguous on the disk,
+	// the reservation beyond the end of file is released when the file is closed.
+	FILE_ALLOCATION_INFO allocationInfo;
+	allocationInfo.AllocationSize.QuadPart = segmentBytes_ > 0 ?
+		segmentBytes_ + segmentBytes_ / 4 : DefaultSegmentBytes;
+	::SetFileInformationByHandle(segmentHandle_, FileAllocationInfo,
+		&allocationInfo, sizeof(allocationInfo));
+
+	segmentBytes_ = 0;
+
+	try
+	{
+		indexPtr_ = make_unique<ArchiveIndex>(ArchiveIndex::IndexFileName(directory_, segmentId_), true);
+
+		uint8_t *bufferPtr = static_cast<uint8_t *>(av_malloc(IoBufferSize));
+		if (bufferPtr == nullptr)
+			throw runtime_error("av_malloc() failed");
+
+		ioCtxPtr_ = avio_alloc_context(bufferPtr, IoBufferSize, 1, this, nullptr, WriteSegment, SeekSegment);
+		if (ioCtxPtr_ == nullptr)
+		{
+			av_free(bufferPtr);
+			throw runtime_error("avio_alloc_context() failed");
+		}
+
+		// MPEG-TS can be decoded from any packet boundary, so playback can start at an indexed offset.
+		auto muxerPtr = make_unique<Muxer>(ioCtxPtr_, "mpegts", codecCtxPtr, timeBase);
+
+		lastFlush_ = Clock::now();
+		segments_.push_back(SegmentInfo{ segmentId_, 0 });
+
+		return muxerPtr;
+	}
+	catch (runtime_error&)
+	{
+		ReleaseSegment();
+		::DeleteFileA(segmentFileName.c_str());
+		::DeleteFileA(ArchiveIndex::IndexFileName(directory_, segmentId_).c_str());
+		throw;
+	}
+}
+
+void ArchiveWriter::PacketWriting(AVPacket const &packet, int64_t wallClockMs, Muxer &muxer)
+{
+	if (!(packet.flags & AV_PKT_FLAG_KEY))
+		return;
+
+	ArchiveIndex::Record record;
+	record.timestamp = wallClockMs;
+	record.offset = muxer.BytesWritten();
+	record.segmentId = segmentId_;
+	record.flags = ArchiveIndex::KeyframeFlag;
+	record.reserved = 0;
+
+	indexPtr_->Append(record);
+
+	const auto now = Clock::now();
+	if (now - lastFlush_ >= boost::chrono::milliseconds(FlushIntervalInMilliseconds))
+	{
+		avio_flush(ioCtxPtr_);
+		::FlushFileBuffers(segmentHandle_);
+		indexPtr_->Flush();
+		lastFlush_ = now;
+	}
+}
+
+void ArchiveWriter::SegmentClosed()
+{
+	avio_flush(ioCtxPtr_);
+	::FlushFileBuffers(segmentHandle_);
+
+	segments_.back().bytes = segmentBytes_;
+	totalBytes_ += segmentBytes_;
+
+	ReleaseSegment();
+
+	EnforceRetention();
+}
+
+int ArchiveWriter::WriteSegment(void *opaque, uint8_t *buf, int bufSize)
+{
+	ArchiveWriter *writerPtr = static_cast<ArchiveWriter *>(opaque);
+
+	DWORD written = 0;
+	if (!::WriteFile(writerPtr->segmentHandle_, buf, bufSize, &written, nullptr))
+		return AVERROR(EIO);
+
+	writerPtr->segmentBytes_ += written;
+	return static_cast<int>(written);
+}
+
+int64_t ArchiveWriter::SeekSegment(void *opaque, int64_t offset, int whence)
+{
+	ArchiveWriter *writerPtr = static_cast<ArchiveWriter *>(opaque);
+
+	LARGE_INTEGER position;
+	if (whence == AVSEEK_SIZE)
+	{
+		return ::GetFileSizeEx(writerPtr->segmentHandle_, &position) ?
+			position.QuadPart : AVERROR(EIO);
+	}
+
+	LARGE_INTEGER distance;
+	distance.QuadPart = offset;
+
+	const DWORD moveMethod = whence == SEEK_CUR ? FILE_CURRENT : whence == SEEK_END ? FILE_END : FILE_BEGIN;
+	if (!::SetFilePointerEx(writerPtr->segmentHandle_, distance, &position, moveMethod))
+		return AVERROR(EIO);
+
+	return position.QuadPart;
+}
+
+void ArchiveWriter::ReleaseSegment()
+{
+	if (ioCtxPtr_ != nullptr)
+	{
+		av_freep(&ioCtxPtr_->buffer);
+		av_freep(&ioCtxPtr_);
+	}
+
+	indexPtr_.reset();
+
+	if (segmentHandle_ != INVALID_HANDLE_VALUE)
+	{
+		::CloseHandle(segmentHandle_);
+		segmentHandle_ = INVALID_HANDLE_VALUE;
+	}
+}
+
+void ArchiveWriter::EnforceRetention()
+{
+	const int64_t maxAgeMs = maxAgeHours_ * 3600000LL;
+	const int64_t wallClockMs = boost::chrono::duration_cast<boost::chrono::milliseconds>(
+		boost::chrono::system_clock::now().time_since_epoch()).count();
+
+	// The newest segment is always kept.
+	while (segments_.size() > 1)
+	{
+		SegmentInfo const& oldest = segments_.front();
+
+		const bool expired = maxAgeHours_ > 0 && oldest.segmentId < wallClockMs - maxAgeMs;
+		const bool overQuota = quotaBytes_ > 0 && totalBytes_ > quotaBytes_;
+		if (!expired && !overQuota)
+			break;
+
+		// A segment being played back cannot be deleted, it is retried after the next segment.
+		if (!::DeleteFileA(ArchiveIndex::SegmentFileName(directory_, oldest.segmentId).c_str()) &&
+			::GetLastError() != ERROR_FILE_NOT_FOUND)
+		{
+			break;
+		}
+
+		::DeleteFileA(ArchiveIndex::IndexFileName(directory_, oldest.segmentId).c_str());
+
+		totalBytes_ -= oldest.bytes;
+		segments_.pop_front();
+	}
+}
+
+void ArchiveWriter::ScanDirectory()
+{
+	segments_.clear();
+	totalBytes_ = 0;
+
+	WIN32_FIND_DATAA findData;
+	HANDLE findHandle = ::FindFirstFileA((directory_ + "\\*.ts").c_str(), &findData);
+	if (findHandle == INVALID_HANDLE_VALUE)
+		return;
+
+	do
+	{
+		char *endPtr = nullptr;
+		const int64_t segmentId = _strtoi64(findData.cFileName, &endPtr, 10);
+		if (endPtr == findData.cFileName || _stricmp(endPtr, ".ts") != 0)
+			continue;
+
+		const uint64_t bytes = (static_cast<uint64_t>(findData.nFileSizeHigh) << 32) | findData.nFileSizeLow;
+		segments_.push_back(SegmentInfo{ segmentId, bytes });
+		totalBytes_ += bytes;
+	} while (::FindNextFileA(findHandle, &findData));
+
+	::FindClose(findHandle);
+
+	sort(segments_.begin(), segments_.end(),
+		[](SegmentInfo const& a, SegmentInfo const& b) { return a.segmentId < b.segmentId; });
+}
+
+ArchiveWriter::~ArchiveWriter()
+{
+	// The writer thread calls the overrides, it must be finished before this part is destroyed.
+	Stop();
+}
@@ -0,0 +1,98 @@
+#ifndef FFMPEG_FACADE_ARCHIVEWRITER_H
+#define FFMPEG_FACADE_ARCHIVEWRITER_H
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <boost/chrono.hpp>
+
+#include "recorder.h"
+
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+
+namespace FFmpeg
+{
+	namespace Facade
+	{
+		class ArchiveIndex;
+
+		/// <summary>
+		/// An ArchiveWriter class appends a stream to an archive directory of MPEG-TS segment files,
+		/// each with a memory-mapped sidecar index of its keyframes. Segment files are preallocated,
+		/// flushes to the disk are batched, and the oldest segments are evicted by age or disk quota.
+		/// </summary>
+		class ArchiveWriter : public Recorder
+		{
+		public:
+			/// <summary>
+			/// Initializes a new instance of the ArchiveWriter class.
+			/// </summary>
+			ArchiveWriter();
+
+			/// <summary>
+			/// Starts archiving at the next keyframe.
+			/// </summary>
+			/// <param name="directory">The archive directory, created if it does not exist.</param>
+			/// <param name="segmentSeconds">The segment duration.</param>
+			/// <param name="maxAgeHours">The age after which segments are evicted, zero for no limit.</param>
+			/// <param name="quotaBytes">The disk quota of the archive, zero for no limit.</param>
+			void Start(std::string const& directory, uint32_t segmentSeconds,
+				uint32_t maxAgeHours, uint64_t quotaBytes);
+
+			/// <summary>
+			/// Stops archiving and releases all resources used by the writer.
+			/// </summary>
+			virtual ~ArchiveWriter();
+
+		protected:
+			virtual std::unique_ptr<Muxer> CreateSegment(AVCodecContext const *codecCtxPtr,
+				AVRational timeBase, int64_t wallClockMs) override;
+
+			virtual void PacketWriting(AVPacket const &packet, int64_t wallClockMs, Muxer &muxer) override;
+
+			virtual void SegmentClosed() override;
+
+		private:
+			typedef boost::chrono::steady_clock Clock;
+
+			struct SegmentInfo
+			{
+				int64_t segmentId;
+				uint64_t bytes;
+			};
+
+			static int WriteSegment(void *opaque, uint8_t *buf, int bufSize);
+
+			static int64_t SeekSegment(void *opaque, int64_t offset, int whence);
+
+			void ReleaseSegment();
+
+			void EnforceRetention();
+
+			void ScanDirectory();
+
+			// The file system is asked to flush the written data no more often than this.
+			static const uint32_t FlushIntervalInMilliseconds = 2000;
+			static const uint32_t IoBufferSize = 64 * 1024;
+
+			std::string directory_;
+			uint32_t maxAgeHours_;
+			uint64_t quotaBytes_;
+
+			HANDLE segmentHandle_;
+			AVIOContext *ioCtxPtr_;
+			std::unique_ptr<ArchiveIndex> indexPtr_;
+			int64_t segmentId_;
+			uint64_t segmentBytes_;
+			Clock::time_point lastFlush_;
+
+			// The segments on the disk, oldest first, for the retention.
+			std::deque<SegmentInfo> segments_;
+			uint64_t totalBytes_;
+		};
+	}
+}
+
+#endif // FFMPEG_FACADE_ARCHIVEWRITER_H
@@ -0,0 +1,51 @@
+#include "cpumonitor.h"
+
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+
+using namespace std;
+using namespace FFmpeg;
+using namespace FFmpeg::Facade;
+
+namespace
+{
+	uint64_t ToUInt64(FILETIME const& fileTime)
+	{
+		return (static_cast<uint64_t>(fileTime.dwHighDateTime) << 32) | fileTime.dwLowDateTime;
+	}
+}
+
+CpuMonitor::CpuMonitor(uint32_t loadPercent)
+	: loadPercent_(loadPercent), idleTime_(0), busyTime_(0), overloaded_(false) {}
+
+bool CpuMonitor::Overloaded()
+{
+	boost::unique_lock<boost::mutex> lock(mutex_);
+
+	const Clock::time_point now = Clock::now();
+	if (now - lastSample_ < boost::chrono::seconds(1))
+		return overloaded_;
+
+	FILETIME idle, kernel, user;
+	if (!::GetSystemTimes(&idle, &kernel, &user))
+		return overloaded_;
+
+	// The kernel time includes the idle time.
+	const uint64_t idleTime = ToUInt64(idle);
+	const uint64_t busyTime = ToUInt64(kernel) + ToUInt64(user) - idleTime;
+
+	if (lastSample_ != Clock::time_point())
+	{
+		const uint64_t idleDelta = idleTime - idleTime_;
+		const uint64_t busyDelta = busyTime - busyTime_;
+
+		overloaded_ = idleDelta + busyDelta > 0 &&
+			busyDelta * 100 > (idleDelta + busyDelta) * loadPercent_;
+	}
+
+	lastSample_ = now;
+	idleTime_ = idleTime;
+	busyTime_ = busyTime;
+
+	return overloaded_;
+}
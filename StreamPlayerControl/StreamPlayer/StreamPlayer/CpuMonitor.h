@@ -0,0 +1,51 @@
+#ifndef FFMPEG_FACADE_CPUMONITOR_H
+#define FFMPEG_FACADE_CPUMONITOR_H
+
+#include <cstdint>
+#include <boost/noncopyable.hpp>
+#include <boost/chrono.hpp>
+
+#pragma warning( push )
+#pragma warning( disable : 4100 )
+
+#include <boost/thread.hpp>
+
+#pragma warning( pop )
+
+namespace FFmpeg
+{
+	namespace Facade
+	{
+		/// <summary>
+		/// A CpuMonitor class tells whether the machine is short of CPU time.
+		/// </summary>
+		class CpuMonitor : private boost::noncopyable
+		{
+		public:
+			/// <summary>
+			/// Initializes a new instance of the CpuMonitor class.
+			/// </summary>
+			/// <param name="loadPercent">The load from which the machine is overloaded.</param>
+			explicit CpuMonitor(uint32_t loadPercent = 90);
+
+			/// <summary>
+			/// Gets whether the load of all cores was above the threshold during the last second.
+			/// Callable from any thread, the system times are sampled at most once a second.
+			/// </summary>
+			bool Overloaded();
+
+		private:
+			typedef boost::chrono::steady_clock Clock;
+
+			const uint32_t loadPercent_;
+
+			boost::mutex mutex_;
+			Clock::time_point lastSample_;
+			uint64_t idleTime_;
+			uint64_t busyTime_;
+			bool overloaded_;
+		};
+	}
+}
+
+#endif // FFMPEG_FACADE_CPUMONITOR_H
@@ -0,0 +1,189 @@
+#include "decodescheduler.h"
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+using namespace FFmpeg;
+using namespace FFmpeg::Facade;
+
+DecodeScheduler::DecodeScheduler()
+	: stopRequested_(false), readyCount_(0), nextWorker_(0) {}
+
+void DecodeScheduler::Start(uint32_t workerCount)
+{
+	if (!workers_.empty())
+		return;
+
+	if (workerCount == 0)
+		workerCount = max(boost::thread::hardware_concurrency(), 1u);
+
+	stopRequested_ = false;
+
+	for (uint32_t i = 0; i < workerCount; ++i)
+		workers_.push_back(std::make_unique<Worker>());
+
+	for (uint32_t i = 0; i < workerCount; ++i)
+		threads_.create_thread(boost::bind(&DecodeScheduler::Run, this, i));
+}
+
+void DecodeScheduler::Submit(std::shared_ptr<Task> const& taskPtr)
+{
+	if (workers_.empty())
+		throw runtime_error("the scheduler is not started");
+
+	Push(nextWorker_++ % workers_.size(), taskPtr);
+}
+
+void DecodeScheduler::Shutdown()
+{
+	{
+		boost::unique_lock<boost::mutex> lock(timerMutex_);
+		stopRequested_ = true;
+	}
+
+	timerCondition_.notify_all();
+	threads_.join_all();
+
+	// The tasks are released here, not by the workers, so their owners see them finish.
+	while (!timedTasks_.empty())
+		timedTasks_.pop();
+
+	workers_.clear();
+	readyCount_ = 0;
+}
+
+void DecodeScheduler::Run(uint32_t workerNum)
+{
+	while (!stopRequested_)
+	{
+		std::shared_ptr<Task> taskPtr = Pop(workerNum);
+		if (taskPtr == nullptr)
+			taskPtr = Steal(workerNum);
+		if (taskPtr == nullptr)
+		{
+			for (auto const& dueTaskPtr : WaitForTasks())
+				Push(workerNum, dueTaskPtr);
+
+			continue;
+		}
+
+		Clock::time_point nextStep;
+		if (!taskPtr->Step(nextStep))
+			continue;
+
+		if (nextStep <= Clock::now())
+		{
+			// Behind the other ready tasks of the worker, a busy stream cannot starve them.
+			Push(workerNum, taskPtr);
+			continue;
+		}
+
+		{
+			boost::unique_lock<boost::mutex> lock(timerMutex_);
+			timedTasks_.push(TimedTask{ nextStep, taskPtr });
+		}
+
+		// A sleeping worker may have to wake up earlier than it planned.
+		timerCondition_.notify_one();
+	}
+}
+
+void DecodeScheduler::Push(uint32_t workerNum, std::shared_ptr<Task> const& taskPtr)
+{
+	{
+		Worker &worker = *workers_[workerNum];
+		const int32_t priority = taskPtr->Priority();
+
+		boost::unique_lock<boost::mutex> lock(worker.mutex);
+
+		// Ahead of the tasks of a lower priority, behind those of the same one.
+		auto position = find_if(worker.tasks.begin(), worker.tasks.end(),
+			[priority](std::shared_ptr<Task> const& otherPtr) { return otherPtr->Priority() < priority; });
+
+		worker.tasks.insert(position, taskPtr);
+	}
+
+	++readyCount_;
+
+	// Taking the timer lock orders the count before the check of a worker about to sleep.
+	{
+		boost::unique_lock<boost::mutex> lock(timerMutex_);
+	}
+
+	timerCondition_.notify_one();
+}
+
+std::shared_ptr<DecodeScheduler::Task> DecodeScheduler::Pop(uint32_t workerNum)
+{
+	Worker &worker = *workers_[workerNum];
+
+	boost::unique_lock<boost::mutex> lock(worker.mutex);
+	if (worker.tasks.empty())
+		return nullptr;
+
+	std::shared_ptr<Task> taskPtr = worker.tasks.front();
+	worker.tasks.pop_front();
+	--readyCount_;
+
+	return taskPtr;
+}
+
+std::shared_ptr<DecodeScheduler::Task> DecodeScheduler::Steal(uint32_t workerNum)
+{
+	const uint32_t workerCount = static_cast<uint32_t>(workers_.size());
+
+	for (uint32_t i = 1; i < workerCount; ++i)
+	{
+		Worker &victim = *workers_[(workerNum + i) % workerCount];
+
+		// The owner takes from the front, a thief takes the least urgent task from the back.
+		boost::unique_lock<boost::mutex> lock(victim.mutex, boost::try_to_lock);
+		if (!lock.owns_lock() || victim.tasks.empty())
+			continue;
+
+		std::shared_ptr<Task> taskPtr = victim.tasks.back();
+		victim.tasks.pop_back();
+		--readyCount_;
+
+		return taskPtr;
+	}
+
+	return nullptr;
+}
+
+std::vector<std::shared_ptr<DecodeScheduler::Task>> DecodeScheduler::WaitForTasks()
+{
+	std::vector<std::shared_ptr<Task>> dueTasks;
+
+	boost::unique_lock<boost::mutex> lock(timerMutex_);
+
+	for (;;)
+	{
+		if (stopRequested_ || readyCount_ > 0)
+			return dueTasks;
+
+		if (timedTasks_.empty())
+		{
+			timerCondition_.wait(lock);
+			continue;
+		}
+
+		// Every task that is due goes to the queues, where the priority decides what runs first.
+		const Clock::time_point now = Clock::now();
+		while (!timedTasks_.empty() && timedTasks_.top().time <= now)
+		{
+			dueTasks.push_back(timedTasks_.top().taskPtr);
+			timedTasks_.pop();
+		}
+
+		if (!dueTasks.empty())
+			return dueTasks;
+
+		timerCondition_.wait_until(lock, timedTasks_.top().time);
+	}
+}
+
+DecodeScheduler::~DecodeScheduler()
+{
+	Shutdown();
+}
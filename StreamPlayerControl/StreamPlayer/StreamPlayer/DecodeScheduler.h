@@ -0,0 +1,124 @@
+#ifndef FFMPEG_FACADE_DECODESCHEDULER_H
+#define FFMPEG_FACADE_DECODESCHEDULER_H
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <queue>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include <boost/chrono.hpp>
+
+#pragma warning( push )
+#pragma warning( disable : 4100 )
+
+#include <boost/thread.hpp>
+
+#pragma warning( pop )
+
+#include <boost/atomic.hpp>
+
+namespace FFmpeg
+{
+	namespace Facade
+	{
+		/// <summary>
+		/// A DecodeScheduler class runs the streams of a player on a fixed pool of workers
+		/// instead of a thread per stream. Every worker owns a queue of ready tasks and steals
+		/// from the others when its own is empty; a task runs a single frame per step and is
+		/// queued behind the others of its priority again, so the streams share the workers fairly.
+		/// When the workers fall behind, the tasks of a higher priority are the ones that run on time.
+		/// </summary>
+		class DecodeScheduler : private boost::noncopyable
+		{
+		public:
+			typedef boost::chrono::steady_clock Clock;
+
+			/// <summary>
+			/// A Task interface is a resumable unit of work.
+			/// </summary>
+			class Task
+			{
+			public:
+				/// <summary>
+				/// Runs a step of the task on a worker.
+				/// </summary>
+				/// <param name="nextStep">Receives the time the next step is due.</param>
+				/// <returns>false if the task is finished.</returns>
+				virtual bool Step(Clock::time_point &nextStep) = 0;
+
+				/// <summary>
+				/// Gets the priority of the task, the ready tasks of a higher priority run first.
+				/// </summary>
+				virtual int32_t Priority() const { return 0; }
+
+				virtual ~Task() {}
+			};
+
+			/// <summary>
+			/// Initializes a new instance of the DecodeScheduler class, no worker is started.
+			/// </summary>
+			DecodeScheduler();
+
+			/// <summary>
+			/// Starts the workers if they are not running.
+			/// </summary>
+			/// <param name="workerCount">The number of workers, zero for one per core.</param>
+			void Start(uint32_t workerCount);
+
+			/// <summary>
+			/// Queues a task, its first step runs as soon as a worker is free.
+			/// </summary>
+			void Submit(std::shared_ptr<Task> const& taskPtr);
+
+			/// <summary>
+			/// Stops the workers and drops the tasks left.
+			/// </summary>
+			void Shutdown();
+
+			/// <summary>
+			/// Releases all resources used by the scheduler.
+			/// </summary>
+			~DecodeScheduler();
+
+		private:
+			struct Worker
+			{
+				boost::mutex mutex;
+				std::deque<std::shared_ptr<Task>> tasks;
+			};
+
+			struct TimedTask
+			{
+				Clock::time_point time;
+				std::shared_ptr<Task> taskPtr;
+
+				bool operator>(TimedTask const& other) const { return time > other.time; }
+			};
+
+			void Run(uint32_t workerNum);
+
+			void Push(uint32_t workerNum, std::shared_ptr<Task> const& taskPtr);
+
+			std::shared_ptr<Task> Pop(uint32_t workerNum);
+
+			std::shared_ptr<Task> Steal(uint32_t workerNum);
+
+			std::vector<std::shared_ptr<Task>> WaitForTasks();
+
+			std::vector<std::unique_ptr<Worker>> workers_;
+			boost::thread_group threads_;
+			boost::atomic<bool> stopRequested_;
+			// The number of tasks in the worker queues, idle workers wake up to steal them.
+			boost::atomic<int32_t> readyCount_;
+			boost::atomic<uint32_t> nextWorker_;
+
+			// The tasks waiting for their next step, the earliest first.
+			boost::mutex timerMutex_;
+			boost::condition_variable timerCondition_;
+			std::priority_queue<TimedTask, std::vector<TimedTask>, std::greater<TimedTask>> timedTasks_;
+		};
+	}
+}
+
+#endif // FFMPEG_FACADE_DECODESCHEDULER_H
@@ -1,16 +1,35 @@
 #include "decoder.h"
+#include <cstring>
 #include <stdexcept>
+#include <tuple>
 
 #include "frame.h"
+#include "packetsink.h"
+#include "framesink.h"
+#include "netinput.h"
+#include "gopcache.h"
 
 using namespace std;
 using namespace boost;
 using namespace FFmpeg;
 using namespace FFmpeg::Facade;
 
-Decoder::Decoder(string const& streamUrl)
-	: formatCtxPtr_(nullptr), codecCtxPtr_(nullptr),
-	videoStreamIndex_(-1), imageConvertCtxPtr_(nullptr)
+namespace
+{
+	// A longer group is not kept, the stream then waits for a keyframe to resume.
+	const size_t MaxGopBytes = 16 * 1024 * 1024;
+
+	const int32_t IoBufferSize = 32 * 1024;
+}
+
+Decoder::Decoder(string const& streamUrl, DecoderParams const& params,
+	boost::atomic<bool> const *cancelRequestedPtr, boost::atomic<int64_t> const *cancelDeadlinePtr)
+	: ioCtxPtr_(nullptr), averagePacketBytes_(0), formatCtxPtr_(nullptr), codecCtxPtr_(nullptr),
+	videoStreamIndex_(-1), imageConvertCtxPtr_(nullptr), params_(params), cancelRequestedPtr_(cancelRequestedPtr),
+	cancelDeadlinePtr_(cancelDeadlinePtr),
+	leadPtr_(nullptr), leadSequence_(0),
+	primedFramePtr_(nullptr), decodeMode_(FullDecoding), appliedDecodeMode_(FullDecoding),
+	gopCachePtr_(nullptr), gopBytes_(0), gopReplayIndex_(0), gopReplaySequence_(0), replayingGop_(false), lumaHash_(0), frameChanged_(true)
 {
 	static boost::once_flag flag = BOOST_ONCE_INIT;
 	boost::call_once(flag, []()
@@ -24,35 +43,94 @@ Decoder::Decoder(string const& streamUrl)
 	AVDictionary *streamOpts = nullptr;
 	av_dict_set(&streamOpts, "stimeout", "5000000", 0); // 5 seconds timeout.
 
+	TransportProfile const& transport = params_.transport;
+	if (transport.transport != DefaultTransport)
+	{
+		av_dict_set(&streamOpts, "rtsp_transport", transport.transport == UdpTransport ? "udp" :
+			transport.transport == TcpTransport ? "tcp" : "udp_multicast", 0);
+	}
+
+	if (transport.reorderQueueSize >= 0)
+		av_dict_set_int(&streamOpts, "reorder_queue_size", transport.reorderQueueSize, 0);
+
+	if (transport.socketBufferSize > 0)
+		av_dict_set_int(&streamOpts, "buffer_size", transport.socketBufferSize, 0);
+
+	if (transport.maxDelayInMilliseconds >= 0)
+		av_dict_set_int(&streamOpts, "max_delay", transport.maxDelayInMilliseconds * 1000LL, 0);
+
+	if (transport.lowDelay != 0)
+		av_dict_set(&streamOpts, "fflags", "nobuffer", 0);
+
 	formatCtxPtr_ = avformat_alloc_context();
-	int error = avformat_open_input(&formatCtxPtr_, streamUrl.c_str(), nullptr, &streamOpts);
+
+	// Stop returns as soon as the blocking call polls the callback, not after the socket timeout.
+	formatCtxPtr_->interrupt_callback.callback = &Decoder::Interrupt;
+	formatCtxPtr_->interrupt_callback.opaque = this;
+
+	StartOperation(params_.openTimeoutInMilliseconds);
+
+	if (params_.inputPtr != nullptr)
+	{
+		inputPtr_ = params_.inputPtr;
+	}
+	else if (params_.netReactorPtr != nullptr && NetInput::Supports(streamUrl))
+	{
+		try
+		{
+			inputPtr_ = std::make_shared<NetInput>(*params_.netReactorPtr, streamUrl, formatCtxPtr_->interrupt_callback);
+		}
+		catch (runtime_error&)
+		{
+			// The FFmpeg protocol handles what the reactor input does not, like Digest auth
+			// and redirects, it gets the stream with a fresh timeout.
+			StartOperation(params_.openTimeoutInMilliseconds);
+		}
+	}
+
+	AVInputFormat *inputFormatPtr = inputPtr_ != nullptr ? inputPtr_->Format() : nullptr;
+
+	if (inputFormatPtr == nullptr && !params_.streamInfo.formatName.empty())
+	{
+		// A reopened stream keeps its demuxer and codec, a short analysis gets the rest.
+		inputFormatPtr = av_find_input_format(params_.streamInfo.formatName.c_str());
+		av_dict_set(&streamOpts, "analyzeduration", "500000", 0);
+	}
+
+	if (inputPtr_ != nullptr)
+	{
+		uint8_t *ioBufferPtr = static_cast<uint8_t *>(av_malloc(IoBufferSize));
+		ioCtxPtr_ = avio_alloc_context(ioBufferPtr, IoBufferSize, 0, this, &Decoder::ReadInput, nullptr, nullptr);
+
+		formatCtxPtr_->pb = ioCtxPtr_;
+		formatCtxPtr_->flags |= AVFMT_FLAG_CUSTOM_IO;
+	}
+
+	int error = avformat_open_input(&formatCtxPtr_, streamUrl.c_str(), inputFormatPtr, &streamOpts);
 	if (error != 0)
 	{
+		FreeInput();
 		av_dict_free(&streamOpts);
 		throw runtime_error("avformat_open_input() failed: " + AvStrError(error));
 	}
 
 	av_dict_free(&streamOpts);
 
+	StartOperation(params_.openTimeoutInMilliseconds);
 	error = avformat_find_stream_info(formatCtxPtr_, nullptr);
 	if (error < 0)
 	{
 		avformat_close_input(&formatCtxPtr_);
+		FreeInput();
 		throw runtime_error("avformat_find_stream_info() failed: " + AvStrError(error));
 	}
 
-	for (uint32_t i = 0; i < formatCtxPtr_->nb_streams; i++)
-	{
-		if (formatCtxPtr_->streams[i]->codec->codec_type == AVMEDIA_TYPE_VIDEO)
-		{
-			videoStreamIndex_ = i;
-			break;
-		}
-	}
+	videoStreamIndex_ = SelectVideoStream();
 
-	if (videoStreamIndex_ == -1)
+	if (videoStreamIndex_ < 0)
 	{
 		avformat_close_input(&formatCtxPtr_);
+		FreeInput();
 		throw runtime_error("no video stream");
 	}
 
@@ -61,30 +139,90 @@ Decoder::Decoder(string const& streamUrl)
 	if (codecPtr == nullptr)
 	{
 		avformat_close_input(&formatCtxPtr_);
+		FreeInput();
 		throw runtime_error("avcodec_find_decoder() failed");
 	}
 
+	// Frame sinks may keep a reference to a decoded frame past the next decode.
+	codecCtxPtr_->refcounted_frames = 1;
+
+	if (params_.exportMotionVectors)
+		codecCtxPtr_->flags2 |= AV_CODEC_FLAG2_EXPORT_MVS;
+
+	if (params_.transport.lowDelay != 0)
+		codecCtxPtr_->flags |= AV_CODEC_FLAG_LOW_DELAY;
+
 	error = avcodec_open2(codecCtxPtr_, codecPtr, nullptr);
 	if (error < 0)
 	{
 		avcodec_close(codecCtxPtr_);
 		avformat_close_input(&formatCtxPtr_);
+		FreeInput();
 		throw runtime_error("avcodec_open2() failed: " + AvStrError(error));
 	}	
 }
 
-void Decoder::GetNextFrame(std::unique_ptr<Frame>& framePtr)
+bool Decoder::GetNextFrame(std::unique_ptr<Frame>& framePtr)
 {
+	if (primedFramePtr_ != nullptr)
+	{
+		// The sinks were added after priming, they get the keyframe and its followers first.
+		for (auto& primedPacket : primedPackets_)
+		{
+			for (auto sinkPtr : packetSinks_)
+				sinkPtr->PacketReceived(primedPacket);
+
+			av_free_packet(&primedPacket);
+		}
+
+		primedPackets_.clear();
+
+		AVFrame *avframePtr = primedFramePtr_;
+		primedFramePtr_ = nullptr;
+
+		try
+		{
+			ProcessFrame(avframePtr, framePtr);
+		}
+		catch (runtime_error&)
+		{
+			av_frame_free(&avframePtr);
+			throw;
+		}
+
+		av_frame_free(&avframePtr);
+		return true;
+	}
+
+	// With no group to replay the stream waits for a keyframe, the packets before it lack their reference.
+	if (decodeMode_ == FullDecoding && appliedDecodeMode_ != FullDecoding &&
+		(!gopPackets_.empty() || (gopCachePtr_ != nullptr && !gopCachePtr_->Empty())))
+	{
+		appliedDecodeMode_ = FullDecoding;
+		gopReplayIndex_ = 0;
+		gopReplaySequence_ = 0;
+		replayingGop_ = true;
+	}
+
+	if (replayingGop_)
+		return ReplayGop(framePtr);
+
 	AVFrame *avframePtr = av_frame_alloc();
 	AVPacket packet;
 
+	// Every read may succeed while nothing decodes, like an audio stream or broken video.
+	const Clock::time_point frameDeadline = params_.frameTimeoutInMilliseconds > 0 ?
+		Clock::now() + boost::chrono::milliseconds(params_.frameTimeoutInMilliseconds) : Clock::time_point::max();
+
 	for (;;)
 	{
+		StartOperation(params_.readTimeoutInMilliseconds);
 		int error = av_read_frame(formatCtxPtr_, &packet);
 		if (error < 0)
 		{
 			if (error != static_cast<int>(AVERROR_EOF))
 			{
+				av_frame_free(&avframePtr);
 				throw runtime_error("av_read_frame() failed: " + AvStrError(error));
 			}
 
@@ -94,49 +232,414 @@ void Decoder::GetNextFrame(std::unique_ptr<Frame>& framePtr)
 
 		if (packet.stream_index == videoStreamIndex_)
 		{
-			int frameFinished = 0;			
-			avcodec_decode_video2(codecCtxPtr_, avframePtr, &frameFinished, &packet);
+			averagePacketBytes_ += (packet.size - averagePacketBytes_) / 8;
+			++stats_.receivedPackets;
 
-			if (frameFinished != 0)
+			// The demuxer flags a packet with missing data, the codec then reports the damage it finds.
+			bool damaged = (packet.flags & AV_PKT_FLAG_CORRUPT) != 0;
+
+			for (auto sinkPtr : packetSinks_)
+				sinkPtr->PacketReceived(packet);
+
+			const bool keyframe = (packet.flags & AV_PKT_FLAG_KEY) != 0;
+			if (decodeMode_ > appliedDecodeMode_ || (decodeMode_ < appliedDecodeMode_ && keyframe))
+				appliedDecodeMode_ = decodeMode_;
+
+			if (appliedDecodeMode_ != FullDecoding)
+				CacheGopPacket(packet, keyframe);
+			else if (!gopPackets_.empty())
+				ClearGop();
+
+			if (appliedDecodeMode_ == NoDecoding || (appliedDecodeMode_ == KeyframeDecoding && !keyframe))
+			{
+				// Non-key packets are dropped until the next keyframe, which needs no reference.
+				frameChanged_ = false;
+
+				if (damaged)
+					++stats_.corruptPackets;
+
+				av_frame_free(&avframePtr);
+				av_free_packet(&packet);
+
+				return true;
+			}
+
+			if (leadPtr_ != nullptr)
 			{
-				AVPicture avRgbFrame;
-				AVPixelFormat pixelFormat = AV_PIX_FMT_BGR24;
-				avpicture_alloc(&avRgbFrame, pixelFormat, codecCtxPtr_->width, codecCtxPtr_->height);
-
-				if (imageConvertCtxPtr_ == nullptr)
-				{					
-					imageConvertCtxPtr_ = sws_getContext(codecCtxPtr_->width, codecCtxPtr_->height,
-						codecCtxPtr_->pix_fmt, codecCtxPtr_->width, codecCtxPtr_->height,
-						pixelFormat, SWS_BICUBIC, nullptr, nullptr, nullptr);
-
-					if (imageConvertCtxPtr_ == nullptr)
-					{
-						throw runtime_error("sws_getContext() failed");
-					}
+				if (!keyframe)
+				{
+					// The packet needs pictures this stream has not seen, the lead's are decoded instead.
+					av_free_packet(&packet);
+					return DecodeLead(avframePtr, framePtr);
 				}
 
-				sws_scale(imageConvertCtxPtr_, ((AVPicture*)avframePtr)->data,
-					((AVPicture*)avframePtr)->linesize, 0, codecCtxPtr_->height,
-					avRgbFrame.data, avRgbFrame.linesize);
+				// From its first keyframe on the stream decodes its own packets.
+				leadPtr_ = nullptr;
+				avcodec_flush_buffers(codecCtxPtr_);
+			}
+
+			int frameFinished = 0;			
+			if (avcodec_decode_video2(codecCtxPtr_, avframePtr, &frameFinished, &packet) < 0 ||
+				(frameFinished != 0 && avframePtr->decode_error_flags != 0))
+			{
+				damaged = true;
+			}
+
+			if (damaged)
+				++stats_.corruptPackets;
 
-				if (framePtr == nullptr)
+			if (frameFinished != 0)
+			{
+				try
 				{
-					framePtr = make_unique<Frame>(codecCtxPtr_->width,
-						codecCtxPtr_->height, avRgbFrame);
+					ProcessFrame(avframePtr, framePtr);
+				}
+				catch (runtime_error&)
+				{
+					av_frame_free(&avframePtr);
+					av_free_packet(&packet);
+					throw;
 				}
-				else
-					framePtr->Update(avRgbFrame);
 
-				avpicture_free(&avRgbFrame);
 				av_frame_free(&avframePtr);
 				av_free_packet(&packet);
 
-				break;				
+				return true;
 			}			
 		}
 
 		av_free_packet(&packet);
+
+		if (Clock::now() > frameDeadline)
+		{
+			av_frame_free(&avframePtr);
+			throw runtime_error("no frame decoded");
+		}
+	}
+
+	av_frame_free(&avframePtr);
+	return false;
+}
+
+bool Decoder::Prime(boost::atomic<bool> const& cancelRequested)
+{
+	AVFrame *avframePtr = av_frame_alloc();
+	AVPacket packet;
+
+	while (!cancelRequested)
+	{
+		StartOperation(params_.readTimeoutInMilliseconds);
+		int error = av_read_frame(formatCtxPtr_, &packet);
+		if (error < 0)
+		{
+			av_frame_free(&avframePtr);
+
+			if (error != static_cast<int>(AVERROR_EOF))
+				throw runtime_error("av_read_frame() failed: " + AvStrError(error));
+
+			return false;
+		}
+
+		// Packets before the first keyframe would decode into a broken picture.
+		if (packet.stream_index != videoStreamIndex_ ||
+			(primedPackets_.empty() && (packet.flags & AV_PKT_FLAG_KEY) == 0))
+		{
+			av_free_packet(&packet);
+			continue;
+		}
+
+		AVPacket primedPacket;
+		if (av_copy_packet(&primedPacket, &packet) < 0)
+		{
+			av_free_packet(&packet);
+			av_frame_free(&avframePtr);
+			throw runtime_error("av_copy_packet() failed");
+		}
+
+		primedPackets_.push_back(primedPacket);
+
+		int frameFinished = 0;
+		error = avcodec_decode_video2(codecCtxPtr_, avframePtr, &frameFinished, &packet);
+		av_free_packet(&packet);
+
+		if (error < 0)
+		{
+			// The pictures after a damaged packet would be broken too, wait for the next keyframe.
+			++stats_.corruptPackets;
+
+			for (auto& primedPacket : primedPackets_)
+				av_free_packet(&primedPacket);
+
+			primedPackets_.clear();
+			continue;
+		}
+
+		if (frameFinished != 0)
+		{
+			primedFramePtr_ = avframePtr;
+			return true;
+		}
+	}
+
+	av_frame_free(&avframePtr);
+	return false;
+}
+
+void Decoder::ProcessFrame(AVFrame *avframePtr, std::unique_ptr<Frame>& framePtr)
+{
+	for (auto sinkPtr : frameSinks_)
+		sinkPtr->FrameDecoded(avframePtr);
+
+	++stats_.decodedFrames;
+
+	// A decoded frame is new unless the hash says otherwise, a packet left undecoded before it
+	// must not hold the display.
+	frameChanged_ = true;
+
+	if (params_.skipUnchangedFrames)
+	{
+		// A still scene, or a camera resending the same picture, hashes the same.
+		const uint64_t lumaHash = LumaHash(avframePtr);
+		frameChanged_ = framePtr == nullptr || lumaHash != lumaHash_ ||
+			framePtr->Width() != static_cast<uint32_t>(avframePtr->width) ||
+			framePtr->Height() != static_cast<uint32_t>(avframePtr->height);
+		lumaHash_ = lumaHash;
+
+		if (!frameChanged_)
+			++stats_.skippedFrames;
+	}
+
+	if (!params_.convertFrames || !frameChanged_)
+		return;
+
+	if (framePtr == nullptr)
+	{
+		framePtr = make_unique<Frame>(avframePtr->width,
+			avframePtr->height, params_.frameFormat);
+	}
+
+	// The cached context is only rebuilt when the frame size or format changes.
+	imageConvertCtxPtr_ = sws_getCachedContext(imageConvertCtxPtr_,
+		avframePtr->width, avframePtr->height, static_cast<AVPixelFormat>(avframePtr->format),
+		avframePtr->width, avframePtr->height, framePtr->AvFormat(),
+		SWS_BICUBIC, nullptr, nullptr, nullptr);
+
+	if (imageConvertCtxPtr_ == nullptr)
+		throw runtime_error("sws_getCachedContext() failed");
+
+	// The frame takes the size of the decoded one, whether it is another stream
+	// of the camera or a resolution change within the stream.
+	framePtr->Update(imageConvertCtxPtr_, avframePtr);
+}
+
+void Decoder::CacheGopPacket(AVPacket const& packet, bool keyframe)
+{
+	if (keyframe)
+		ClearGop();
+
+	// The cache of the stream has the group, a group kept from the pool lasts until the next keyframe.
+	if (gopCachePtr_ != nullptr && gopPackets_.empty())
+		return;
+
+	// Without its keyframe a group is useless, as is one too long to keep.
+	if (gopPackets_.empty() && !keyframe)
+		return;
+
+	if (gopBytes_ + packet.size > MaxGopBytes)
+	{
+		ClearGop();
+		return;
+	}
+
+	AVPacket gopPacket;
+	if (av_copy_packet(&gopPacket, &packet) < 0)
+		throw runtime_error("av_copy_packet() failed");
+
+	gopPackets_.push_back(gopPacket);
+	gopBytes_ += packet.size;
+}
+
+bool Decoder::ReplayGop(std::unique_ptr<Frame>& framePtr)
+{
+	// The first call decodes up to the keyframe picture, so that it is shown at once,
+	// the second one decodes the rest of the group and shows its last picture.
+	const bool firstCall = gopReplayIndex_ == 0 && gopReplaySequence_ == 0;
+	if (firstCall)
+		avcodec_flush_buffers(codecCtxPtr_);
+
+	AVFrame *decodedFramePtr = av_frame_alloc();
+	AVFrame *lastFramePtr = av_frame_alloc();
+	bool frameFinished = false;
+
+	for (;;)
+	{
+		AVPacket packet;
+		if (!NextGopPacket(packet))
+		{
+			ClearGop();
+			replayingGop_ = false;
+			break;
+		}
+
+		int finished = 0;
+		avcodec_decode_video2(codecCtxPtr_, decodedFramePtr, &finished, &packet);
+		av_free_packet(&packet);
+
+		if (finished != 0)
+		{
+			// The decoder reuses the frame it is given, the finished picture is moved out of it.
+			av_frame_unref(lastFramePtr);
+			av_frame_move_ref(lastFramePtr, decodedFramePtr);
+			frameFinished = true;
+
+			if (firstCall)
+				break;
+		}
+	}
+
+	try
+	{
+		if (frameFinished)
+			ProcessFrame(lastFramePtr, framePtr);
+		else
+			frameChanged_ = false;
+	}
+	catch (runtime_error&)
+	{
+		av_frame_free(&decodedFramePtr);
+		av_frame_free(&lastFramePtr);
+		throw;
+	}
+
+	av_frame_free(&decodedFramePtr);
+	av_frame_free(&lastFramePtr);
+
+	return true;
+}
+
+bool Decoder::NextGopPacket(AVPacket &packet)
+{
+	// A group the decoder kept from the pool comes first, it is newer than an empty cache.
+	if (!gopPackets_.empty())
+	{
+		if (gopReplayIndex_ == gopPackets_.size())
+			return false;
+
+		av_init_packet(&packet);
+		return av_copy_packet(&packet, &gopPackets_[gopReplayIndex_++]) >= 0;
+	}
+
+	return gopCachePtr_ != nullptr && gopCachePtr_->Next(gopReplaySequence_, packet);
+}
+
+void Decoder::ClearGop()
+{
+	for (auto& gopPacket : gopPackets_)
+		av_free_packet(&gopPacket);
+
+	gopPackets_.clear();
+	gopBytes_ = 0;
+	gopReplayIndex_ = 0;
+	gopReplaySequence_ = 0;
+}
+
+void Decoder::SeekToOffset(int64_t offset)
+{
+	int error = av_seek_frame(formatCtxPtr_, videoStreamIndex_, offset, AVSEEK_FLAG_BYTE);
+	if (error < 0)
+	{
+		throw runtime_error("av_seek_frame() failed: " + AvStrError(error));
+	}
+
+	avcodec_flush_buffers(codecCtxPtr_);
+}
+
+void Decoder::AddPacketSink(PacketSink *sinkPtr)
+{
+	sinkPtr->StreamOpened(formatCtxPtr_->streams[videoStreamIndex_]);
+	packetSinks_.push_back(sinkPtr);
+}
+
+void Decoder::AddFrameSink(FrameSink *sinkPtr)
+{
+	sinkPtr->StreamOpened(formatCtxPtr_->streams[videoStreamIndex_]);
+	frameSinks_.push_back(sinkPtr);
+}
+
+void Decoder::FollowSource(GopCache *leadPtr)
+{
+	if (leadPtr->Matches(codecCtxPtr_))
+	{
+		leadPtr_ = leadPtr;
+		leadSequence_ = 0;
+	}
+}
+
+bool Decoder::DecodeLead(AVFrame *avframePtr, std::unique_ptr<Frame>& framePtr)
+{
+	// The first call decodes the whole cached group, faster than real time, the next ones
+	// the packets the lead received since.
+	AVFrame *lastFramePtr = av_frame_alloc();
+	bool frameFinished = false;
+
+	AVPacket packet;
+	while (leadPtr_->Next(leadSequence_, packet))
+	{
+		int finished = 0;
+		avcodec_decode_video2(codecCtxPtr_, avframePtr, &finished, &packet);
+		av_free_packet(&packet);
+
+		if (finished != 0)
+		{
+			av_frame_unref(lastFramePtr);
+			av_frame_move_ref(lastFramePtr, avframePtr);
+			frameFinished = true;
+		}
 	}
+
+	try
+	{
+		if (frameFinished)
+			ProcessFrame(lastFramePtr, framePtr);
+		else
+			frameChanged_ = false;
+	}
+	catch (runtime_error&)
+	{
+		av_frame_free(&avframePtr);
+		av_frame_free(&lastFramePtr);
+		throw;
+	}
+
+	av_frame_free(&avframePtr);
+	av_frame_free(&lastFramePtr);
+
+	return true;
+}
+
+void Decoder::SetGopCache(GopCache *gopCachePtr)
+{
+	AddPacketSink(gopCachePtr);
+	gopCachePtr_ = gopCachePtr;
+}
+
+void Decoder::RemoveSinks()
+{
+	// The cache followed belongs to the other stream, it may go before this decoder does.
+	leadPtr_ = nullptr;
+	gopCachePtr_ = nullptr;
+	packetSinks_.clear();
+	frameSinks_.clear();
+}
+
+int64_t Decoder::MemoryBytes() const
+{
+	// The reference pictures of a 4:2:0 stream and the picture being decoded, the kept
+	// group of pictures and the input buffer.
+	const int64_t pictureBytes = static_cast<int64_t>(codecCtxPtr_->width) * codecCtxPtr_->height * 3 / 2;
+	const int64_t pictureCount = (codecCtxPtr_->refs > 0 ? codecCtxPtr_->refs : 1) + 1;
+
+	return pictureBytes * pictureCount + static_cast<int64_t>(gopBytes_) + IoBufferSize;
 }
 
 int32_t Decoder::InterframeDelayInMilliseconds() const
@@ -145,6 +648,141 @@ int32_t Decoder::InterframeDelayInMilliseconds() const
 		codecCtxPtr_->time_base.num / codecCtxPtr_->time_base.den;
 }
 
+int32_t Decoder::SelectVideoStream() const
+{
+	// The stream FFmpeg ranks best, by the frames probed, the resolution and the bit rate.
+	const int32_t bestIndex = av_find_best_stream(formatCtxPtr_, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+
+	if (params_.maxWidth <= 0 && params_.maxHeight <= 0 && params_.maxBitRate <= 0 &&
+		params_.preferredCodec.empty())
+	{
+		return bestIndex;
+	}
+
+	AVCodec const *preferredCodecPtr = params_.preferredCodec.empty() ?
+		nullptr : avcodec_find_decoder_by_name(params_.preferredCodec.c_str());
+
+	int32_t selectedIndex = -1;
+	bool selectedCodecMatch = false;
+	int64_t selectedPixels = 0;
+	int64_t selectedBitRate = 0;
+
+	for (uint32_t i = 0; i < formatCtxPtr_->nb_streams; i++)
+	{
+		AVCodecContext const *codecCtxPtr = formatCtxPtr_->streams[i]->codec;
+		if (codecCtxPtr->codec_type != AVMEDIA_TYPE_VIDEO)
+			continue;
+
+		if ((params_.maxWidth > 0 && codecCtxPtr->width > params_.maxWidth) ||
+			(params_.maxHeight > 0 && codecCtxPtr->height > params_.maxHeight) ||
+			(params_.maxBitRate > 0 && codecCtxPtr->bit_rate > params_.maxBitRate))
+		{
+			continue;
+		}
+
+		const bool codecMatch = preferredCodecPtr != nullptr && codecCtxPtr->codec_id == preferredCodecPtr->id;
+		const int64_t pixels = static_cast<int64_t>(codecCtxPtr->width) * codecCtxPtr->height;
+
+		if (selectedIndex < 0 ||
+			std::tie(codecMatch, pixels, codecCtxPtr->bit_rate) > std::tie(selectedCodecMatch, selectedPixels, selectedBitRate))
+		{
+			selectedIndex = i;
+			selectedCodecMatch = codecMatch;
+			selectedPixels = pixels;
+			selectedBitRate = codecCtxPtr->bit_rate;
+		}
+	}
+
+	return selectedIndex >= 0 ? selectedIndex : bestIndex;
+}
+
+uint64_t Decoder::LumaHash(AVFrame const *framePtr)
+{
+	// FNV-1a over 8-byte words of every 8th row of the first plane.
+	const uint64_t Prime = 0x100000001B3ULL;
+	uint64_t hash = 0xCBF29CE484222325ULL;
+
+	const int32_t wordCount = framePtr->width / 8;
+
+	for (int32_t y = 0; y < framePtr->height; y += 8)
+	{
+		uint8_t const *rowPtr = framePtr->data[0] + y * framePtr->linesize[0];
+
+		for (int32_t i = 0; i < wordCount; ++i)
+		{
+			uint64_t word;
+			memcpy(&word, rowPtr + i * 8, sizeof(word));
+
+			hash = (hash ^ word) * Prime;
+		}
+	}
+
+	return hash;
+}
+
+int Decoder::Interrupt(void *opaque)
+{
+	Decoder const *decoderPtr = static_cast<Decoder const *>(opaque);
+
+	if (decoderPtr->cancelRequestedPtr_ != nullptr && *decoderPtr->cancelRequestedPtr_)
+		return 1;
+
+	if (decoderPtr->cancelDeadlinePtr_ != nullptr && CancelDeadline(0) >= *decoderPtr->cancelDeadlinePtr_)
+		return 1;
+
+	return Clock::now() > decoderPtr->deadline_ ? 1 : 0;
+}
+
+int64_t Decoder::CancelDeadline(uint32_t delayInMilliseconds)
+{
+	return boost::chrono::duration_cast<boost::chrono::milliseconds>(
+		Clock::now().time_since_epoch()).count() + delayInMilliseconds;
+}
+
+int Decoder::ReadInput(void *opaque, uint8_t *bufferPtr, int size)
+{
+	Decoder *decoderPtr = static_cast<Decoder *>(opaque);
+	return decoderPtr->inputPtr_->Read(bufferPtr, size, decoderPtr->formatCtxPtr_->interrupt_callback);
+}
+
+void Decoder::FreeInput()
+{
+	// The format context does not free a custom I/O context.
+	if (ioCtxPtr_ != nullptr)
+	{
+		av_freep(&ioCtxPtr_->buffer);
+		av_freep(&ioCtxPtr_);
+	}
+
+	inputPtr_.reset();
+}
+
+StreamInfo Decoder::Info() const
+{
+	StreamInfo info;
+	info.formatName = formatCtxPtr_->iformat->name;
+
+	return info;
+}
+
+bool Decoder::InputReady() const
+{
+	if (inputPtr_ == nullptr || primedFramePtr_ != nullptr || replayingGop_)
+		return true;
+
+	// The bytes the demuxer already holds count as well.
+	const int64_t bufferedBytes = static_cast<int64_t>(inputPtr_->Available()) +
+		(ioCtxPtr_->buf_end - ioCtxPtr_->buf_ptr);
+
+	return inputPtr_->Ended() || bufferedBytes >= averagePacketBytes_;
+}
+
+void Decoder::StartOperation(uint32_t timeoutInMilliseconds)
+{
+	deadline_ = timeoutInMilliseconds > 0 ?
+		Clock::now() + boost::chrono::milliseconds(timeoutInMilliseconds) : Clock::time_point::max();
+}
+
 string Decoder::AvStrError(int errnum)
 {
 	char buf[128];
@@ -154,6 +792,13 @@ string Decoder::AvStrError(int errnum)
 
 Decoder::~Decoder()
 {
+	for (auto& primedPacket : primedPackets_)
+		av_free_packet(&primedPacket);
+
+	av_frame_free(&primedFramePtr_);
+
+	ClearGop();
+
 	if (imageConvertCtxPtr_ != nullptr)
 	{
 		sws_freeContext(imageConvertCtxPtr_);
@@ -162,4 +807,5 @@ Decoder::~Decoder()
 	avcodec_close(codecCtxPtr_);
 	avformat_close_input(&formatCtxPtr_);
 	avformat_free_context(formatCtxPtr_);
+	FreeInput();
 }
\ No newline at end of file
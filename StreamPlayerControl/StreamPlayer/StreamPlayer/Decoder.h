@@ -4,6 +4,8 @@
 #include <cstdint>
 #include <string>
 #include <memory>
+#include <vector>
+#include <deque>
 #include <boost/noncopyable.hpp>
 
 #pragma warning( push )
@@ -13,6 +15,10 @@
 
 #pragma warning( pop )
 
+#include <boost/atomic.hpp>
+
+#include "frame.h"
+
 namespace FFmpeg
 {
 
@@ -47,7 +53,143 @@ namespace FFmpeg
 
 	namespace Facade
 	{
-		class Frame;
+		class PacketSink;
+		class FrameSink;
+		class InputSource;
+		class NetReactor;
+		class GopCache;
+
+		/// <summary>
+		/// How an RTSP stream is received.
+		/// </summary>
+		enum RtspTransport
+		{
+			// UDP, or TCP if UDP cannot be set up.
+			DefaultTransport,
+			UdpTransport,
+			TcpTransport,
+			MulticastTransport
+		};
+
+		/// <summary>
+		/// A TransportProfile structure contains how a stream is received, trading latency against artifacts.
+		/// </summary>
+		struct TransportProfile
+		{
+			TransportProfile()
+				: transport(DefaultTransport), reorderQueueSize(-1), socketBufferSize(0),
+				maxDelayInMilliseconds(-1), lowDelay(0), fallbackLossPercent(0) {}
+
+			// An RtspTransport value.
+			int32_t transport;
+			// The RTP packets held to put them back in order, -1 for the FFmpeg default.
+			int32_t reorderQueueSize;
+			// The receive buffer of the socket, in bytes, zero for the FFmpeg default.
+			int32_t socketBufferSize;
+			// How long a missing packet is waited for, -1 for the FFmpeg default.
+			int32_t maxDelayInMilliseconds;
+			// Non-zero to skip the demuxer buffering and have the codec output frames without delay.
+			int32_t lowDelay;
+			// Moves a stream received over UDP to TCP when this share of its packets is damaged
+			// for several seconds, zero to never move it.
+			int32_t fallbackLossPercent;
+		};
+
+		/// <summary>
+		/// A StreamInfo structure contains what opening a stream found out, so that reopening it probes less.
+		/// </summary>
+		struct StreamInfo
+		{
+			// The demuxer of the stream, or empty if the stream is probed.
+			std::string formatName;
+		};
+
+		/// <summary>
+		/// A DecoderParams structure contains the information that is used to open a stream.
+		/// </summary>
+		struct DecoderParams
+		{
+			DecoderParams()
+				: exportMotionVectors(false), convertFrames(true), skipUnchangedFrames(false),
+				frameFormat(Bgr24Format), maxWidth(0), maxHeight(0), maxBitRate(0),
+				openTimeoutInMilliseconds(10000), readTimeoutInMilliseconds(5000), frameTimeoutInMilliseconds(0),
+				netReactorPtr(nullptr) {}
+
+			// Makes the codec export motion vectors as frame side data (H.264, MPEG-4 and similar).
+			bool exportMotionVectors;
+			// Converts decoded frames for display, when false only the frame sinks get the frames.
+			bool convertFrames;
+			// Skips the conversion of frames whose sampled luma matches the previous frame.
+			bool skipUnchangedFrames;
+			// The pixel layout frames are converted to.
+			FrameFormat frameFormat;
+
+			// Video stream preferences, zero or empty for no preference. Streams within the limits
+			// are ranked by the codec, then the resolution, then the bit rate; when none is within
+			// the limits the stream FFmpeg ranks best is played.
+			int32_t maxWidth;
+			int32_t maxHeight;
+			int64_t maxBitRate;
+			std::string preferredCodec;
+
+			// How long opening the stream and reading a packet may block, zero for no limit.
+			uint32_t openTimeoutInMilliseconds;
+			uint32_t readTimeoutInMilliseconds;
+			// How long packets may be read with no frame decoded from them, zero for no limit.
+			uint32_t frameTimeoutInMilliseconds;
+
+			// Reads http:// and tcp:// streams on the reactor threads instead of the FFmpeg protocols, or nullptr.
+			// A stream the reactor input cannot open falls back to the FFmpeg protocols.
+			NetReactor *netReactorPtr;
+			// The input to demux instead of the url, or nullptr.
+			std::shared_ptr<InputSource> inputPtr;
+			// The RTSP receiving options.
+			TransportProfile transport;
+			// The info of an earlier open of the same url, skips the demuxer probe and shortens the analysis.
+			StreamInfo streamInfo;
+		};
+
+		/// <summary>
+		/// How much of a stream is decoded.
+		/// </summary>
+		enum DecodeMode
+		{
+			FullDecoding,
+			// Only keyframes are decoded, the other packets are passed to the packet sinks.
+			KeyframeDecoding,
+			// Packets are read and passed to the packet sinks, nothing is decoded.
+			NoDecoding
+		};
+
+		/// <summary>
+		/// A StreamStats structure contains the counters of a stream.
+		/// </summary>
+		struct StreamStats
+		{
+			StreamStats()
+				: decodedFrames(0), skippedFrames(0), decodeMode(FullDecoding), cpuCycles(0),
+				reconnects(0), recoveryMilliseconds(0), urlIndex(0),
+				receivedPackets(0), corruptPackets(0), transport(DefaultTransport) {}
+
+			int64_t decodedFrames;
+			// The frames that matched the previous one and were neither converted nor drawn.
+			int64_t skippedFrames;
+			// The current DecodeMode of the stream.
+			int32_t decodeMode;
+			// The CPU cycles spent reading and decoding the stream.
+			int64_t cpuCycles;
+			// The times the watchdog brought the stream back.
+			int32_t reconnects;
+			// How long the last outage lasted, from the last frame before it to the first one after.
+			int64_t recoveryMilliseconds;
+			// The url playing, 0 for the stream url and from 1 on for the backup ones.
+			int32_t urlIndex;
+			// The video packets read, and those that were damaged or failed to decode.
+			int64_t receivedPackets;
+			int64_t corruptPackets;
+			// The RtspTransport in use, which a fallback changes.
+			int32_t transport;
+		};
 
 		/// <summary>
 		/// A Decoder class converts a stream into a set of frames. 
@@ -59,13 +201,135 @@ namespace FFmpeg
 			/// Initializes a new instance of the Frame class.
 			/// </summary>
 			/// <param name="streamUrl">The url of a stream to decode.</param>
-			Decoder(std::string const& streamUrl);
+			/// <param name="params">The decoding options.</param>
+			/// <param name="cancelRequestedPtr">A flag that interrupts the blocking operations when set, or nullptr.</param>
+			/// <param name="cancelDeadlinePtr">A time past which the blocking operations are interrupted, or nullptr,
+			/// see SetCancelDeadline.</param>
+			Decoder(std::string const& streamUrl, DecoderParams const& params = DecoderParams(),
+				boost::atomic<bool> const *cancelRequestedPtr = nullptr,
+				boost::atomic<int64_t> const *cancelDeadlinePtr = nullptr);
 
 			/// <summary>
 			/// Gets the next frame in a stream.
 			/// </summary>
-			/// <param name="framePtr">The next frame in a stream.</param>
-			void GetNextFrame(std::unique_ptr<Frame>& framePtr);
+			/// <param name="framePtr">The next frame in a stream, left untouched if frames are not converted.</param>
+			/// <returns>false if the end of the stream is reached.</returns>
+			/// <remarks>Unless the stream is fully decoded, a packet that is not decoded counts as
+			/// an unchanged frame, so the call returns at the stream rate.</remarks>
+			bool GetNextFrame(std::unique_ptr<Frame>& framePtr);
+
+			/// <summary>
+			/// Sets how much of the stream is decoded. Less decoding takes effect at once,
+			/// more decoding at the next keyframe, so that no broken picture is shown. While the
+			/// stream is not fully decoded the packets since the last keyframe are kept, and going
+			/// back to full decoding replays them instead of waiting: the next call returns the
+			/// keyframe and the one after it catches up with the rest of the group.
+			/// </summary>
+			void SetDecodeMode(DecodeMode mode) { decodeMode_ = mode; }
+
+			/// <summary>
+			/// Gets the DecodeMode in effect.
+			/// </summary>
+			DecodeMode CurrentDecodeMode() const { return appliedDecodeMode_; }
+
+			/// <summary>
+			/// Reads the stream up to its first keyframe and decodes it, so that the next
+			/// GetNextFrame() returns a complete picture at once. Sinks added afterwards
+			/// get the packets read from the keyframe on.
+			/// </summary>
+			/// <param name="cancelRequested">Stops priming when set.</param>
+			/// <returns>false if cancelled or the end of the stream is reached.</returns>
+			bool Prime(boost::atomic<bool> const& cancelRequested);
+
+			/// <summary>
+			/// Gets whether the last frame differs from the previous one, unchanged frames are not converted.
+			/// </summary>
+			bool FrameChanged() const { return frameChanged_; }
+
+			/// <summary>
+			/// Gets whether the next frame is likely to be read without blocking on the network,
+			/// always true for the streams that are not read through a NetReactor.
+			/// </summary>
+			bool InputReady() const;
+
+			/// <summary>
+			/// Gets what opening the stream found out, to reopen it with.
+			/// </summary>
+			StreamInfo Info() const;
+
+			/// <summary>
+			/// Gets whether the codec was opened to export motion vectors with the frames.
+			/// </summary>
+			bool MotionVectorsExported() const { return params_.exportMotionVectors; }
+
+			/// <summary>
+			/// Gets the counters of the stream.
+			/// </summary>
+			StreamStats const& Stats() const { return stats_; }
+
+			/// <summary>
+			/// Continues decoding from a byte offset, which should be the start of a keyframe.
+			/// </summary>
+			/// <param name="offset">The offset in the stream, in bytes.</param>
+			void SeekToOffset(int64_t offset);
+
+			/// <summary>
+			/// Adds a sink that receives every compressed packet of the video stream.
+			/// </summary>
+			/// <param name="sinkPtr">The sink, must outlive the decoder.</param>
+			void AddPacketSink(PacketSink *sinkPtr);
+
+			/// <summary>
+			/// Adds a sink that receives every decoded frame before it is converted for display.
+			/// </summary>
+			/// <param name="sinkPtr">The sink, must outlive the decoder.</param>
+			void AddFrameSink(FrameSink *sinkPtr);
+
+			/// <summary>
+			/// Decodes the packets of another stream of the same source until the first keyframe
+			/// of this one, so that the picture shows at once instead of after that keyframe.
+			/// Nothing is followed unless the other stream has the same codec and size.
+			/// </summary>
+			/// <param name="leadPtr">The cache of the other stream, must outlive the following.</param>
+			void FollowSource(GopCache *leadPtr);
+
+			/// <summary>
+			/// Adds the cache of the stream as its first packet sink. The decoder then resumes full
+			/// decoding from the group in the cache and keeps no group of its own.
+			/// </summary>
+			/// <param name="gopCachePtr">The cache, must outlive the decoder or be removed with RemoveSinks.</param>
+			void SetGopCache(GopCache *gopCachePtr);
+
+			/// <summary>
+			/// Removes the sinks, the decoder outlives them in a DecoderPool.
+			/// </summary>
+			void RemoveSinks();
+
+			/// <summary>
+			/// Sets the flag that interrupts the blocking operations, for a decoder handed over to another owner.
+			/// </summary>
+			/// <param name="cancelRequestedPtr">The flag, or nullptr.</param>
+			void SetCancelFlag(boost::atomic<bool> const *cancelRequestedPtr) { cancelRequestedPtr_ = cancelRequestedPtr; }
+
+			/// <summary>
+			/// Sets the time past which the blocking operations are interrupted. Unlike the flag, a deadline
+			/// lets the packet being read finish first, leaving the decoder fit to read on.
+			/// </summary>
+			/// <param name="cancelDeadlinePtr">The deadline, see CancelDeadline, or nullptr.</param>
+			void SetCancelDeadline(boost::atomic<int64_t> const *cancelDeadlinePtr) { cancelDeadlinePtr_ = cancelDeadlinePtr; }
+
+			/// <summary>
+			/// Gets a cancel deadline some time from now, NoCancelDeadline for none.
+			/// </summary>
+			/// <param name="delayInMilliseconds">The time the blocking operations are given.</param>
+			static int64_t CancelDeadline(uint32_t delayInMilliseconds);
+
+			static const int64_t NoCancelDeadline = INT64_MAX;
+
+			/// <summary>
+			/// Gets an estimate of the memory the decoder holds, in bytes.
+			/// </summary>
+			int64_t MemoryBytes() const;
 
 			/// <summary>
 			/// Gets an interframe delay, in milliseconds.
@@ -79,12 +343,68 @@ namespace FFmpeg
 
 		private:
 
+			typedef boost::chrono::steady_clock Clock;
+
 			static std::string AvStrError(int errnum);
+
+			static int Interrupt(void *opaque);
+
+			static int ReadInput(void *opaque, uint8_t *bufferPtr, int size);
+
+			void FreeInput();
+
+			void StartOperation(uint32_t timeoutInMilliseconds);
+
+			int32_t SelectVideoStream() const;
+
+			void ProcessFrame(AVFrame *avframePtr, std::unique_ptr<Frame>& framePtr);
+
+			void CacheGopPacket(AVPacket const& packet, bool keyframe);
+
+			bool ReplayGop(std::unique_ptr<Frame>& framePtr);
+
+			bool NextGopPacket(AVPacket &packet);
+
+			void ClearGop();
+
+			bool DecodeLead(AVFrame *avframePtr, std::unique_ptr<Frame>& framePtr);
+
+			static uint64_t LumaHash(AVFrame const *framePtr);
 						
+			std::shared_ptr<InputSource> inputPtr_;
+			AVIOContext *ioCtxPtr_;
+			// The mean size of the last packets, the data a read likely waits for.
+			int64_t averagePacketBytes_;
 			AVFormatContext *formatCtxPtr_;
 			AVCodecContext  *codecCtxPtr_;			
 			int32_t videoStreamIndex_;			
 			SwsContext *imageConvertCtxPtr_;
+			DecoderParams params_;
+			boost::atomic<bool> const *cancelRequestedPtr_;
+			boost::atomic<int64_t> const *cancelDeadlinePtr_;
+			// The stream decoded until the first keyframe of this one, or nullptr.
+			GopCache *leadPtr_;
+			uint64_t leadSequence_;
+			// When the blocking operation in progress is interrupted.
+			Clock::time_point deadline_;
+			std::deque<AVPacket> primedPackets_;
+			AVFrame *primedFramePtr_;
+			StreamStats stats_;
+			DecodeMode decodeMode_;
+			DecodeMode appliedDecodeMode_;
+			// The cache of the stream, or nullptr.
+			GopCache *gopCachePtr_;
+			// The packets since the last keyframe, kept while the stream is not fully decoded and
+			// has no cache, that is in a DecoderPool.
+			std::deque<AVPacket> gopPackets_;
+			size_t gopBytes_;
+			size_t gopReplayIndex_;
+			uint64_t gopReplaySequence_;
+			bool replayingGop_;
+			uint64_t lumaHash_;
+			bool frameChanged_;
+			std::vector<PacketSink *> packetSinks_;
+			std::vector<FrameSink *> frameSinks_;
 		};
 	}
 }
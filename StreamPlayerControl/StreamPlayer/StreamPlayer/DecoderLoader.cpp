@@ -0,0 +1,54 @@
+#include "decoderloader.h"
+#include <stdexcept>
+
+using namespace std;
+using namespace FFmpeg;
+using namespace FFmpeg::Facade;
+
+DecoderLoader::DecoderLoader()
+	: loading_(false), ready_(false), cancelRequested_(false) {}
+
+void DecoderLoader::Start(string const& streamUrl, DecoderParams const& params)
+{
+	streamUrl_ = streamUrl;
+	params_ = params;
+	decoderPtr_.reset();
+	loading_ = true;
+	ready_ = false;
+	cancelRequested_ = false;
+
+	thread_ = boost::thread(&DecoderLoader::Load, this);
+}
+
+unique_ptr<Decoder> DecoderLoader::Take()
+{
+	thread_.join();
+	loading_ = false;
+	ready_ = false;
+
+	return move(decoderPtr_);
+}
+
+void DecoderLoader::Load()
+{
+	try
+	{
+		unique_ptr<Decoder> decoderPtr = make_unique<Decoder>(streamUrl_, params_, &cancelRequested_);
+		if (decoderPtr->Prime(cancelRequested_))
+			decoderPtr_ = move(decoderPtr);
+	}
+	catch (runtime_error&)
+	{
+		// Ready with no decoder, the current stream keeps playing.
+	}
+
+	ready_ = true;
+}
+
+DecoderLoader::~DecoderLoader()
+{
+	cancelRequested_ = true;
+
+	if (thread_.joinable())
+		thread_.join();
+}
@@ -0,0 +1,82 @@
+#ifndef FFMPEG_FACADE_DECODERLOADER_H
+#define FFMPEG_FACADE_DECODERLOADER_H
+
+#include <string>
+#include <memory>
+#include <boost/noncopyable.hpp>
+
+#pragma warning( push )
+#pragma warning( disable : 4100 )
+
+#include <boost/thread.hpp>
+
+#pragma warning( pop )
+
+#include <boost/atomic.hpp>
+
+#include "decoder.h"
+
+namespace FFmpeg
+{
+	namespace Facade
+	{
+		/// <summary>
+		/// A DecoderLoader class opens a stream on a background thread and primes its decoder
+		/// to the first keyframe, while the current stream keeps playing.
+		/// </summary>
+		class DecoderLoader : private boost::noncopyable
+		{
+		public:
+			/// <summary>
+			/// Initializes a new instance of the DecoderLoader class.
+			/// </summary>
+			DecoderLoader();
+
+			/// <summary>
+			/// Starts loading a stream, the loader must not be loading another one.
+			/// </summary>
+			/// <param name="streamUrl">The url of a stream to load.</param>
+			/// <param name="params">The decoding options.</param>
+			void Start(std::string const& streamUrl, DecoderParams const& params);
+
+			/// <summary>
+			/// Gets whether a stream is being loaded or waits to be taken.
+			/// </summary>
+			bool Loading() const { return loading_; }
+
+			/// <summary>
+			/// Gets whether the loading has finished, successfully or not.
+			/// </summary>
+			bool Ready() const { return ready_; }
+
+			/// <summary>
+			/// Gets the url of the stream being loaded.
+			/// </summary>
+			std::string const& Url() const { return streamUrl_; }
+
+			/// <summary>
+			/// Takes the primed decoder once Ready() is set.
+			/// </summary>
+			/// <returns>The decoder, nullptr if the stream failed to load.</returns>
+			std::unique_ptr<Decoder> Take();
+
+			/// <summary>
+			/// Releases all resources used by the loader, cancelling the loading.
+			/// </summary>
+			~DecoderLoader();
+
+		private:
+			void Load();
+
+			std::string streamUrl_;
+			DecoderParams params_;
+			std::unique_ptr<Decoder> decoderPtr_;
+			bool loading_;
+			boost::atomic<bool> ready_;
+			boost::atomic<bool> cancelRequested_;
+			boost::thread thread_;
+		};
+	}
+}
+
+#endif // FFMPEG_FACADE_DECODERLOADER_H
@@ -0,0 +1,233 @@
+#include "decoderpool.h"
+#include <stdexcept>
+
+#include "frame.h"
+
+using namespace std;
+using namespace FFmpeg;
+using namespace FFmpeg::Facade;
+
+namespace
+{
+	// How long a take waits for the packet being read, a silent camera is reopened instead.
+	const uint32_t TakeTimeoutInMilliseconds = 500;
+}
+
+DecoderPool::Entry::Entry()
+	: takeRequested(false), takeDeadline(Decoder::NoCancelDeadline), closeRequested(false), failed(false),
+	memoryBytes(0) {}
+
+DecoderPool::DecoderPool()
+	: budgetInBytes_(0), trimRequested_(false), stopping_(false) {}
+
+void DecoderPool::SetBudget(int64_t budgetInBytes)
+{
+	Entries closedEntries;
+
+	{
+		boost::unique_lock<boost::mutex> lock(mutex_);
+		budgetInBytes_ = budgetInBytes;
+		Trim(closedEntries);
+	}
+
+	Close(closedEntries);
+}
+
+void DecoderPool::Park(string const& streamUrl, std::unique_ptr<Decoder> decoderPtr)
+{
+	std::unique_ptr<Entry> entryPtr = std::make_unique<Entry>();
+	entryPtr->streamUrl = streamUrl;
+	entryPtr->decoderPtr = std::move(decoderPtr);
+	entryPtr->decoderPtr->SetCancelFlag(&entryPtr->closeRequested);
+	entryPtr->decoderPtr->SetCancelDeadline(&entryPtr->takeDeadline);
+	entryPtr->decoderPtr->SetDecodeMode(NoDecoding);
+	entryPtr->memoryBytes = entryPtr->decoderPtr->MemoryBytes();
+	entryPtr->thread = boost::thread(&DecoderPool::Read, this, entryPtr.get());
+
+	Entries closedEntries;
+
+	{
+		boost::unique_lock<boost::mutex> lock(mutex_);
+
+		if (!trimThread_.joinable())
+			trimThread_ = boost::thread(&DecoderPool::TrimLoop, this);
+
+		// A url is parked once, the older decoder goes.
+		for (auto it = entries_.begin(); it != entries_.end();)
+		{
+			if ((*it)->streamUrl == streamUrl)
+				closedEntries.splice(closedEntries.end(), entries_, it++);
+			else
+				++it;
+		}
+
+		entries_.push_front(std::move(entryPtr));
+		Trim(closedEntries);
+	}
+
+	Close(closedEntries);
+}
+
+std::unique_ptr<Decoder> DecoderPool::Take(string const& streamUrl)
+{
+	std::unique_ptr<Entry> entryPtr;
+
+	{
+		boost::unique_lock<boost::mutex> lock(mutex_);
+
+		for (auto it = entries_.begin(); it != entries_.end(); ++it)
+		{
+			if ((*it)->streamUrl == streamUrl)
+			{
+				entryPtr = std::move(*it);
+				entries_.erase(it);
+				break;
+			}
+		}
+	}
+
+	if (entryPtr == nullptr)
+		return nullptr;
+
+	// The read in progress is let finish, an interrupted one could leave the demuxer mid-packet.
+	// One that takes too long is interrupted after all, and the stalled decoder closed.
+	entryPtr->takeDeadline = Decoder::CancelDeadline(TakeTimeoutInMilliseconds);
+	entryPtr->takeRequested = true;
+	entryPtr->thread.join();
+
+	if (entryPtr->failed)
+		return nullptr;
+
+	entryPtr->decoderPtr->SetCancelFlag(nullptr);
+	entryPtr->decoderPtr->SetCancelDeadline(nullptr);
+	return std::move(entryPtr->decoderPtr);
+}
+
+int32_t DecoderPool::Count()
+{
+	boost::unique_lock<boost::mutex> lock(mutex_);
+	return static_cast<int32_t>(entries_.size());
+}
+
+void DecoderPool::Clear()
+{
+	Entries closedEntries;
+
+	{
+		boost::unique_lock<boost::mutex> lock(mutex_);
+		closedEntries.swap(entries_);
+	}
+
+	Close(closedEntries);
+}
+
+void DecoderPool::Read(Entry *entryPtr)
+{
+	// Nothing is converted in standby, the frame stays empty.
+	std::unique_ptr<Frame> framePtr;
+
+	try
+	{
+		while (!entryPtr->takeRequested && !entryPtr->closeRequested)
+		{
+			if (!entryPtr->decoderPtr->GetNextFrame(framePtr))
+			{
+				entryPtr->failed = true;
+				break;
+			}
+
+			// The kept group grows with every packet, the pool is held to its budget as it does.
+			const int64_t memoryBytes = entryPtr->decoderPtr->MemoryBytes();
+			if (memoryBytes > entryPtr->memoryBytes.exchange(memoryBytes))
+				RequestTrim();
+		}
+	}
+	catch (runtime_error&)
+	{
+		entryPtr->failed = true;
+	}
+
+	// A failed decoder is closed now rather than at the next park.
+	if (entryPtr->failed)
+		RequestTrim();
+}
+
+void DecoderPool::RequestTrim()
+{
+	{
+		boost::unique_lock<boost::mutex> lock(mutex_);
+		trimRequested_ = true;
+	}
+
+	trimCondition_.notify_one();
+}
+
+void DecoderPool::TrimLoop()
+{
+	boost::unique_lock<boost::mutex> lock(mutex_);
+
+	for (;;)
+	{
+		while (!trimRequested_ && !stopping_)
+			trimCondition_.wait(lock);
+
+		if (stopping_)
+			return;
+
+		trimRequested_ = false;
+
+		Entries closedEntries;
+		Trim(closedEntries);
+
+		lock.unlock();
+		Close(closedEntries);
+		lock.lock();
+	}
+}
+
+void DecoderPool::Trim(Entries &closedEntries)
+{
+	int64_t memoryBytes = 0;
+
+	for (auto it = entries_.begin(); it != entries_.end();)
+	{
+		memoryBytes += (*it)->memoryBytes;
+
+		if ((*it)->failed || memoryBytes > budgetInBytes_)
+		{
+			memoryBytes -= (*it)->memoryBytes;
+			closedEntries.splice(closedEntries.end(), entries_, it++);
+		}
+		else
+		{
+			++it;
+		}
+	}
+}
+
+void DecoderPool::Close(Entries &entries)
+{
+	// Closed outside the lock, a read may take until its timeout to notice.
+	for (auto& entryPtr : entries)
+		entryPtr->closeRequested = true;
+
+	for (auto& entryPtr : entries)
+		entryPtr->thread.join();
+
+	entries.clear();
+}
+
+DecoderPool::~DecoderPool()
+{
+	{
+		boost::unique_lock<boost::mutex> lock(mutex_);
+		stopping_ = true;
+	}
+
+	trimCondition_.notify_one();
+
+	if (trimThread_.joinable())
+		trimThread_.join();
+
+	Clear();
+}
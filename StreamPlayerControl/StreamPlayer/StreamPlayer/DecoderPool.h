@@ -0,0 +1,130 @@
+#ifndef FFMPEG_FACADE_DECODERPOOL_H
+#define FFMPEG_FACADE_DECODERPOOL_H
+
+#include <string>
+#include <memory>
+#include <list>
+#include <boost/noncopyable.hpp>
+
+#pragma warning( push )
+#pragma warning( disable : 4100 )
+
+#include <boost/thread.hpp>
+
+#pragma warning( pop )
+
+#include <boost/atomic.hpp>
+
+#include "decoder.h"
+
+namespace FFmpeg
+{
+	namespace Facade
+	{
+		/// <summary>
+		/// A DecoderPool class keeps the decoders of recently stopped streams connected, so that
+		/// playing one of them again takes no reopening. A parked decoder is read in standby on
+		/// its own thread, keeping the group of pictures a resume starts from; the least recently
+		/// parked decoders are closed when the pool exceeds its memory budget.
+		/// </summary>
+		class DecoderPool : private boost::noncopyable
+		{
+		public:
+			/// <summary>
+			/// Initializes a new instance of the DecoderPool class.
+			/// </summary>
+			DecoderPool();
+
+			/// <summary>
+			/// Sets the memory the parked decoders may hold, closing the ones past it.
+			/// </summary>
+			/// <param name="budgetInBytes">The budget, in bytes, zero to keep no decoder.</param>
+			void SetBudget(int64_t budgetInBytes);
+
+			/// <summary>
+			/// Parks a decoder, which must have no sinks.
+			/// </summary>
+			/// <param name="streamUrl">The url the decoder plays.</param>
+			/// <param name="decoderPtr">The decoder.</param>
+			void Park(std::string const& streamUrl, std::unique_ptr<Decoder> decoderPtr);
+
+			/// <summary>
+			/// Takes the decoder parked for a url, in standby and with no cancel flag or deadline.
+			/// A decoder whose read does not finish shortly is closed instead.
+			/// </summary>
+			/// <param name="streamUrl">The url of a stream.</param>
+			/// <returns>The decoder, nullptr if none is parked, it failed or it stalled.</returns>
+			std::unique_ptr<Decoder> Take(std::string const& streamUrl);
+
+			/// <summary>
+			/// Gets the number of parked decoders.
+			/// </summary>
+			int32_t Count();
+
+			/// <summary>
+			/// Closes all the parked decoders.
+			/// </summary>
+			void Clear();
+
+			/// <summary>
+			/// Releases all resources used by the pool.
+			/// </summary>
+			~DecoderPool();
+
+		private:
+			/// <summary>
+			/// A parked decoder and the thread reading it.
+			/// </summary>
+			struct Entry : private boost::noncopyable
+			{
+				Entry();
+
+				std::string streamUrl;
+				std::unique_ptr<Decoder> decoderPtr;
+				// Ends the reading after the packet being read, the decoder is taken.
+				boost::atomic<bool> takeRequested;
+				// Interrupts a read that does not finish in time for the take.
+				boost::atomic<int64_t> takeDeadline;
+				// Interrupts the read in progress, the decoder is closed.
+				boost::atomic<bool> closeRequested;
+				boost::atomic<bool> failed;
+				boost::atomic<int64_t> memoryBytes;
+				boost::thread thread;
+			};
+
+			typedef std::list<std::unique_ptr<Entry>> Entries;
+
+			void Read(Entry *entryPtr);
+
+			/// <summary>
+			/// Wakes the trimming thread, a decoder grew or failed since it was parked.
+			/// </summary>
+			void RequestTrim();
+
+			/// <summary>
+			/// Trims the pool whenever a reader asks, on a thread of its own since a reader cannot close itself.
+			/// </summary>
+			void TrimLoop();
+
+			/// <summary>
+			/// Moves the entries past the budget, and the failed ones, out of the pool.
+			/// </summary>
+			void Trim(Entries &closedEntries);
+
+			static void Close(Entries &entries);
+
+			// The most recently parked decoder first.
+			Entries entries_;
+			int64_t budgetInBytes_;
+			boost::mutex mutex_;
+
+			// Started with the first parked decoder.
+			boost::thread trimThread_;
+			boost::condition_variable trimCondition_;
+			bool trimRequested_;
+			bool stopping_;
+		};
+	}
+}
+
+#endif // FFMPEG_FACADE_DECODERPOOL_H
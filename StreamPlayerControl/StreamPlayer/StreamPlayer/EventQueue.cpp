@@ -0,0 +1,53 @@
+#include "eventqueue.h"
+
+using namespace std;
+using namespace FFmpeg;
+using namespace FFmpeg::Facade;
+
+EventQueue::EventQueue()
+	: droppedEvents_(0), waiterCount_(0) {}
+
+bool EventQueue::Push(PlayerEvent const& event)
+{
+	if (!queue_.bounded_push(event))
+	{
+		++droppedEvents_;
+		return false;
+	}
+
+	if (waiterCount_ > 0)
+	{
+		boost::unique_lock<boost::mutex> lock(mutex_);
+		eventCondition_.notify_all();
+	}
+
+	return true;
+}
+
+bool EventQueue::Poll(PlayerEvent &event)
+{
+	return queue_.pop(event);
+}
+
+bool EventQueue::Wait(PlayerEvent &event, uint32_t timeoutInMilliseconds)
+{
+	if (queue_.pop(event))
+		return true;
+
+	const auto deadline = boost::chrono::steady_clock::now() + boost::chrono::milliseconds(timeoutInMilliseconds);
+
+	boost::unique_lock<boost::mutex> lock(mutex_);
+	++waiterCount_;
+
+	// The queue is checked again after the waiter is counted, a push in between wakes it.
+	bool popped = queue_.pop(event);
+	while (!popped && eventCondition_.wait_until(lock, deadline) != boost::cv_status::timeout)
+		popped = queue_.pop(event);
+
+	if (!popped)
+		popped = queue_.pop(event);
+
+	--waiterCount_;
+
+	return popped;
+}
@@ -0,0 +1,94 @@
+#ifndef FFMPEG_FACADE_EVENTQUEUE_H
+#define FFMPEG_FACADE_EVENTQUEUE_H
+
+#include <cstdint>
+#include <boost/noncopyable.hpp>
+
+#pragma warning( push )
+#pragma warning( disable : 4100 )
+
+#include <boost/thread.hpp>
+
+#pragma warning( pop )
+
+#include <boost/atomic.hpp>
+#include <boost/lockfree/queue.hpp>
+
+namespace FFmpeg
+{
+	namespace Facade
+	{
+		/// <summary>
+		/// The kinds of player events.
+		/// </summary>
+		enum PlayerEventType
+		{
+			StreamStartedEvent = 1,
+			StreamStoppedEvent,
+			StreamFailedEvent,
+			MotionStartedEvent,
+			MotionStoppedEvent
+		};
+
+		/// <summary>
+		/// A PlayerEvent structure describes something that happened to a stream.
+		/// </summary>
+		struct PlayerEvent
+		{
+			// A PlayerEventType value.
+			int32_t type;
+			uint32_t streamNum;
+			// The motion zone of the motion events.
+			uint32_t zoneNum;
+		};
+
+		/// <summary>
+		/// An EventQueue class passes the events of the decoding threads to a consumer,
+		/// which polls for them or waits on them.
+		/// </summary>
+		class EventQueue : private boost::noncopyable
+		{
+		public:
+			/// <summary>
+			/// Initializes a new instance of the EventQueue class.
+			/// </summary>
+			EventQueue();
+
+			/// <summary>
+			/// Queues an event, callable from any thread. Lock-free unless a consumer is waiting.
+			/// </summary>
+			/// <returns>false if the queue is full, the event is then dropped.</returns>
+			bool Push(PlayerEvent const& event);
+
+			/// <summary>
+			/// Takes the oldest event.
+			/// </summary>
+			/// <returns>false if there is none.</returns>
+			bool Poll(PlayerEvent &event);
+
+			/// <summary>
+			/// Takes the oldest event, waiting for one if there is none.
+			/// </summary>
+			/// <param name="timeoutInMilliseconds">How long to wait.</param>
+			/// <returns>false on timeout.</returns>
+			bool Wait(PlayerEvent &event, uint32_t timeoutInMilliseconds);
+
+			/// <summary>
+			/// Gets the number of events dropped because nobody took them.
+			/// </summary>
+			uint64_t DroppedEvents() const { return droppedEvents_; }
+
+		private:
+			// Bounded, so that a player nobody polls does not grow.
+			boost::lockfree::queue<PlayerEvent, boost::lockfree::capacity<1024>> queue_;
+			boost::atomic<uint64_t> droppedEvents_;
+
+			// The producers take the mutex only to wake a waiting consumer.
+			boost::atomic<uint32_t> waiterCount_;
+			boost::mutex mutex_;
+			boost::condition_variable eventCondition_;
+		};
+	}
+}
+
+#endif // FFMPEG_FACADE_EVENTQUEUE_H
@@ -1,8 +1,13 @@
 #include "frame.h"
+#include <algorithm>
 #include <cassert>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#include <malloc.h>
+#include <emmintrin.h>
 #include <boost/thread/locks.hpp>
 #include <Objbase.h>
-#define DRAWDIB_INCLUDE_STRETCHDIB
 #include <Vfw.h>
 
 using namespace std;
@@ -10,39 +15,273 @@ using namespace boost;
 using namespace FFmpeg;
 using namespace FFmpeg::Facade;
 
-Frame::Frame(uint32_t width, uint32_t height, AVPicture &avPicture)
-    : width_(width), height_(height)
+namespace
 {
-    int32_t lineSize = avPicture.linesize[0];
-    uint32_t padding = GetPadding(lineSize);
+	/// <summary>
+	/// A PixelTraits structure describes a frame format at compile time, so that every kernel
+	/// is instantiated per format and runs without per-pixel branches.
+	/// </summary>
+	template <FrameFormat Format>
+	struct PixelTraits;
 
-    pixelsPtr_ = new uint8_t[height_ * (lineSize + padding)];
+	template <>
+	struct PixelTraits<Bgr24Format>
+	{
+		static const uint32_t PixelSize = 3;
+		static const bool HasChroma = false;
+		static const AVPixelFormat AvFormat = AV_PIX_FMT_BGR24;
+
+		static void ToBgr24(uint8_t *dstPtr, uint8_t const *srcPtr, uint8_t const *, uint32_t width)
+		{
+			memcpy(dstPtr, srcPtr, width * 3);
+		}
+	};
+
+	template <>
+	struct PixelTraits<Bgra32Format>
+	{
+		static const uint32_t PixelSize = 4;
+		static const bool HasChroma = false;
+		static const AVPixelFormat AvFormat = AV_PIX_FMT_BGRA;
+
+		static void ToBgr24(uint8_t *dstPtr, uint8_t const *srcPtr, uint8_t const *, uint32_t width)
+		{
+			for (uint32_t x = 0; x < width; ++x, dstPtr += 3, srcPtr += 4)
+			{
+				dstPtr[0] = srcPtr[0];
+				dstPtr[1] = srcPtr[1];
+				dstPtr[2] = srcPtr[2];
+			}
+		}
+	};
+
+	template <>
+	struct PixelTraits<Gray8Format>
+	{
+		static const uint32_t PixelSize = 1;
+		static const bool HasChroma = false;
+		static const AVPixelFormat AvFormat = AV_PIX_FMT_GRAY8;
+
+		static void ToBgr24(uint8_t *dstPtr, uint8_t const *srcPtr, uint8_t const *, uint32_t width)
+		{
+			for (uint32_t x = 0; x < width; ++x, dstPtr += 3)
+				dstPtr[0] = dstPtr[1] = dstPtr[2] = srcPtr[x];
+		}
+	};
+
+	template <>
+	struct PixelTraits<Nv12Format>
+	{
+		// The luma plane, the overlays are drawn on it and the UV plane is only composited.
+		static const uint32_t PixelSize = 1;
+		static const bool HasChroma = true;
+		static const AVPixelFormat AvFormat = AV_PIX_FMT_NV12;
+
+		static uint8_t Clamp(int32_t value)
+		{
+			return static_cast<uint8_t>(value < 0 ? 0 : value > 0xFF ? 0xFF : value);
+		}
+
+		// BT.601 limited range, in 8.8 fixed point.
+		static void ToBgr24(uint8_t *dstPtr, uint8_t const *srcPtr, uint8_t const *chromaPtr, uint32_t width)
+		{
+			for (uint32_t x = 0; x < width; ++x, dstPtr += 3)
+			{
+				const int32_t c = 298 * (srcPtr[x] - 16) + 128;
+				const int32_t d = chromaPtr[x & ~1u] - 128;
+				const int32_t e = chromaPtr[x | 1u] - 128;
+
+				dstPtr[0] = Clamp((c + 516 * d) >> 8);
+				dstPtr[1] = Clamp((c - 100 * d - 208 * e) >> 8);
+				dstPtr[2] = Clamp((c + 409 * e) >> 8);
+			}
+		}
+	};
+
+	uint32_t PixelSizeOf(FrameFormat format)
+	{
+		switch (format)
+		{
+		case Bgra32Format:
+			return PixelTraits<Bgra32Format>::PixelSize;
+		case Gray8Format:
+			return PixelTraits<Gray8Format>::PixelSize;
+		case Nv12Format:
+			return PixelTraits<Nv12Format>::PixelSize;
+		default:
+			return PixelTraits<Bgr24Format>::PixelSize;
+		}
+	}
+
+	/// <summary>
+	/// Adds a value to every byte of a span with unsigned saturation.
+	/// </summary>
+	void AddSaturated(uint8_t *ptr, uint32_t size, uint8_t value)
+	{
+		const __m128i addend = _mm_set1_epi8(static_cast<char>(value));
+
+		uint32_t i = 0;
+		for (; i + 16 <= size; i += 16)
+		{
+			__m128i bytes = _mm_loadu_si128(reinterpret_cast<__m128i const *>(ptr + i));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(ptr + i), _mm_adds_epu8(bytes, addend));
+		}
+
+		for (; i < size; ++i)
+			ptr[i] = ptr[i] < 0xFF - value ? static_cast<uint8_t>(ptr[i] + value) : 0xFF;
+	}
+
+	/// <summary>
+	/// Scales a plane into a rectangle of another one with the nearest neighbour filter.
+	/// Rows of both planes are bottom-up, the rectangle is clipped to the destination plane.
+	/// </summary>
+	template <uint32_t PixelSize>
+	void ScalePlane(uint8_t *dstPtr, uint32_t dstStride, int32_t dstWidth, int32_t dstHeight,
+		int32_t left, int32_t bottom, int32_t width, int32_t height,
+		uint8_t const *srcPtr, uint32_t srcStride, int32_t srcWidth, int32_t srcHeight)
+	{
+		if (width <= 0 || height <= 0)
+			return;
+
+		const int32_t x0 = max(left, 0);
+		const int32_t x1 = min(left + width, dstWidth);
+		if (x0 >= x1)
+			return;
+
+		vector<uint32_t> srcOffsets(x1 - x0);
+		for (int32_t x = x0; x < x1; ++x)
+			srcOffsets[x - x0] = static_cast<uint32_t>((x - left) * srcWidth / width) * PixelSize;
+
+		const int32_t y0 = max(bottom, 0);
+		const int32_t y1 = min(bottom + height, dstHeight);
+
+		for (int32_t y = y0; y < y1; ++y)
+		{
+			uint8_t const *srcRowPtr = srcPtr + ((y - bottom) * srcHeight / height) * srcStride;
+			uint8_t *dstRowPtr = dstPtr + y * dstStride + x0 * PixelSize;
+
+			for (auto offset : srcOffsets)
+			{
+				// A constant size copy compiles to a single move.
+				memcpy(dstRowPtr, srcRowPtr + offset, PixelSize);
+				dstRowPtr += PixelSize;
+			}
+		}
+	}
+}
+
+Frame::Frame(uint32_t width, uint32_t height, FrameFormat format)
+    : width_(0), height_(0), format_(format), stride_(0), pixelsPtr_(nullptr), chromaPtr_(nullptr), overlayPtr_(nullptr)
+{
+	Allocate(width, height);
+}
+
+uint32_t Frame::BufferSize() const
+{
+	const uint32_t chromaSize = format_ == Nv12Format ? stride_ * ((height_ + 1) / 2) : 0;
+	return stride_ * height_ + chromaSize;
+}
+
+void Frame::Allocate(uint32_t width, uint32_t height)
+{
+	width_ = width;
+	height_ = height;
+	stride_ = GetStride(width, format_);
+
+	const uint32_t lumaSize = stride_ * height_;
+	const uint32_t bufferSize = BufferSize();
+
+	pixelsPtr_ = static_cast<uint8_t *>(::_aligned_malloc(bufferSize, 64));
+	if (pixelsPtr_ == nullptr)
+		throw runtime_error("_aligned_malloc failed");
+
+	// The padding is never drawn, but it is zeroed once to keep bitmaps deterministic.
+	::SecureZeroMemory(pixelsPtr_, bufferSize);
+
+	if (bufferSize > lumaSize)
+		chromaPtr_ = pixelsPtr_ + lumaSize;
+
+	const uint32_t pixelSize = PixelSizeOf(format_);
 
 	::SecureZeroMemory(&bmpInfo_, sizeof(bmpInfo_));
-	bmpInfo_.bmiHeader.biBitCount = 24;
+	bmpInfo_.bmiHeader.biBitCount = static_cast<WORD>(pixelSize * 8);
 	bmpInfo_.bmiHeader.biHeight = height_;
-	bmpInfo_.bmiHeader.biWidth = width_;
+	bmpInfo_.bmiHeader.biWidth = stride_ / pixelSize;
 	bmpInfo_.bmiHeader.biPlanes = 1;
 	bmpInfo_.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
 	bmpInfo_.bmiHeader.biCompression = BI_RGB;
 
-    Update(avPicture);
+	if (pixelSize == 1)
+	{
+		// The 8-bit formats are drawn through a gray palette, NV12 shows its luma plane.
+		bmpInfo_.bmiHeader.biClrUsed = 256;
+
+		for (uint32_t i = 0; i < 256; ++i)
+		{
+			bmpInfo_.bmiColors[i].rgbBlue = bmpInfo_.bmiColors[i].rgbGreen =
+				bmpInfo_.bmiColors[i].rgbRed = static_cast<BYTE>(i);
+		}
+	}
 }
 
-void Frame::Update(AVPicture &avPicture)
+uint32_t Frame::GetStride(uint32_t width, FrameFormat format)
 {
-    unique_lock<mutex> lock(mutex_);
+	const uint32_t pixelSize = PixelSizeOf(format);
 
-    int32_t lineSize = avPicture.linesize[0];
-    uint32_t padding = GetPadding(lineSize);
+	// 192 is the least multiple of 64 that is a whole number of 24-bit pixels.
+	const uint32_t alignment = pixelSize == 3 ? 192 : 64;
 
-    for (int32_t y = 0; y < height_; ++y)
-    {
-        ::CopyMemory(pixelsPtr_ + (lineSize + padding) * y,
-            avPicture.data[0] + (height_ - y - 1) * lineSize, lineSize);
+	return (width * pixelSize + alignment - 1) / alignment * alignment;
+}
 
-        ::SecureZeroMemory(pixelsPtr_ + (lineSize + padding) * y + lineSize, padding);
-    }
+AVPixelFormat Frame::AvFormat() const
+{
+	switch (format_)
+	{
+	case Bgra32Format:
+		return PixelTraits<Bgra32Format>::AvFormat;
+	case Gray8Format:
+		return PixelTraits<Gray8Format>::AvFormat;
+	case Nv12Format:
+		return PixelTraits<Nv12Format>::AvFormat;
+	default:
+		return PixelTraits<Bgr24Format>::AvFormat;
+	}
+}
+
+void Frame::Update(SwsContext *convertCtxPtr, AVFrame const *avframePtr)
+{
+	boost::unique_lock<boost::mutex> lock(mutex_);
+
+	if (static_cast<uint32_t>(avframePtr->width) != Width() ||
+		static_cast<uint32_t>(avframePtr->height) != Height())
+	{
+		// Reallocated under the lock, a paint shows either the old picture or the new one.
+		::_aligned_free(pixelsPtr_);
+		pixelsPtr_ = nullptr;
+		chromaPtr_ = nullptr;
+		::_aligned_free(overlayPtr_);
+		overlayPtr_ = nullptr;
+
+		Allocate(avframePtr->width, avframePtr->height);
+	}
+
+	// Negative strides make the converter write bottom-up rows straight into the frame.
+	const int32_t chromaHeight = (height_ + 1) / 2;
+	uint8_t *const planes[4] =
+	{
+		pixelsPtr_ + (height_ - 1) * stride_,
+		chromaPtr_ != nullptr ? chromaPtr_ + (chromaHeight - 1) * stride_ : nullptr,
+		nullptr, nullptr
+	};
+	const int strides[4] =
+	{
+		-static_cast<int>(stride_),
+		chromaPtr_ != nullptr ? -static_cast<int>(stride_) : 0,
+		0, 0
+	};
+
+	sws_scale(convertCtxPtr, avframePtr->data, avframePtr->linesize, 0, height_, planes, strides);
 }
 
 void Frame::Draw(HWND window, int zoom, int cross, Frame *pip, int pip_width, int pip_top, int pip_left)
@@ -61,9 +300,68 @@ void Frame::Draw(HWND window, int zoom, int cross, Frame *pip, int pip_width, in
 
 	HDRAWDIB hdd = ::DrawDibOpen();
 
-	if (pip != nullptr)
+	int xSrc = 0;
+	int ySrc = 0;
+	int dxSrc = width_;
+	int dySrc = height_;
+
+	if (zoom > 1) {
+		dxSrc = width_ / zoom;
+		dySrc = height_ / zoom;
+		xSrc = (width_ - dxSrc) / 2;
+		ySrc = (height_ - dySrc) / 2;
+	}
+
+	// The overlays go on a copy, a frame painted again keeps no trace of the previous ones.
+	uint8_t *bitsPtr = pixelsPtr_;
+
+	const bool overlaid = cross > 0 || (pip != nullptr && pip->format_ == format_);
+
+	if (overlaid && overlayPtr_ == nullptr)
+		overlayPtr_ = static_cast<uint8_t *>(::_aligned_malloc(BufferSize(), 64));
+
+	// Without memory for the copy the frame is drawn bare.
+	if (overlaid && overlayPtr_ != nullptr)
+	{
+		memcpy(overlayPtr_, pixelsPtr_, BufferSize());
+		bitsPtr = overlayPtr_;
+
+		switch (format_)
+		{
+		case Bgra32Format:
+			Overlay<Bgra32Format>(bitsPtr, zoom, cross, pip, pip_width, pip_top, pip_left);
+			break;
+		case Gray8Format:
+			Overlay<Gray8Format>(bitsPtr, zoom, cross, pip, pip_width, pip_top, pip_left);
+			break;
+		case Nv12Format:
+			Overlay<Nv12Format>(bitsPtr, zoom, cross, pip, pip_width, pip_top, pip_left);
+			break;
+		default:
+			Overlay<Bgr24Format>(bitsPtr, zoom, cross, pip, pip_width, pip_top, pip_left);
+			break;
+		}
+	}
+
+	::DrawDibDraw(hdd, hdc, rc.left, rc.top, rc.right - rc.left, rc.bottom - rc.top,
+		&bmpInfo_.bmiHeader, bitsPtr, xSrc, ySrc, dxSrc, dySrc, DDF_HALFTONE);
+
+	::DrawDibClose(hdd);
+
+	::EndPaint(window, &ps);
+}
+
+template <FrameFormat Format>
+void Frame::Overlay(uint8_t *dstPtr, int zoom, int cross, Frame *pip, int pip_width, int pip_top, int pip_left)
+{
+	typedef PixelTraits<Format> Traits;
+
+	uint8_t *dstChromaPtr = chromaPtr_ != nullptr ? dstPtr + (chromaPtr_ - pixelsPtr_) : nullptr;
+
+	// The PiP frame comes from another decoder and is composited only once both use the same format.
+	if (pip != nullptr && pip->format_ == Format)
 	{
-		unique_lock<mutex> lock(pip->mutex_);
+		boost::unique_lock<boost::mutex> lock(pip->mutex_);
 
 		LONG pip_height = pip->height_;
 		if (pip_width <= 0)
@@ -73,58 +371,62 @@ void Frame::Draw(HWND window, int zoom, int cross, Frame *pip, int pip_width, in
 		if (pip_left < 0) pip_left = (width_ - pip_width) / 2;
 		if (pip_top < 0) pip_top = (height_ - pip_height) / 2;
 
-		::StretchDIB(
-			&bmpInfo_.bmiHeader, pixelsPtr_, pip_left, pip->height_ - pip_top - pip_height, pip_width, pip_height,
-			&(pip->bmpInfo_.bmiHeader), pip->pixelsPtr_, 0, 0, pip->width_, pip->height_);
-	}
+		const int32_t pip_bottom = height_ - pip_top - pip_height;
 
-	int xSrc = 0;
-	int ySrc = 0;
-	int dxSrc = width_;
-	int dySrc = height_;
+		ScalePlane<Traits::PixelSize>(dstPtr, stride_, width_, height_,
+			pip_left, pip_bottom, pip_width, pip_height,
+			pip->pixelsPtr_, pip->stride_, pip->width_, pip->height_);
 
-	if (zoom > 1) {
-		dxSrc = width_ / zoom;
-		dySrc = height_ / zoom;
-		xSrc = (width_ - dxSrc) / 2;
-		ySrc = (height_ - dySrc) / 2;
+		if (Traits::HasChroma)
+		{
+			ScalePlane<2>(dstChromaPtr, stride_, (width_ + 1) / 2, (height_ + 1) / 2,
+				pip_left / 2, pip_bottom / 2, (pip_width + 1) / 2, (pip_height + 1) / 2,
+				pip->chromaPtr_, pip->stride_, (pip->width_ + 1) / 2, (pip->height_ + 1) / 2);
+		}
 	}
 
-	if (cross > 0) {
+	if (cross > 0)
+	{
 		cross = cross / zoom;
 		int cw = cross / 8;
 		if (cw < 1) cw = 1;
-		int xCntr = width_ / 2;
-		int yCntr = height_ / 2;
-		for (int x = -cross; x <= cross; x++) {
-			for (int y = -cw; y <= cw; y++) {
-				brightenUp(pixelsPtr_ + (width_ * (yCntr + y) + xCntr + x) * 3, 0x6F);
-			}
-		}
-		for (int y = -cross; y < -cw; y++) {
-			for (int x = -cw; x <= cw; x++) {
-				brightenUp(pixelsPtr_ + (width_ * (yCntr + y) + xCntr + x) * 3, 0x6F);
-			}
-		}
-		for (int y = cw + 1; y <= cross; y++) {
-			for (int x = -cw; x <= cw; x++) {
-				brightenUp(pixelsPtr_ + (width_ * (yCntr + y) + xCntr + x) * 3, 0x6F);
+		const int xCntr = width_ / 2;
+		const int yCntr = height_ / 2;
+
+		// Every row of the cross is a single span, clipped to the frame.
+		const int bottom = max(yCntr - cross, 0);
+		const int top = min(yCntr + cross, height_ - 1);
+
+		for (int y = bottom; y <= top; ++y)
+		{
+			const bool horizontalBar = y >= yCntr - cw && y <= yCntr + cw;
+			const int x0 = max(xCntr - (horizontalBar ? cross : cw), 0);
+			const int x1 = min(xCntr + (horizontalBar ? cross : cw), width_ - 1);
+
+			if (x0 <= x1)
+			{
+				AddSaturated(dstPtr + y * stride_ + x0 * Traits::PixelSize,
+					(x1 - x0 + 1) * Traits::PixelSize, 0x6F);
 			}
 		}
 	}
+}
 
-	::DrawDibDraw(hdd, hdc, rc.left, rc.top, rc.right - rc.left, rc.bottom - rc.top,
-		&bmpInfo_.bmiHeader, pixelsPtr_, xSrc, ySrc, dxSrc, dySrc, DDF_HALFTONE);
+template <FrameFormat Format>
+void Frame::CopyToBgr24(uint8_t *bitsPtr, uint32_t lineSize) const
+{
+	const int32_t chromaHeight = (height_ + 1) / 2;
 
-	::DrawDibClose(hdd);
+	for (int32_t y = 0; y < height_; ++y)
+	{
+		uint8_t *dstPtr = bitsPtr + y * lineSize;
 
-	::EndPaint(window, &ps);
-}
+		// Rows are bottom-up, so a chroma row is found from the top of the frame.
+		uint8_t const *chromaRowPtr = chromaPtr_ != nullptr ?
+			chromaPtr_ + (chromaHeight - 1 - (height_ - 1 - y) / 2) * stride_ : nullptr;
 
-void Frame::brightenUp(uint8_t *ptr, uint8_t value) {
-	for (int x = 0; x < 3; x++) {
-		if (*ptr < (0xFF - value)) *ptr += value; else *ptr = 0xFF;
-		ptr++;
+		PixelTraits<Format>::ToBgr24(dstPtr, pixelsPtr_ + y * stride_, chromaRowPtr, width_);
+		::SecureZeroMemory(dstPtr + width_ * 3, lineSize - width_ * 3);
 	}
 }
 
@@ -134,8 +436,12 @@ void Frame::ToBmp(uint8_t **bmpPtr)
 
     unique_lock<mutex> lock(mutex_);
 
+    // The bits in the array are packed together, but each scan line must be
+    // padded with zeros to end on a LONG data-type boundary.
+    const uint32_t lineSize = (width_ * 3 + 3) & ~3u;
+
     *bmpPtr =
-        static_cast<uint8_t *>(::CoTaskMemAlloc(sizeof(BITMAPINFOHEADER) + height_ * width_ * 3));
+        static_cast<uint8_t *>(::CoTaskMemAlloc(sizeof(BITMAPINFOHEADER) + height_ * lineSize));
 
     if (*bmpPtr == nullptr)
         throw runtime_error("CoTaskMemAlloc failed");
@@ -150,5 +456,20 @@ void Frame::ToBmp(uint8_t **bmpPtr)
     headerPtr->biCompression = BI_RGB;
 
     uint8_t* pixelsPtr = *bmpPtr + sizeof(BITMAPINFOHEADER);
-    ::CopyMemory(pixelsPtr, pixelsPtr_, height_ * width_ * 3);
+
+    switch (format_)
+    {
+    case Bgra32Format:
+        CopyToBgr24<Bgra32Format>(pixelsPtr, lineSize);
+        break;
+    case Gray8Format:
+        CopyToBgr24<Gray8Format>(pixelsPtr, lineSize);
+        break;
+    case Nv12Format:
+        CopyToBgr24<Nv12Format>(pixelsPtr, lineSize);
+        break;
+    default:
+        CopyToBgr24<Bgr24Format>(pixelsPtr, lineSize);
+        break;
+    }
 }
\ No newline at end of file
@@ -23,12 +23,29 @@ namespace FFmpeg
     extern "C"
     {
 #include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
     }
 
 #pragma warning( pop )
 
     namespace Facade
     {
+        /// <summary>
+        /// A FrameFormat enumeration lists the pixel layouts a frame can be stored in.
+        /// </summary>
+        enum FrameFormat
+        {
+            // 24-bit BGR, the default.
+            Bgr24Format,
+            // 32-bit BGRA, each pixel is a single aligned word.
+            Bgra32Format,
+            // 8-bit luma only.
+            Gray8Format,
+            // A luma plane followed by an interleaved half-resolution UV plane.
+            Nv12Format,
+            FrameFormatCount
+        };
+
         /// <summary>
         /// A Frame class implements a set of frame-related utilities. 
         /// </summary>
@@ -38,7 +55,10 @@ namespace FFmpeg
             /// <summary>
             /// Initializes a new instance of the Frame class.
             /// </summary>
-            Frame(uint32_t width, uint32_t height, AVPicture &avPicture);
+            /// <param name="width">The width, in pixels, of the frame.</param>
+            /// <param name="height">The height, in pixels, of the frame.</param>
+            /// <param name="format">The pixel layout of the frame.</param>
+            Frame(uint32_t width, uint32_t height, FrameFormat format = Bgr24Format);
 
             /// <summary>
             /// Gets the width, in pixels, of the frame.
@@ -51,10 +71,22 @@ namespace FFmpeg
             uint32_t Height() const { return height_; }
 
             /// <summary>
-            /// Updates the frame.
+            /// Gets the pixel layout of the frame.
+            /// </summary>
+            FrameFormat Format() const { return format_; }
+
+            /// <summary>
+            /// Gets the FFmpeg pixel format a converter should produce for the frame.
             /// </summary>
-            /// <param name="avPicture">The AVPicture object to update the frame with.</param>
-            void Update(AVPicture &avPicture);
+            AVPixelFormat AvFormat() const;
+
+            /// <summary>
+            /// Updates the frame, the frame takes the size of the decoded one.
+            /// Rows are stored bottom-up, like a DIB.
+            /// </summary>
+            /// <param name="convertCtxPtr">The converter to the AvFormat() pixel format.</param>
+            /// <param name="avframePtr">The decoded frame to update the frame with.</param>
+            void Update(SwsContext *convertCtxPtr, AVFrame const *avframePtr);
 
             /// <summary>
             /// Draws the frame.
@@ -63,7 +95,7 @@ namespace FFmpeg
 			void Draw(HWND window, int zoom = 1, int cross = 0, Frame *pip = nullptr, int pip_width = 0, int pip_top = 0, int pip_left = 0);
 
             /// <summary>
-            /// Converts the frame to a bitmap.
+            /// Converts the frame to a 24-bit bitmap, whatever the frame format is.
             /// </summary>
             /// <param name="bmpPtr">Address of a pointer to a byte that will receive the DIB.</param>
             void ToBmp(uint8_t **bmpPtr);
@@ -73,27 +105,60 @@ namespace FFmpeg
             /// </summary>
             ~Frame()
             {
-                delete[] pixelsPtr_;
+                ::_aligned_free(pixelsPtr_);
+                ::_aligned_free(overlayPtr_);
             }
 
         private:
             /// <summary>
-            /// The bits in the array are packed together, but each scan line must be
-            /// padded with zeros to end on a LONG data-type boundary.
+            /// A BitmapInfo structure is a BITMAPINFO with room for the gray palette of the 8-bit formats.
             /// </summary>
-            uint32_t GetPadding(int32_t lineSize) const
+            struct BitmapInfo
             {
-                return lineSize % sizeof(uint32_t) > 0 ?
-                    sizeof(uint32_t) - (lineSize % sizeof(uint32_t)) : 0;
-            }
+                BITMAPINFOHEADER bmiHeader;
+                RGBQUAD bmiColors[256];
+            };
 
-			void brightenUp(uint8_t *ptr, uint8_t value);
+            /// <summary>
+            /// Allocates the pixels and describes them in the bitmap header.
+            /// </summary>
+            void Allocate(uint32_t width, uint32_t height);
+
+            /// <summary>
+            /// Scan lines are aligned to 64 bytes, and hold a whole number of pixels so that
+            /// the DIB width can cover the padding.
+            /// </summary>
+            static uint32_t GetStride(uint32_t width, FrameFormat format);
+
+            /// <summary>
+            /// Gets the size of the pixels, the chroma plane included.
+            /// </summary>
+            uint32_t BufferSize() const;
+
+            /// <summary>
+            /// Composites the PiP frame and draws the cross with the kernels of the frame format.
+            /// </summary>
+            /// <param name="dstPtr">A copy of the pixels to draw on, laid out like them.</param>
+            template <FrameFormat Format>
+            void Overlay(uint8_t *dstPtr, int zoom, int cross, Frame *pip, int pip_width, int pip_top, int pip_left);
+
+            /// <summary>
+            /// Converts the frame to 24-bit rows padded to a LONG boundary.
+            /// </summary>
+            template <FrameFormat Format>
+            void CopyToBgr24(uint8_t *bitsPtr, uint32_t lineSize) const;
 
             int32_t width_, height_;
+            FrameFormat format_;
+            uint32_t stride_;
             uint8_t *pixelsPtr_;
+            // The UV plane of an NV12 frame, nullptr for other formats.
+            uint8_t *chromaPtr_;
+            // The copy of the pixels the overlays are drawn on, allocated by the first paint that has any.
+            uint8_t *overlayPtr_;
             boost::mutex mutex_;
 			
-			BITMAPINFO bmpInfo_;
+			BitmapInfo bmpInfo_;
 		};
     }
 }
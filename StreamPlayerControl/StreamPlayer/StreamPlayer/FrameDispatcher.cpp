@@ -0,0 +1,71 @@
+#include "framedispatcher.h"
+#include <stdexcept>
+#include <boost/thread/locks.hpp>
+
+using namespace std;
+using namespace FFmpeg;
+using namespace FFmpeg::Facade;
+
+FrameDispatcher::FrameDispatcher()
+	: timeBase_(AVRational{ 1, 1 }), sequence_(0) {}
+
+void FrameDispatcher::SetHandler(FrameHandler const& handler)
+{
+	boost::unique_lock<boost::mutex> lock(mutex_);
+	handler_ = handler;
+}
+
+void *FrameDispatcher::Retain(void *handle)
+{
+	// The decoder produces reference counted frames, so the clone shares their buffers.
+	AVFrame *framePtr = av_frame_clone(static_cast<AVFrame const *>(handle));
+	if (framePtr == nullptr)
+		throw runtime_error("av_frame_clone() failed");
+
+	return framePtr;
+}
+
+void FrameDispatcher::Release(void *handle)
+{
+	AVFrame *framePtr = static_cast<AVFrame *>(handle);
+	av_frame_free(&framePtr);
+}
+
+void FrameDispatcher::StreamOpened(AVStream const *streamPtr)
+{
+	boost::unique_lock<boost::mutex> lock(mutex_);
+
+	timeBase_ = streamPtr->time_base;
+	sequence_ = 0;
+}
+
+void FrameDispatcher::FrameDecoded(AVFrame const *framePtr)
+{
+	boost::unique_lock<boost::mutex> lock(mutex_);
+
+	++sequence_;
+
+	if (!handler_)
+		return;
+
+	FrameView view;
+	for (uint32_t i = 0; i < 4; ++i)
+	{
+		view.planes[i] = framePtr->data[i];
+		view.strides[i] = framePtr->linesize[i];
+	}
+
+	view.width = framePtr->width;
+	view.height = framePtr->height;
+	view.format = framePtr->format;
+	view.pts = framePtr->best_effort_timestamp;
+	view.timeBaseNum = timeBase_.num;
+	view.timeBaseDen = timeBase_.den;
+	view.sequence = sequence_;
+	view.handle = const_cast<AVFrame *>(framePtr);
+
+	FrameHandler handler = handler_;
+	lock.unlock();
+
+	handler(view);
+}
@@ -0,0 +1,89 @@
+#ifndef FFMPEG_FACADE_FRAMEDISPATCHER_H
+#define FFMPEG_FACADE_FRAMEDISPATCHER_H
+
+#include <cstdint>
+#include <functional>
+#include <boost/noncopyable.hpp>
+
+#pragma warning( push )
+#pragma warning( disable : 4100 )
+
+#include <boost/thread/mutex.hpp>
+
+#pragma warning( pop )
+
+#include "framesink.h"
+
+namespace FFmpeg
+{
+	namespace Facade
+	{
+		/// <summary>
+		/// A FrameView structure is a read-only view of the planes of a decoded frame.
+		/// </summary>
+		struct FrameView
+		{
+			uint8_t const *planes[4];
+			int32_t strides[4];
+			int32_t width;
+			int32_t height;
+			// The AVPixelFormat of the decoder.
+			int32_t format;
+			// The presentation time, in timeBaseNum / timeBaseDen seconds.
+			int64_t pts;
+			int32_t timeBaseNum;
+			int32_t timeBaseDen;
+			// The frame number in the stream, starting at 1.
+			int64_t sequence;
+			// The frame the planes belong to, pass it to Retain() to keep the planes past the callback.
+			void *handle;
+		};
+
+		/// <summary>
+		/// A FrameDispatcher class hands every decoded frame to a handler without copying it.
+		/// </summary>
+		class FrameDispatcher : public FrameSink, private boost::noncopyable
+		{
+		public:
+			/// <summary>
+			/// Handles a decoded frame, called on the decoding thread. The view is valid
+			/// for the duration of the call unless its handle is retained.
+			/// </summary>
+			typedef std::function<void(FrameView const& view)> FrameHandler;
+
+			/// <summary>
+			/// Initializes a new instance of the FrameDispatcher class with no handler.
+			/// </summary>
+			FrameDispatcher();
+
+			/// <summary>
+			/// Sets the frame handler, an empty handler stops the dispatching.
+			/// </summary>
+			void SetHandler(FrameHandler const& handler);
+
+			/// <summary>
+			/// Takes a reference to the buffers of a frame, the plane pointers of its view stay valid until Release().
+			/// </summary>
+			/// <param name="handle">The handle of a frame view.</param>
+			/// <returns>A handle to pass to Release().</returns>
+			static void *Retain(void *handle);
+
+			/// <summary>
+			/// Releases a reference taken by Retain().
+			/// </summary>
+			static void Release(void *handle);
+
+			virtual void StreamOpened(AVStream const *streamPtr) override;
+
+			virtual void FrameDecoded(AVFrame const *framePtr) override;
+
+		private:
+			boost::mutex mutex_;
+			FrameHandler handler_;
+			AVRational timeBase_;
+			int64_t sequence_;
+		};
+	}
+}
+
+#endif // FFMPEG_FACADE_FRAMEDISPATCHER_H
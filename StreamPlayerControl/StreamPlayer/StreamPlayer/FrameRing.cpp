@@ -0,0 +1,175 @@
+#include "framering.h"
+#include <stdexcept>
+#include <boost/thread/locks.hpp>
+
+namespace FFmpeg
+{
+	extern "C"
+	{
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+	}
+}
+
+using namespace std;
+using namespace FFmpeg;
+using namespace FFmpeg::Facade;
+
+namespace
+{
+	const uint32_t PlaneAlignment = 64;
+
+	uint32_t Align(uint32_t value)
+	{
+		return (value + PlaneAlignment - 1) / PlaneAlignment * PlaneAlignment;
+	}
+}
+
+FrameRing::FrameRing()
+	: mappingHandle_(nullptr), viewPtr_(nullptr), timeBase_(AVRational{ 1, 1 }) {}
+
+void FrameRing::Start(string const& name, uint32_t slotCount, uint32_t slotSize)
+{
+	boost::unique_lock<boost::mutex> lock(mutex_);
+
+	StopUnlocked();
+
+	if (slotCount == 0 || slotSize <= sizeof(SlotHeader))
+		throw runtime_error("invalid frame ring size");
+
+	slotSize = Align(slotSize);
+	const uint64_t mappingSize = SlotsOffset + static_cast<uint64_t>(slotCount) * slotSize;
+
+	// The pagefile-backed mapping lives as long as any process has a view of it.
+	mappingHandle_ = ::CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+		static_cast<DWORD>(mappingSize >> 32), static_cast<DWORD>(mappingSize), name.c_str());
+
+	if (mappingHandle_ == nullptr)
+		throw runtime_error("CreateFileMapping() failed");
+
+	if (::GetLastError() == ERROR_ALREADY_EXISTS)
+	{
+		::CloseHandle(mappingHandle_);
+		mappingHandle_ = nullptr;
+		throw runtime_error("the frame ring name is in use");
+	}
+
+	viewPtr_ = static_cast<uint8_t *>(::MapViewOfFile(mappingHandle_, FILE_MAP_WRITE, 0, 0, 0));
+	if (viewPtr_ == nullptr)
+	{
+		::CloseHandle(mappingHandle_);
+		mappingHandle_ = nullptr;
+		throw runtime_error("MapViewOfFile() failed");
+	}
+
+	// A new mapping is zeroed, so every slot starts out empty.
+	HeaderPtr()->slotCount = slotCount;
+	HeaderPtr()->slotSize = slotSize;
+	HeaderPtr()->version = Version;
+	HeaderPtr()->magic = Magic;
+}
+
+void FrameRing::Stop()
+{
+	boost::unique_lock<boost::mutex> lock(mutex_);
+
+	StopUnlocked();
+}
+
+void FrameRing::StopUnlocked()
+{
+	if (viewPtr_ != nullptr)
+	{
+		::UnmapViewOfFile(viewPtr_);
+		viewPtr_ = nullptr;
+	}
+
+	if (mappingHandle_ != nullptr)
+	{
+		::CloseHandle(mappingHandle_);
+		mappingHandle_ = nullptr;
+	}
+}
+
+void FrameRing::StreamOpened(AVStream const *streamPtr)
+{
+	boost::unique_lock<boost::mutex> lock(mutex_);
+
+	timeBase_ = streamPtr->time_base;
+}
+
+void FrameRing::FrameDecoded(AVFrame const *framePtr)
+{
+	boost::unique_lock<boost::mutex> lock(mutex_);
+
+	if (viewPtr_ == nullptr)
+		return;
+
+	const AVPixelFormat format = static_cast<AVPixelFormat>(framePtr->format);
+	const AVPixFmtDescriptor *descPtr = av_pix_fmt_desc_get(format);
+
+	int lineSizes[4] = {};
+	if (descPtr == nullptr || av_image_fill_linesizes(lineSizes, format, framePtr->width) < 0)
+		return;
+
+	// Chroma planes are subsampled vertically, the alpha plane is not.
+	const int chromaHeight = -((-framePtr->height) >> descPtr->log2_chroma_h);
+
+	uint32_t offsets[4] = {};
+	uint32_t strides[4] = {};
+	uint32_t planeCount = 0;
+	uint32_t size = Align(sizeof(SlotHeader));
+
+	for (; planeCount < 4 && lineSizes[planeCount] > 0 && framePtr->data[planeCount] != nullptr; ++planeCount)
+	{
+		const int height = planeCount == 1 || planeCount == 2 ? chromaHeight : framePtr->height;
+
+		offsets[planeCount] = size;
+		strides[planeCount] = Align(lineSizes[planeCount]);
+		size += strides[planeCount] * height;
+	}
+
+	RingHeader *headerPtr = HeaderPtr();
+	if (planeCount == 0 || size > headerPtr->slotSize)
+	{
+		::InterlockedIncrement64(&headerPtr->droppedFrames);
+		return;
+	}
+
+	const LONG64 sequence = headerPtr->sequence + 1;
+	uint8_t *slotPtr = SlotPtr(sequence);
+	SlotHeader *slotHeaderPtr = reinterpret_cast<SlotHeader *>(slotPtr);
+
+	// The interlocked stores are full barriers, readers that saw the old frame
+	// find beginSequence changed before any of its bytes are overwritten.
+	::InterlockedExchange64(&slotHeaderPtr->beginSequence, sequence);
+
+	slotHeaderPtr->pts = framePtr->best_effort_timestamp;
+	slotHeaderPtr->timeBaseNum = timeBase_.num;
+	slotHeaderPtr->timeBaseDen = timeBase_.den;
+	slotHeaderPtr->width = framePtr->width;
+	slotHeaderPtr->height = framePtr->height;
+	slotHeaderPtr->format = format;
+	slotHeaderPtr->planeCount = planeCount;
+
+	for (uint32_t i = 0; i < 4; ++i)
+	{
+		slotHeaderPtr->offsets[i] = offsets[i];
+		slotHeaderPtr->strides[i] = strides[i];
+
+		if (i < planeCount)
+		{
+			const int height = i == 1 || i == 2 ? chromaHeight : framePtr->height;
+			av_image_copy_plane(slotPtr + offsets[i], strides[i],
+				framePtr->data[i], framePtr->linesize[i], lineSizes[i], height);
+		}
+	}
+
+	::InterlockedExchange64(&slotHeaderPtr->endSequence, sequence);
+	::InterlockedExchange64(&headerPtr->sequence, sequence);
+}
+
+FrameRing::~FrameRing()
+{
+	StopUnlocked();
+}
@@ -0,0 +1,117 @@
+#ifndef FFMPEG_FACADE_FRAMERING_H
+#define FFMPEG_FACADE_FRAMERING_H
+
+#include <cstdint>
+#include <string>
+#include <boost/noncopyable.hpp>
+
+#pragma warning( push )
+#pragma warning( disable : 4100 )
+
+#include <boost/thread/mutex.hpp>
+
+#pragma warning( pop )
+
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+
+#include "framesink.h"
+
+namespace FFmpeg
+{
+	namespace Facade
+	{
+		/// <summary>
+		/// A FrameRing class publishes decoded frames into a named shared memory ring, so that
+		/// other local processes can map it and read the frames without extra decodes.
+		/// 
+		/// The mapping is a RingHeader followed by slotCount slots of slotSize bytes, the first
+		/// slot starts at SlotsOffset. Frame n (starting at 1) goes to slot (n - 1) % slotCount.
+		/// A reader takes n from RingHeader::sequence and reads the slot when its endSequence is n,
+		/// the data is valid if the slot beginSequence is still n once it has been read.
+		/// </summary>
+		class FrameRing : public FrameSink, private boost::noncopyable
+		{
+		public:
+			struct RingHeader
+			{
+				uint32_t magic;
+				uint32_t version;
+				uint32_t slotCount;
+				uint32_t slotSize;
+				// The last published frame, zero until the first frame.
+				volatile LONG64 sequence;
+				// The frames that did not fit into a slot.
+				volatile LONG64 droppedFrames;
+			};
+
+			struct SlotHeader
+			{
+				// Set to the frame number before the slot is written.
+				volatile LONG64 beginSequence;
+				// Set to the frame number after the slot is written.
+				volatile LONG64 endSequence;
+				// The presentation time, in timeBaseNum / timeBaseDen seconds.
+				int64_t pts;
+				int32_t timeBaseNum;
+				int32_t timeBaseDen;
+				int32_t width;
+				int32_t height;
+				// The AVPixelFormat of the decoder.
+				int32_t format;
+				uint32_t planeCount;
+				// The plane offsets from the slot start, in bytes.
+				uint32_t offsets[4];
+				uint32_t strides[4];
+			};
+
+			static const uint32_t Magic = 0x47524657; // "WFRG"
+			static const uint32_t Version = 1;
+			static const uint32_t SlotsOffset = 64;
+
+			/// <summary>
+			/// Initializes a new instance of the FrameRing class, the ring is not published.
+			/// </summary>
+			FrameRing();
+
+			/// <summary>
+			/// Creates the shared memory ring and starts publishing frames.
+			/// </summary>
+			/// <param name="name">The name of the file mapping, e.g. Local\camera1.</param>
+			/// <param name="slotCount">The number of frames the ring holds.</param>
+			/// <param name="slotSize">The size of a slot, in bytes, frames that do not fit are dropped.</param>
+			void Start(std::string const& name, uint32_t slotCount, uint32_t slotSize);
+
+			/// <summary>
+			/// Stops publishing frames and releases the mapping, readers keep it alive until they unmap it.
+			/// </summary>
+			void Stop();
+
+			virtual void StreamOpened(AVStream const *streamPtr) override;
+
+			virtual void FrameDecoded(AVFrame const *framePtr) override;
+
+			/// <summary>
+			/// Releases all resources used by the ring.
+			/// </summary>
+			~FrameRing();
+
+		private:
+			RingHeader *HeaderPtr() const { return reinterpret_cast<RingHeader *>(viewPtr_); }
+
+			uint8_t *SlotPtr(LONG64 sequence) const
+			{
+				return viewPtr_ + SlotsOffset + ((sequence - 1) % HeaderPtr()->slotCount) * HeaderPtr()->slotSize;
+			}
+
+			void StopUnlocked();
+
+			HANDLE mappingHandle_;
+			uint8_t *viewPtr_;
+			AVRational timeBase_;
+			boost::mutex mutex_;
+		};
+	}
+}
+
+#endif // FFMPEG_FACADE_FRAMERING_H
@@ -0,0 +1,50 @@
+#include "framesignal.h"
+#include <boost/thread/locks.hpp>
+#include <boost/chrono.hpp>
+
+using namespace FFmpeg;
+using namespace FFmpeg::Facade;
+
+FrameSignal::FrameSignal()
+	: sequence_(0), open_(false) {}
+
+void FrameSignal::Open()
+{
+	boost::unique_lock<boost::mutex> lock(mutex_);
+	open_ = true;
+}
+
+void FrameSignal::Close()
+{
+	{
+		boost::unique_lock<boost::mutex> lock(mutex_);
+		open_ = false;
+	}
+
+	condition_.notify_all();
+}
+
+void FrameSignal::Publish()
+{
+	{
+		boost::unique_lock<boost::mutex> lock(mutex_);
+		++sequence_;
+	}
+
+	condition_.notify_all();
+}
+
+FrameSignal::WaitResult FrameSignal::Wait(int64_t lastSequence, uint32_t timeoutInMilliseconds, int64_t &sequence)
+{
+	boost::unique_lock<boost::mutex> lock(mutex_);
+
+	condition_.wait_for(lock, boost::chrono::milliseconds(timeoutInMilliseconds),
+		[this, lastSequence]() { return sequence_ > lastSequence || !open_; });
+
+	sequence = sequence_;
+
+	if (sequence_ > lastSequence)
+		return FramePublished;
+
+	return open_ ? TimedOut : StreamClosed;
+}
@@ -0,0 +1,71 @@
+#ifndef FFMPEG_FACADE_FRAMESIGNAL_H
+#define FFMPEG_FACADE_FRAMESIGNAL_H
+
+#include <cstdint>
+#include <boost/noncopyable.hpp>
+
+#pragma warning( push )
+#pragma warning( disable : 4100 )
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#pragma warning( pop )
+
+namespace FFmpeg
+{
+	namespace Facade
+	{
+		/// <summary>
+		/// A FrameSignal class numbers the frames of a stream and wakes up the threads waiting for a new one.
+		/// </summary>
+		class FrameSignal : private boost::noncopyable
+		{
+		public:
+			enum WaitResult
+			{
+				// A frame newer than the last seen one is available.
+				FramePublished,
+				// The stream is not playing.
+				StreamClosed,
+				TimedOut
+			};
+
+			/// <summary>
+			/// Initializes a new instance of the FrameSignal class, the stream is closed.
+			/// </summary>
+			FrameSignal();
+
+			/// <summary>
+			/// Marks the stream as playing.
+			/// </summary>
+			void Open();
+
+			/// <summary>
+			/// Marks the stream as stopped and wakes up all waiters.
+			/// </summary>
+			void Close();
+
+			/// <summary>
+			/// Numbers a new frame and wakes up all waiters.
+			/// </summary>
+			void Publish();
+
+			/// <summary>
+			/// Waits for a frame newer than a given one. Sequence numbers keep growing across stream restarts.
+			/// </summary>
+			/// <param name="lastSequence">The sequence number of the last seen frame, zero for none.</param>
+			/// <param name="timeoutInMilliseconds">How long to wait.</param>
+			/// <param name="sequence">Receives the sequence number of the latest frame.</param>
+			WaitResult Wait(int64_t lastSequence, uint32_t timeoutInMilliseconds, int64_t &sequence);
+
+		private:
+			boost::mutex mutex_;
+			boost::condition_variable condition_;
+			int64_t sequence_;
+			bool open_;
+		};
+	}
+}
+
+#endif // FFMPEG_FACADE_FRAMESIGNAL_H
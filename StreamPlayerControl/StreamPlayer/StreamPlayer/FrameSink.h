@@ -0,0 +1,44 @@
+#ifndef FFMPEG_FACADE_FRAMESINK_H
+#define FFMPEG_FACADE_FRAMESINK_H
+
+namespace FFmpeg
+{
+
+#pragma warning( push )
+#pragma warning( disable : 4244 )
+
+	extern "C"
+	{
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+	}
+
+#pragma warning( pop )
+
+	namespace Facade
+	{
+		/// <summary>
+		/// A FrameSink interface receives the decoded frames of a video stream
+		/// in the decoder pixel format, before they are converted for display.
+		/// </summary>
+		class FrameSink
+		{
+		public:
+			/// <summary>
+			/// Called once the stream is opened, before any of its frames is delivered.
+			/// </summary>
+			/// <param name="streamPtr">The video stream the frames belong to.</param>
+			virtual void StreamOpened(AVStream const *streamPtr) = 0;
+
+			/// <summary>
+			/// Called on the decoding thread for every decoded frame.
+			/// </summary>
+			/// <param name="framePtr">The frame, valid for the duration of the call only.</param>
+			virtual void FrameDecoded(AVFrame const *framePtr) = 0;
+
+			virtual ~FrameSink() {}
+		};
+	}
+}
+
+#endif // FFMPEG_FACADE_FRAMESINK_H
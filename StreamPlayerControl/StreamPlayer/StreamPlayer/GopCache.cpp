@@ -0,0 +1,136 @@
+#include "gopcache.h"
+#include <boost/thread/locks.hpp>
+
+using namespace std;
+using namespace FFmpeg;
+using namespace FFmpeg::Facade;
+
+GopCache::GopCache()
+	: bytes_(0), firstSequence_(1), nextSequence_(1), codecId_(AV_CODEC_ID_NONE), width_(0), height_(0) {}
+
+void GopCache::SetUrl(string const& url)
+{
+	boost::unique_lock<boost::mutex> lock(mutex_);
+	url_ = url;
+}
+
+string GopCache::Url() const
+{
+	boost::unique_lock<boost::mutex> lock(mutex_);
+	return url_;
+}
+
+bool GopCache::Empty() const
+{
+	boost::unique_lock<boost::mutex> lock(mutex_);
+	return packets_.empty();
+}
+
+bool GopCache::Matches(AVCodecContext const *codecCtxPtr) const
+{
+	boost::unique_lock<boost::mutex> lock(mutex_);
+	return codecCtxPtr->codec_id == codecId_ && codecCtxPtr->width == width_ && codecCtxPtr->height == height_;
+}
+
+void GopCache::RequestGop(PacketSink *sinkPtr)
+{
+	boost::unique_lock<boost::mutex> lock(mutex_);
+	pendingSinks_.push_back(sinkPtr);
+}
+
+bool GopCache::Next(uint64_t &sequence, AVPacket &packet)
+{
+	boost::unique_lock<boost::mutex> lock(mutex_);
+
+	if (packets_.empty())
+		return false;
+
+	if (sequence < firstSequence_)
+		sequence = firstSequence_;
+
+	if (sequence >= nextSequence_)
+		return false;
+
+	av_init_packet(&packet);
+	if (av_copy_packet(&packet, &packets_[static_cast<size_t>(sequence - firstSequence_)]) < 0)
+		return false;
+
+	++sequence;
+	return true;
+}
+
+void GopCache::Clear()
+{
+	boost::unique_lock<boost::mutex> lock(mutex_);
+
+	ClearPackets();
+	url_.clear();
+
+	// A sink that asked for the group of the stopped source would get the next source's.
+	pendingSinks_.clear();
+}
+
+void GopCache::StreamOpened(AVStream const *streamPtr)
+{
+	boost::unique_lock<boost::mutex> lock(mutex_);
+
+	ClearPackets();
+
+	codecId_ = streamPtr->codec->codec_id;
+	width_ = streamPtr->codec->width;
+	height_ = streamPtr->codec->height;
+}
+
+void GopCache::PacketReceived(AVPacket const &packet)
+{
+	boost::unique_lock<boost::mutex> lock(mutex_);
+
+	// Sent before the packet is cached, the sinks get it next along with the other sinks.
+	for (auto sinkPtr : pendingSinks_)
+		sinkPtr->GopReceived(packets_);
+
+	pendingSinks_.clear();
+
+	const bool keyframe = (packet.flags & AV_PKT_FLAG_KEY) != 0;
+	if (keyframe)
+		ClearPackets();
+
+	// Without its keyframe a group is useless, as is one too long to keep.
+	if (packets_.empty() && !keyframe)
+		return;
+
+	if (bytes_ + packet.size > MaxBytes)
+	{
+		ClearPackets();
+		return;
+	}
+
+	AVPacket cachedPacket;
+	av_init_packet(&cachedPacket);
+	if (av_copy_packet(&cachedPacket, &packet) < 0)
+	{
+		ClearPackets();
+		return;
+	}
+
+	packets_.push_back(cachedPacket);
+	bytes_ += packet.size;
+	++nextSequence_;
+}
+
+void GopCache::ClearPackets()
+{
+	for (auto& packet : packets_)
+		av_free_packet(&packet);
+
+	packets_.clear();
+	bytes_ = 0;
+
+	// The sequence goes on, so that a consumer behind a cleared group moves on to the next one.
+	firstSequence_ = nextSequence_;
+}
+
+GopCache::~GopCache()
+{
+	ClearPackets();
+}
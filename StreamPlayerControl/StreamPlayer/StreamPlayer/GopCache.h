@@ -0,0 +1,107 @@
+#ifndef FFMPEG_FACADE_GOPCACHE_H
+#define FFMPEG_FACADE_GOPCACHE_H
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+#include <boost/noncopyable.hpp>
+
+#pragma warning( push )
+#pragma warning( disable : 4100 )
+
+#include <boost/thread/mutex.hpp>
+
+#pragma warning( pop )
+
+#include "packetsink.h"
+
+namespace FFmpeg
+{
+	namespace Facade
+	{
+		/// <summary>
+		/// A GopCache class keeps the packets of a source from its last keyframe on, so that
+		/// a consumer joining the source starts from that keyframe instead of waiting for the next.
+		/// The decoder of the source resumes full decoding from it too, see Decoder::SetGopCache.
+		/// </summary>
+		class GopCache : public PacketSink, private boost::noncopyable
+		{
+		public:
+			/// <summary>
+			/// Initializes a new instance of the GopCache class.
+			/// </summary>
+			GopCache();
+
+			/// <summary>
+			/// Sets the url of the source whose packets are cached.
+			/// </summary>
+			void SetUrl(std::string const& url);
+
+			/// <summary>
+			/// Gets the url of the source whose packets are cached, empty if none is.
+			/// </summary>
+			std::string Url() const;
+
+			/// <summary>
+			/// Gets whether no group is cached, none was received from a keyframe on.
+			/// </summary>
+			bool Empty() const;
+
+			/// <summary>
+			/// Gets whether the packets decode with a codec context, that is of the same codec and size.
+			/// </summary>
+			bool Matches(AVCodecContext const *codecCtxPtr) const;
+
+			/// <summary>
+			/// Asks for the cached packets to be sent to a sink, on the decoding thread of the source
+			/// and before its next packet, so that no packet is missed or sent twice in between.
+			/// </summary>
+			/// <param name="sinkPtr">The sink, its GopReceived() is called.</param>
+			void RequestGop(PacketSink *sinkPtr);
+
+			/// <summary>
+			/// Copies the next cached packet, for a consumer that decodes the source from another thread.
+			/// A consumer that fell behind a new keyframe continues from it.
+			/// </summary>
+			/// <param name="sequence">The sequence number of the next packet, zero to start from the keyframe.</param>
+			/// <param name="packet">Receives the packet, to be freed with av_free_packet().</param>
+			/// <returns>false if there is no newer packet.</returns>
+			bool Next(uint64_t &sequence, AVPacket &packet);
+
+			/// <summary>
+			/// Discards the cached packets and the url, the source stopped.
+			/// </summary>
+			void Clear();
+
+			virtual void StreamOpened(AVStream const *streamPtr) override;
+
+			virtual void PacketReceived(AVPacket const &packet) override;
+
+			/// <summary>
+			/// Releases all resources used by the cache.
+			/// </summary>
+			~GopCache();
+
+		private:
+			void ClearPackets();
+
+			// A longer group is not kept, the consumers then wait for the next keyframe.
+			static const size_t MaxBytes = 16 * 1024 * 1024;
+
+			mutable boost::mutex mutex_;
+			std::deque<AVPacket> packets_;
+			size_t bytes_;
+			// The sequence number of the cached keyframe, and of the packet to come.
+			uint64_t firstSequence_;
+			uint64_t nextSequence_;
+			std::vector<PacketSink *> pendingSinks_;
+			std::string url_;
+			AVCodecID codecId_;
+			int width_;
+			int height_;
+		};
+	}
+}
+
+#endif // FFMPEG_FACADE_GOPCACHE_H
@@ -0,0 +1,58 @@
+#ifndef FFMPEG_FACADE_INPUTSOURCE_H
+#define FFMPEG_FACADE_INPUTSOURCE_H
+
+#include <cstdint>
+#include <cstddef>
+
+namespace FFmpeg
+{
+
+#pragma warning( push )
+#pragma warning( disable : 4244 )
+
+	extern "C"
+	{
+#include <libavformat/avformat.h>
+	}
+
+#pragma warning( pop )
+
+	namespace Facade
+	{
+		/// <summary>
+		/// An InputSource interface supplies the bytes of a stream in place of the FFmpeg protocols,
+		/// the decoder demuxes them through a custom AVIOContext.
+		/// </summary>
+		class InputSource
+		{
+		public:
+			/// <summary>
+			/// Reads bytes, blocking until at least one is available.
+			/// </summary>
+			/// <param name="bufferPtr">The buffer that receives the bytes.</param>
+			/// <param name="size">The size of the buffer.</param>
+			/// <param name="interrupt">Polled while waiting, the read fails with AVERROR_EXIT when it returns non-zero.</param>
+			/// <returns>The number of bytes read, AVERROR_EOF at the end of the input or a negative AVERROR code.</returns>
+			virtual int32_t Read(uint8_t *bufferPtr, int32_t size, AVIOInterruptCB const& interrupt) = 0;
+
+			/// <summary>
+			/// Gets the number of bytes that can be read without blocking.
+			/// </summary>
+			virtual size_t Available() const = 0;
+
+			/// <summary>
+			/// Gets whether the input ended, the bytes left can still be read.
+			/// </summary>
+			virtual bool Ended() const = 0;
+
+			/// <summary>
+			/// Gets the demuxer of the input, nullptr to probe it.
+			/// </summary>
+			virtual AVInputFormat *Format() const { return nullptr; }
+
+			virtual ~InputSource() {}
+		};
+	}
+}
+
+#endif // FFMPEG_FACADE_INPUTSOURCE_H
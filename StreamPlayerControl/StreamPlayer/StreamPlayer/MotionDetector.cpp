@@ -0,0 +1,334 @@
+#include "motiondetector.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include <emmintrin.h>
+#include <boost/thread/locks.hpp>
+
+namespace FFmpeg
+{
+	extern "C"
+	{
+#include <libavutil/pixdesc.h>
+#include <libavutil/motion_vector.h>
+	}
+}
+
+using namespace std;
+using namespace FFmpeg;
+using namespace FFmpeg::Facade;
+
+namespace
+{
+	const uint32_t DefaultThreshold = 12;
+}
+
+MotionDetector::MotionDetector()
+	: enabled_(false), mode_(LumaMode), startDelay_(boost::chrono::milliseconds(500)),
+	stopDelay_(boost::chrono::milliseconds(3000)),
+	width_(0), height_(0), backgroundValid_(false)
+{
+	for (uint32_t zoneNum = 0; zoneNum < MaxZones; ++zoneNum)
+		SetupZone(zoneNum, 0, 0, 100, 100, zoneNum == 0 ? DefaultThreshold : 0);
+}
+
+void MotionDetector::SetHandler(MotionHandler const& handler)
+{
+	boost::unique_lock<boost::mutex> lock(mutex_);
+	handler_ = handler;
+}
+
+void MotionDetector::Setup(bool enabled, uint32_t startDelayInMilliseconds, uint32_t stopDelayInMilliseconds)
+{
+	vector<uint32_t> stoppedZones;
+
+	boost::unique_lock<boost::mutex> lock(mutex_);
+
+	enabled_ = enabled;
+	startDelay_ = boost::chrono::milliseconds(startDelayInMilliseconds);
+	stopDelay_ = boost::chrono::milliseconds(stopDelayInMilliseconds);
+
+	if (!enabled_)
+	{
+		backgroundValid_ = false;
+
+		for (uint32_t zoneNum = 0; zoneNum < MaxZones; ++zoneNum)
+		{
+			if (zones_[zoneNum].motion)
+				stoppedZones.push_back(zoneNum);
+
+			zones_[zoneNum].motion = false;
+			zones_[zoneNum].changePending = false;
+		}
+	}
+
+	MotionHandler handler = handler_;
+	lock.unlock();
+
+	if (handler)
+	{
+		for (auto zoneNum : stoppedZones)
+			handler(zoneNum, false);
+	}
+}
+
+void MotionDetector::SetMode(Mode mode)
+{
+	boost::unique_lock<boost::mutex> lock(mutex_);
+
+	// A reconnect in the same mode keeps the background.
+	if (mode_ == mode)
+		return;
+
+	mode_ = mode;
+	backgroundValid_ = false;
+}
+
+void MotionDetector::SetupZone(uint32_t zoneNum, uint32_t left, uint32_t top,
+	uint32_t right, uint32_t bottom, uint32_t threshold)
+{
+	if (zoneNum >= MaxZones)
+		throw runtime_error("invalid zone");
+
+	boost::unique_lock<boost::mutex> lock(mutex_);
+
+	Zone &zone = zones_[zoneNum];
+	zone.threshold = threshold;
+	zone.cellCount = 0;
+	zone.motion = false;
+	zone.changePending = false;
+
+	::memset(zone.mask, 0, sizeof(zone.mask));
+
+	const uint32_t gridLeft = min(left, 100U) * GridWidth / 100;
+	const uint32_t gridRight = min(right, 100U) * GridWidth / 100;
+	const uint32_t gridTop = min(top, 100U) * GridHeight / 100;
+	const uint32_t gridBottom = min(bottom, 100U) * GridHeight / 100;
+
+	for (uint32_t y = gridTop; y < gridBottom; ++y)
+	{
+		for (uint32_t x = gridLeft; x < gridRight; ++x)
+		{
+			zone.mask[y * GridWidth + x] = 0xFF;
+			++zone.cellCount;
+		}
+	}
+}
+
+void MotionDetector::StreamOpened(AVStream const * /*streamPtr*/)
+{
+	boost::unique_lock<boost::mutex> lock(mutex_);
+	backgroundValid_ = false;
+}
+
+void MotionDetector::FrameDecoded(AVFrame const *framePtr)
+{
+	vector<pair<uint32_t, bool>> events;
+
+	boost::unique_lock<boost::mutex> lock(mutex_);
+
+	if (!enabled_)
+		return;
+
+	if (mode_ == MotionVectorMode)
+	{
+		if (!BuildActivityMap(framePtr))
+			return;
+
+		if (!backgroundValid_)
+		{
+			// The activity is compared against no motion at all.
+			::memset(background_, 0, GridSize);
+			backgroundValid_ = true;
+		}
+	}
+	else if (!Downsample(framePtr))
+	{
+		return;
+	}
+	else if (!backgroundValid_)
+	{
+		::memcpy(background_, grid_, GridSize);
+		backgroundValid_ = true;
+		return;
+	}
+
+	const auto now = Clock::now();
+	for (uint32_t zoneNum = 0; zoneNum < MaxZones; ++zoneNum)
+	{
+		Zone &zone = zones_[zoneNum];
+		if (zone.threshold == 0 || zone.cellCount == 0)
+			continue;
+
+		const uint32_t level = MaskedSad(grid_, background_, zone.mask) / zone.cellCount;
+		if (UpdateZone(zone, level, now))
+			events.push_back(make_pair(zoneNum, zone.motion));
+	}
+
+	if (mode_ == LumaMode)
+	{
+		// The background follows the scene with a weight of 1/8 per frame.
+		for (uint32_t i = 0; i < GridSize; i += 16)
+		{
+			__m128i current = _mm_loadu_si128(reinterpret_cast<__m128i const *>(grid_ + i));
+			__m128i background = _mm_loadu_si128(reinterpret_cast<__m128i const *>(background_ + i));
+
+			background = _mm_avg_epu8(background, _mm_avg_epu8(background, _mm_avg_epu8(background, current)));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(background_ + i), background);
+		}
+	}
+
+	MotionHandler handler = handler_;
+	lock.unlock();
+
+	if (handler)
+	{
+		for (auto const& event : events)
+			handler(event.first, event.second);
+	}
+}
+
+bool MotionDetector::Downsample(AVFrame const *framePtr)
+{
+	// Planar YUV, NV12 and gray formats all start with a full resolution luma plane.
+	AVPixFmtDescriptor const *descPtr = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(framePtr->format));
+	if (descPtr == nullptr || (descPtr->flags & (AV_PIX_FMT_FLAG_RGB | AV_PIX_FMT_FLAG_PAL)))
+		return false;
+
+	const uint32_t cellWidth = framePtr->width / GridWidth;
+	const uint32_t cellHeight = framePtr->height / GridHeight;
+	if (cellWidth == 0 || cellHeight == 0)
+		return false;
+
+	if (framePtr->width != width_ || framePtr->height != height_)
+	{
+		width_ = framePtr->width;
+		height_ = framePtr->height;
+		backgroundValid_ = false;
+	}
+
+	// Up to four rows of a cell are enough to tell its brightness.
+	const uint32_t rowStep = cellHeight > 4 ? cellHeight / 4 : 1;
+
+	for (uint32_t gridY = 0; gridY < GridHeight; ++gridY)
+	{
+		uint32_t sums[GridWidth] = {};
+		uint32_t rowCount = 0;
+
+		for (uint32_t y = gridY * cellHeight; y < (gridY + 1) * cellHeight; y += rowStep)
+		{
+			uint8_t const *rowPtr = framePtr->data[0] + static_cast<ptrdiff_t>(y) * framePtr->linesize[0];
+			for (uint32_t gridX = 0; gridX < GridWidth; ++gridX)
+				sums[gridX] += RowSum(rowPtr + gridX * cellWidth, cellWidth);
+
+			++rowCount;
+		}
+
+		const uint32_t samplesPerCell = rowCount * cellWidth;
+		for (uint32_t gridX = 0; gridX < GridWidth; ++gridX)
+			grid_[gridY * GridWidth + gridX] = static_cast<uint8_t>(sums[gridX] / samplesPerCell);
+	}
+
+	return true;
+}
+
+bool MotionDetector::BuildActivityMap(AVFrame const *framePtr)
+{
+	// Intra frames carry no motion vectors, the zones keep their state until the next frame.
+	if (framePtr->pict_type == AV_PICTURE_TYPE_I || framePtr->width <= 0 || framePtr->height <= 0)
+		return false;
+
+	uint32_t activity[GridSize] = {};
+
+	AVFrameSideData const *sideDataPtr = av_frame_get_side_data(framePtr, AV_FRAME_DATA_MOTION_VECTORS);
+	if (sideDataPtr != nullptr)
+	{
+		AVMotionVector const *vectorsPtr = reinterpret_cast<AVMotionVector const *>(sideDataPtr->data);
+		const size_t vectorCount = sideDataPtr->size / sizeof(AVMotionVector);
+
+		for (size_t i = 0; i < vectorCount; ++i)
+		{
+			AVMotionVector const& vector = vectorsPtr[i];
+
+			const uint32_t length = abs(vector.dst_x - vector.src_x) + abs(vector.dst_y - vector.src_y);
+			if (length == 0)
+				continue;
+
+			const int32_t gridX = min(max(vector.dst_x * static_cast<int32_t>(GridWidth) / framePtr->width, 0),
+				static_cast<int32_t>(GridWidth) - 1);
+			const int32_t gridY = min(max(vector.dst_y * static_cast<int32_t>(GridHeight) / framePtr->height, 0),
+				static_cast<int32_t>(GridHeight) - 1);
+
+			// Weighted by the block area, in 16x16 macroblock units.
+			activity[gridY * GridWidth + gridX] += length * vector.w * vector.h / 256;
+		}
+	}
+
+	for (uint32_t i = 0; i < GridSize; ++i)
+		grid_[i] = static_cast<uint8_t>(min(activity[i], 255U));
+
+	return true;
+}
+
+bool MotionDetector::UpdateZone(Zone &zone, uint32_t level, Clock::time_point now)
+{
+	const bool motion = level >= zone.threshold;
+	if (motion == zone.motion)
+	{
+		zone.changePending = false;
+		return false;
+	}
+
+	if (!zone.changePending)
+	{
+		zone.changePending = true;
+		zone.changeStart = now;
+	}
+
+	if (now - zone.changeStart < (motion ? startDelay_ : stopDelay_))
+		return false;
+
+	zone.motion = motion;
+	zone.changePending = false;
+	return true;
+}
+
+uint32_t MotionDetector::MaskedSad(uint8_t const *aPtr, uint8_t const *bPtr, uint8_t const *maskPtr)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i sum = zero;
+
+	for (uint32_t i = 0; i < GridSize; i += 16)
+	{
+		__m128i a = _mm_loadu_si128(reinterpret_cast<__m128i const *>(aPtr + i));
+		__m128i b = _mm_loadu_si128(reinterpret_cast<__m128i const *>(bPtr + i));
+		__m128i mask = _mm_loadu_si128(reinterpret_cast<__m128i const *>(maskPtr + i));
+
+		__m128i diff = _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+		sum = _mm_add_epi64(sum, _mm_sad_epu8(_mm_and_si128(diff, mask), zero));
+	}
+
+	return static_cast<uint32_t>(_mm_cvtsi128_si32(sum) + _mm_cvtsi128_si32(_mm_srli_si128(sum, 8)));
+}
+
+uint32_t MotionDetector::RowSum(uint8_t const *rowPtr, uint32_t width)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i sum = zero;
+
+	uint32_t x = 0;
+	for (; x + 16 <= width; x += 16)
+	{
+		__m128i pixels = _mm_loadu_si128(reinterpret_cast<__m128i const *>(rowPtr + x));
+		sum = _mm_add_epi64(sum, _mm_sad_epu8(pixels, zero));
+	}
+
+	uint32_t result = static_cast<uint32_t>(_mm_cvtsi128_si32(sum) + _mm_cvtsi128_si32(_mm_srli_si128(sum, 8)));
+	for (; x < width; ++x)
+		result += rowPtr[x];
+
+	return result;
+}
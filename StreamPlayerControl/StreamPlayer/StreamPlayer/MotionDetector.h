@@ -0,0 +1,128 @@
+#ifndef FFMPEG_FACADE_MOTIONDETECTOR_H
+#define FFMPEG_FACADE_MOTIONDETECTOR_H
+
+#include <cstdint>
+#include <functional>
+#include <boost/noncopyable.hpp>
+#include <boost/chrono.hpp>
+
+#pragma warning( push )
+#pragma warning( disable : 4100 )
+
+#include <boost/thread/mutex.hpp>
+
+#pragma warning( pop )
+
+#include "framesink.h"
+
+namespace FFmpeg
+{
+	namespace Facade
+	{
+		/// <summary>
+		/// A MotionDetector class detects motion on the luma plane of decoded frames.
+		/// Frames are downsampled to a small grid and compared to a running background,
+		/// the difference is summed per zone and debounced into motion start and stop events.
+		/// Alternatively the grid is built from the codec motion vectors, with no pixel analysis at all.
+		/// </summary>
+		class MotionDetector : public FrameSink, private boost::noncopyable
+		{
+		public:
+			/// <summary>
+			/// Handles a motion event, called on the decoding thread.
+			/// </summary>
+			typedef std::function<void(uint32_t zoneNum, bool motion)> MotionHandler;
+
+			enum Mode
+			{
+				// Luma differences against a running background.
+				LumaMode,
+				// Motion vectors exported by the codec, the decoder must be opened with exportMotionVectors.
+				MotionVectorMode
+			};
+
+			static const uint32_t MaxZones = 8;
+
+			/// <summary>
+			/// Initializes a new instance of the MotionDetector class. The detector is disabled,
+			/// zone 0 covers the whole frame.
+			/// </summary>
+			MotionDetector();
+
+			/// <summary>
+			/// Sets the handler of the motion events.
+			/// </summary>
+			void SetHandler(MotionHandler const& handler);
+
+			/// <summary>
+			/// Enables or disables the detector.
+			/// </summary>
+			/// <param name="enabled">true to enable the detector.</param>
+			/// <param name="startDelayInMilliseconds">How long motion should last before it is reported.</param>
+			/// <param name="stopDelayInMilliseconds">How long a zone should stay still before the motion end is reported.</param>
+			void Setup(bool enabled, uint32_t startDelayInMilliseconds, uint32_t stopDelayInMilliseconds);
+
+			/// <summary>
+			/// Sets the detection mode.
+			/// </summary>
+			void SetMode(Mode mode);
+
+			/// <summary>
+			/// Sets up a zone. Coordinates are percents of the frame size.
+			/// </summary>
+			/// <param name="threshold">The mean luma difference, or the mean motion vector length per macroblock,
+			/// that counts as motion. Zero removes the zone.</param>
+			void SetupZone(uint32_t zoneNum, uint32_t left, uint32_t top,
+				uint32_t right, uint32_t bottom, uint32_t threshold);
+
+			virtual void StreamOpened(AVStream const *streamPtr) override;
+
+			virtual void FrameDecoded(AVFrame const *framePtr) override;
+
+		private:
+			typedef boost::chrono::steady_clock Clock;
+
+			static const uint32_t GridWidth = 64;
+			static const uint32_t GridHeight = 48;
+			static const uint32_t GridSize = GridWidth * GridHeight;
+
+			struct Zone
+			{
+				uint32_t threshold;
+				uint32_t cellCount;
+				// 0xFF for the grid cells inside the zone.
+				uint8_t mask[GridSize];
+				bool motion;
+				bool changePending;
+				Clock::time_point changeStart;
+			};
+
+			bool Downsample(AVFrame const *framePtr);
+
+			bool BuildActivityMap(AVFrame const *framePtr);
+
+			bool UpdateZone(Zone &zone, uint32_t level, Clock::time_point now);
+
+			static uint32_t MaskedSad(uint8_t const *aPtr, uint8_t const *bPtr, uint8_t const *maskPtr);
+
+			static uint32_t RowSum(uint8_t const *rowPtr, uint32_t width);
+
+			boost::mutex mutex_;
+			MotionHandler handler_;
+			bool enabled_;
+			Mode mode_;
+			Clock::duration startDelay_;
+			Clock::duration stopDelay_;
+			Zone zones_[MaxZones];
+
+			int32_t width_, height_;
+			bool backgroundValid_;
+			// The downsampled luma, or the motion activity, of the latest frame.
+			uint8_t grid_[GridSize];
+			// The running background, all zeros in the motion vector mode.
+			uint8_t background_[GridSize];
+		};
+	}
+}
+
+#endif // FFMPEG_FACADE_MOTIONDETECTOR_H
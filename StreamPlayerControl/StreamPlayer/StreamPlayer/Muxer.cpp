@@ -0,0 +1,159 @@
+#include "muxer.h"
+#include <stdexcept>
+
+using namespace std;
+using namespace FFmpeg;
+using namespace FFmpeg::Facade;
+
+Muxer::Muxer(string const& fileName, AVCodecContext const *codecCtxPtr,
+	AVRational timeBase, AVDictionary *formatOpts)
+	: formatCtxPtr_(nullptr), streamPtr_(nullptr), ownsIo_(true), timeBase_(timeBase),
+	firstDts_(AV_NOPTS_VALUE), lastDts_(AV_NOPTS_VALUE)
+{
+	int error = avformat_alloc_output_context2(&formatCtxPtr_, nullptr, nullptr, fileName.c_str());
+	if (error < 0)
+	{
+		throw runtime_error("avformat_alloc_output_context2() failed: " + AvStrError(error));
+	}
+
+	Open(fileName, codecCtxPtr, formatOpts);
+}
+
+Muxer::Muxer(AVIOContext *ioCtxPtr, string const& formatName, AVCodecContext const *codecCtxPtr,
+	AVRational timeBase, AVDictionary *formatOpts)
+	: formatCtxPtr_(nullptr), streamPtr_(nullptr), ownsIo_(false), timeBase_(timeBase),
+	firstDts_(AV_NOPTS_VALUE), lastDts_(AV_NOPTS_VALUE)
+{
+	int error = avformat_alloc_output_context2(&formatCtxPtr_, nullptr, formatName.c_str(), nullptr);
+	if (error < 0)
+	{
+		throw runtime_error("avformat_alloc_output_context2() failed: " + AvStrError(error));
+	}
+
+	formatCtxPtr_->pb = ioCtxPtr;
+
+	Open(string(), codecCtxPtr, formatOpts);
+}
+
+void Muxer::Open(string const& fileName, AVCodecContext const *codecCtxPtr, AVDictionary *formatOpts)
+{
+	streamPtr_ = avformat_new_stream(formatCtxPtr_, nullptr);
+	if (streamPtr_ == nullptr)
+	{
+		Close();
+		throw runtime_error("avformat_new_stream() failed");
+	}
+
+	int error = avcodec_copy_context(streamPtr_->codec, codecCtxPtr);
+	if (error < 0)
+	{
+		Close();
+		throw runtime_error("avcodec_copy_context() failed: " + AvStrError(error));
+	}
+
+	// The source codec tag may be invalid for the output container.
+	streamPtr_->codec->codec_tag = 0;
+	streamPtr_->time_base = timeBase_;
+
+	if (formatCtxPtr_->oformat->flags & AVFMT_GLOBALHEADER)
+		streamPtr_->codec->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+	if (ownsIo_ && !(formatCtxPtr_->oformat->flags & AVFMT_NOFILE))
+	{
+		error = avio_open(&formatCtxPtr_->pb, fileName.c_str(), AVIO_FLAG_WRITE);
+		if (error < 0)
+		{
+			Close();
+			throw runtime_error("avio_open() failed: " + AvStrError(error));
+		}
+	}
+
+	AVDictionary *opts = nullptr;
+	av_dict_copy(&opts, formatOpts, 0);
+	error = avformat_write_header(formatCtxPtr_, &opts);
+	av_dict_free(&opts);
+
+	if (error < 0)
+	{
+		Close();
+		throw runtime_error("avformat_write_header() failed: " + AvStrError(error));
+	}
+}
+
+void Muxer::WritePacket(AVPacket const &packet)
+{
+	AVPacket outPacket;
+	av_init_packet(&outPacket);
+	outPacket.data = packet.data;
+	outPacket.size = packet.size;
+	outPacket.flags = packet.flags;
+	outPacket.duration = packet.duration;
+	outPacket.stream_index = streamPtr_->index;
+
+	if (firstDts_ == AV_NOPTS_VALUE)
+		firstDts_ = packet.dts != AV_NOPTS_VALUE ? packet.dts : packet.pts;
+
+	if (firstDts_ != AV_NOPTS_VALUE)
+	{
+		outPacket.pts = packet.pts != AV_NOPTS_VALUE ? packet.pts - firstDts_ : AV_NOPTS_VALUE;
+		outPacket.dts = packet.dts != AV_NOPTS_VALUE ? packet.dts - firstDts_ : AV_NOPTS_VALUE;
+	}
+
+	av_packet_rescale_ts(&outPacket, timeBase_, streamPtr_->time_base);
+
+	// Cameras occasionally repeat timestamps, most containers reject non-monotonic ones.
+	if (outPacket.dts != AV_NOPTS_VALUE)
+	{
+		if (lastDts_ != AV_NOPTS_VALUE && outPacket.dts <= lastDts_)
+			outPacket.dts = lastDts_ + 1;
+
+		if (outPacket.pts != AV_NOPTS_VALUE && outPacket.pts < outPacket.dts)
+			outPacket.pts = outPacket.dts;
+
+		lastDts_ = outPacket.dts;
+	}
+
+	int error = av_write_frame(formatCtxPtr_, &outPacket);
+	if (error < 0)
+	{
+		throw runtime_error("av_write_frame() failed: " + AvStrError(error));
+	}
+}
+
+int64_t Muxer::BytesWritten() const
+{
+	return formatCtxPtr_->pb != nullptr ? avio_tell(formatCtxPtr_->pb) : 0;
+}
+
+int64_t Muxer::DurationInMilliseconds() const
+{
+	if (lastDts_ == AV_NOPTS_VALUE)
+		return 0;
+
+	return av_rescale_q(lastDts_, streamPtr_->time_base, AVRational{ 1, 1000 });
+}
+
+void Muxer::Close()
+{
+	if (formatCtxPtr_ == nullptr)
+		return;
+
+	if (ownsIo_ && !(formatCtxPtr_->oformat->flags & AVFMT_NOFILE))
+		avio_closep(&formatCtxPtr_->pb);
+
+	avformat_free_context(formatCtxPtr_);
+	formatCtxPtr_ = nullptr;
+}
+
+string Muxer::AvStrError(int errnum)
+{
+	char buf[128];
+	av_strerror(errnum, buf, sizeof(buf));
+	return string(buf);
+}
+
+Muxer::~Muxer()
+{
+	av_write_trailer(formatCtxPtr_);
+	Close();
+}
@@ -0,0 +1,91 @@
+#ifndef FFMPEG_FACADE_MUXER_H
+#define FFMPEG_FACADE_MUXER_H
+
+#include <cstdint>
+#include <string>
+#include <boost/noncopyable.hpp>
+
+namespace FFmpeg
+{
+
+#pragma warning( push )
+#pragma warning( disable : 4244 )
+
+	extern "C"
+	{
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+	}
+
+#pragma warning( pop )
+
+	namespace Facade
+	{
+		/// <summary>
+		/// A Muxer class writes compressed packets of a single video stream to a container
+		/// without re-encoding them.
+		/// </summary>
+		class Muxer : private boost::noncopyable
+		{
+		public:
+			/// <summary>
+			/// Initializes a new instance of the Muxer class and writes the container header.
+			/// </summary>
+			/// <param name="fileName">The file to write, the container format is guessed from its extension.</param>
+			/// <param name="codecCtxPtr">The codec context of the stream the packets belong to.</param>
+			/// <param name="timeBase">The time base of the packets to be written.</param>
+			/// <param name="formatOpts">The muxer options, may be null.</param>
+			Muxer(std::string const& fileName, AVCodecContext const *codecCtxPtr,
+				AVRational timeBase, AVDictionary *formatOpts = nullptr);
+
+			/// <summary>
+			/// Initializes a new instance of the Muxer class that writes to a caller-owned I/O context.
+			/// </summary>
+			/// <param name="ioCtxPtr">The I/O context to write to, must outlive the muxer.</param>
+			/// <param name="formatName">The short name of the container format.</param>
+			/// <param name="codecCtxPtr">The codec context of the stream the packets belong to.</param>
+			/// <param name="timeBase">The time base of the packets to be written.</param>
+			/// <param name="formatOpts">The muxer options, may be null.</param>
+			Muxer(AVIOContext *ioCtxPtr, std::string const& formatName, AVCodecContext const *codecCtxPtr,
+				AVRational timeBase, AVDictionary *formatOpts = nullptr);
+
+			/// <summary>
+			/// Writes a packet, timestamps are shifted so that the output starts at zero.
+			/// </summary>
+			/// <param name="packet">The packet to write.</param>
+			void WritePacket(AVPacket const &packet);
+
+			/// <summary>
+			/// Gets the number of bytes written so far.
+			/// </summary>
+			int64_t BytesWritten() const;
+
+			/// <summary>
+			/// Gets the duration written so far, in milliseconds.
+			/// </summary>
+			int64_t DurationInMilliseconds() const;
+
+			/// <summary>
+			/// Writes the container trailer and releases all resources used by the muxer.
+			/// </summary>
+			~Muxer();
+
+		private:
+
+			void Open(std::string const& fileName, AVCodecContext const *codecCtxPtr, AVDictionary *formatOpts);
+
+			void Close();
+
+			static std::string AvStrError(int errnum);
+
+			AVFormatContext *formatCtxPtr_;
+			AVStream *streamPtr_;
+			bool ownsIo_;
+			AVRational timeBase_;
+			int64_t firstDts_;
+			int64_t lastDts_;
+		};
+	}
+}
+
+#endif // FFMPEG_FACADE_MUXER_H
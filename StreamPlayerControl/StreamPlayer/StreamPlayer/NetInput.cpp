@@ -0,0 +1,181 @@
+#include "netinput.h"
+#include <cctype>
+#include <cstdlib>
+#include <stdexcept>
+
+#include "netreactor.h"
+
+namespace FFmpeg
+{
+
+#pragma warning( push )
+#pragma warning( disable : 4244 )
+
+	extern "C"
+	{
+#include <libavutil/base64.h>
+	}
+
+#pragma warning( pop )
+
+}
+
+using namespace std;
+using namespace FFmpeg;
+using namespace FFmpeg::Facade;
+
+namespace
+{
+	const size_t MaxHeadersSize = 16 * 1024;
+
+	bool StartsWith(string const& text, string const& prefix)
+	{
+		return text.compare(0, prefix.size(), prefix) == 0;
+	}
+
+	string ToLower(string text)
+	{
+		for (auto& c : text)
+			c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+
+		return text;
+	}
+}
+
+bool NetInput::Supports(string const& streamUrl)
+{
+	const string url = ToLower(streamUrl);
+	return StartsWith(url, "http://") || StartsWith(url, "tcp://");
+}
+
+NetInput::NetInput(NetReactor &reactor, string const& streamUrl, AVIOInterruptCB const& interrupt)
+	: reactor_(reactor)
+{
+	const bool http = StartsWith(ToLower(streamUrl), "http://");
+
+	// scheme://[user:password@]host[:port][/path]
+	const size_t authorityStart = streamUrl.find("://") + 3;
+	const size_t pathStart = streamUrl.find('/', authorityStart);
+	string authority = streamUrl.substr(authorityStart, pathStart - authorityStart);
+	const string path = pathStart != string::npos ? streamUrl.substr(pathStart) : "/";
+
+	string credentials;
+	const size_t credentialsEnd = authority.rfind('@');
+	if (credentialsEnd != string::npos)
+	{
+		credentials = authority.substr(0, credentialsEnd);
+		authority = authority.substr(credentialsEnd + 1);
+	}
+
+	string host = authority;
+	uint16_t port = http ? 80 : 0;
+
+	const size_t portStart = authority.rfind(':');
+	if (portStart != string::npos && authority.find(']', portStart) == string::npos)
+	{
+		host = authority.substr(0, portStart);
+		port = static_cast<uint16_t>(atoi(authority.c_str() + portStart + 1));
+	}
+
+	if (!host.empty() && host.front() == '[' && host.back() == ']')
+		host = host.substr(1, host.size() - 2);
+
+	if (host.empty() || port == 0)
+		throw runtime_error("invalid url");
+
+	connectionPtr_ = reactor_.Connect(host, port, interrupt);
+
+	if (http)
+	{
+		string request = "GET " + path + " HTTP/1.0\r\nHost: " + authority + "\r\nUser-Agent: StreamPlayer\r\n";
+
+		if (!credentials.empty())
+		{
+			string encoded(AV_BASE64_SIZE(credentials.size()), '\0');
+			av_base64_encode(&encoded[0], static_cast<int>(encoded.size()),
+				reinterpret_cast<uint8_t const *>(credentials.data()), static_cast<int>(credentials.size()));
+			encoded.resize(encoded.size() - 1);
+
+			request += "Authorization: Basic " + encoded + "\r\n";
+		}
+
+		request += "\r\n";
+
+		connectionPtr_->Send(request, interrupt);
+	}
+
+	reactor_.Add(connectionPtr_);
+
+	if (http)
+	{
+		try
+		{
+			ReadResponseHeaders(interrupt);
+		}
+		catch (runtime_error&)
+		{
+			reactor_.Remove(connectionPtr_);
+			throw;
+		}
+	}
+}
+
+void NetInput::ReadResponseHeaders(AVIOInterruptCB const& interrupt)
+{
+	// The body follows the headers in the same buffer, so they are read a byte at a time.
+	string headers;
+	while (headers.size() < 4 || headers.compare(headers.size() - 4, 4, "\r\n\r\n") != 0)
+	{
+		if (headers.size() > MaxHeadersSize)
+			throw runtime_error("invalid HTTP response");
+
+		uint8_t c;
+		const int32_t result = connectionPtr_->Read(&c, 1, interrupt);
+		if (result < 0)
+			throw runtime_error("no HTTP response");
+
+		headers += static_cast<char>(c);
+	}
+
+	// HTTP/1.x 200 OK
+	const size_t statusStart = headers.find(' ');
+	if (!StartsWith(headers, "HTTP/") || statusStart == string::npos || atoi(headers.c_str() + statusStart + 1) != 200)
+		throw runtime_error("HTTP request failed: " + headers.substr(0, headers.find('\r')));
+
+	const string lowerHeaders = ToLower(headers);
+	const size_t contentTypeStart = lowerHeaders.find("\r\ncontent-type:");
+	if (contentTypeStart != string::npos)
+	{
+		const size_t valueStart = lowerHeaders.find_first_not_of(' ', contentTypeStart + 15);
+		contentType_ = lowerHeaders.substr(valueStart, lowerHeaders.find('\r', valueStart) - valueStart);
+	}
+}
+
+int32_t NetInput::Read(uint8_t *bufferPtr, int32_t size, AVIOInterruptCB const& interrupt)
+{
+	return connectionPtr_->Read(bufferPtr, size, interrupt);
+}
+
+size_t NetInput::Available() const
+{
+	return connectionPtr_->Available();
+}
+
+bool NetInput::Ended() const
+{
+	return connectionPtr_->Ended();
+}
+
+AVInputFormat *NetInput::Format() const
+{
+	// A camera MJPEG stream is a multipart response with a JPEG picture per part.
+	if (StartsWith(contentType_, "multipart/"))
+		return av_find_input_format("mpjpeg");
+
+	return nullptr;
+}
+
+NetInput::~NetInput()
+{
+	reactor_.Remove(connectionPtr_);
+}
@@ -0,0 +1,59 @@
+#ifndef FFMPEG_FACADE_NETINPUT_H
+#define FFMPEG_FACADE_NETINPUT_H
+
+#include <string>
+#include <memory>
+#include <boost/noncopyable.hpp>
+
+#include "inputsource.h"
+
+namespace FFmpeg
+{
+	namespace Facade
+	{
+		class NetReactor;
+		class NetConnection;
+
+		/// <summary>
+		/// A NetInput class reads an HTTP stream, such as MJPEG, or a raw TCP stream through a NetReactor.
+		/// </summary>
+		class NetInput : public InputSource, private boost::noncopyable
+		{
+		public:
+			/// <summary>
+			/// Gets whether a url is read by this class, http:// and tcp:// urls are.
+			/// </summary>
+			static bool Supports(std::string const& streamUrl);
+
+			/// <summary>
+			/// Initializes a new instance of the NetInput class, connects and reads the response headers.
+			/// </summary>
+			/// <param name="reactor">The reactor that reads the socket.</param>
+			/// <param name="streamUrl">The url of a stream, http://[user:password@]host[:port][/path] or tcp://host:port.</param>
+			/// <param name="interrupt">Polled while connecting and reading.</param>
+			NetInput(NetReactor &reactor, std::string const& streamUrl, AVIOInterruptCB const& interrupt);
+
+			virtual int32_t Read(uint8_t *bufferPtr, int32_t size, AVIOInterruptCB const& interrupt) override;
+
+			virtual size_t Available() const override;
+
+			virtual bool Ended() const override;
+
+			virtual AVInputFormat *Format() const override;
+
+			/// <summary>
+			/// Releases all resources used by the input.
+			/// </summary>
+			virtual ~NetInput();
+
+		private:
+			void ReadResponseHeaders(AVIOInterruptCB const& interrupt);
+
+			NetReactor &reactor_;
+			std::shared_ptr<NetConnection> connectionPtr_;
+			std::string contentType_;
+		};
+	}
+}
+
+#endif // FFMPEG_FACADE_NETINPUT_H
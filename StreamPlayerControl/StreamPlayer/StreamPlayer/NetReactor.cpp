@@ -0,0 +1,402 @@
+#include "netreactor.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include <ws2tcpip.h>
+
+using namespace std;
+using namespace FFmpeg;
+using namespace FFmpeg::Facade;
+
+namespace
+{
+	// The bytes a connection buffers before the reactor stops reading it.
+	const size_t MaxBufferedBytes = 4 * 1024 * 1024;
+	const int32_t ReceiveChunkSize = 64 * 1024;
+
+	// How often a blocked caller polls its interrupt callback.
+	const int32_t PollIntervalInMilliseconds = 50;
+
+	bool Interrupted(AVIOInterruptCB const& interrupt)
+	{
+		return interrupt.callback != nullptr && interrupt.callback(interrupt.opaque) != 0;
+	}
+
+	// Waits until a socket is ready for the given events, polling the interrupt callback.
+	void WaitForSocket(SOCKET socket, short events, AVIOInterruptCB const& interrupt)
+	{
+		for (;;)
+		{
+			if (Interrupted(interrupt))
+				throw runtime_error("interrupted");
+
+			WSAPOLLFD pollFd = { socket, events, 0 };
+			const int result = ::WSAPoll(&pollFd, 1, PollIntervalInMilliseconds);
+
+			if (result == SOCKET_ERROR)
+				throw runtime_error("WSAPoll() failed");
+
+			if (result > 0)
+				return;
+		}
+	}
+}
+
+NetConnection::NetConnection(SOCKET socket)
+	: socket_(socket), readPosition_(0), ended_(false), failed_(false) {}
+
+void NetConnection::Send(string const& data, AVIOInterruptCB const& interrupt)
+{
+	size_t sent = 0;
+
+	while (sent < data.size())
+	{
+		const int result = ::send(socket_, data.data() + sent, static_cast<int>(data.size() - sent), 0);
+
+		if (result == SOCKET_ERROR)
+		{
+			if (::WSAGetLastError() != WSAEWOULDBLOCK)
+				throw runtime_error("send() failed");
+
+			WaitForSocket(socket_, POLLWRNORM, interrupt);
+			continue;
+		}
+
+		sent += result;
+	}
+}
+
+int32_t NetConnection::Read(uint8_t *bufferPtr, int32_t size, AVIOInterruptCB const& interrupt)
+{
+	boost::unique_lock<boost::mutex> lock(mutex_);
+
+	while (buffer_.size() == readPosition_ && !ended_)
+	{
+		if (Interrupted(interrupt))
+			return AVERROR_EXIT;
+
+		dataCondition_.wait_for(lock, boost::chrono::milliseconds(PollIntervalInMilliseconds));
+	}
+
+	const size_t available = buffer_.size() - readPosition_;
+	if (available == 0)
+		return failed_ ? AVERROR(EIO) : AVERROR_EOF;
+
+	const bool wasFull = !WantsInput();
+
+	const size_t count = min(available, static_cast<size_t>(size));
+	memcpy(bufferPtr, buffer_.data() + readPosition_, count);
+	readPosition_ += count;
+
+	// The read bytes are dropped in bulk, not on every read.
+	if (readPosition_ == buffer_.size() || readPosition_ > MaxBufferedBytes / 2)
+	{
+		buffer_.erase(buffer_.begin(), buffer_.begin() + readPosition_);
+		readPosition_ = 0;
+	}
+
+	if (wasFull && WantsInput() && wake_)
+		wake_();
+
+	return static_cast<int32_t>(count);
+}
+
+size_t NetConnection::Available() const
+{
+	boost::unique_lock<boost::mutex> lock(mutex_);
+	return buffer_.size() - readPosition_;
+}
+
+bool NetConnection::Ended() const
+{
+	boost::unique_lock<boost::mutex> lock(mutex_);
+	return ended_;
+}
+
+void NetConnection::Receive()
+{
+	uint8_t chunk[ReceiveChunkSize];
+	const int result = ::recv(socket_, reinterpret_cast<char *>(chunk), sizeof(chunk), 0);
+
+	if (result == SOCKET_ERROR && ::WSAGetLastError() == WSAEWOULDBLOCK)
+		return;
+
+	{
+		boost::unique_lock<boost::mutex> lock(mutex_);
+
+		if (result > 0)
+		{
+			buffer_.insert(buffer_.end(), chunk, chunk + result);
+		}
+		else
+		{
+			// Zero is an orderly close by the peer.
+			ended_ = true;
+			failed_ = result != 0;
+		}
+	}
+
+	dataCondition_.notify_all();
+}
+
+bool NetConnection::WantsInput() const
+{
+	return buffer_.size() - readPosition_ < MaxBufferedBytes;
+}
+
+NetConnection::~NetConnection()
+{
+	::closesocket(socket_);
+}
+
+NetReactor::NetReactor()
+	: stopRequested_(false), winsockStarted_(false) {}
+
+void NetReactor::Start(uint32_t threadCount)
+{
+	if (winsockStarted_)
+		return;
+
+	if (threadCount == 0)
+		threadCount = max(boost::thread::hardware_concurrency() / 4, 1u);
+
+	WSADATA wsaData;
+	if (::WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+		throw runtime_error("WSAStartup() failed");
+
+	winsockStarted_ = true;
+	stopRequested_ = false;
+
+	for (uint32_t i = 0; i < threadCount; ++i)
+	{
+		std::unique_ptr<Loop> loopPtr = std::make_unique<Loop>();
+
+		loopPtr->wakeSocket = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+		if (loopPtr->wakeSocket == INVALID_SOCKET)
+		{
+			Shutdown();
+			throw runtime_error("socket() failed");
+		}
+
+		memset(&loopPtr->wakeAddress, 0, sizeof(loopPtr->wakeAddress));
+		loopPtr->wakeAddress.sin_family = AF_INET;
+		loopPtr->wakeAddress.sin_addr.s_addr = ::htonl(INADDR_LOOPBACK);
+
+		int addressSize = sizeof(loopPtr->wakeAddress);
+		sockaddr *addressPtr = reinterpret_cast<sockaddr *>(&loopPtr->wakeAddress);
+
+		if (::bind(loopPtr->wakeSocket, addressPtr, addressSize) == SOCKET_ERROR ||
+			::getsockname(loopPtr->wakeSocket, addressPtr, &addressSize) == SOCKET_ERROR)
+		{
+			::closesocket(loopPtr->wakeSocket);
+			Shutdown();
+			throw runtime_error("bind() failed");
+		}
+
+		loops_.push_back(std::move(loopPtr));
+	}
+
+	for (auto& loopPtr : loops_)
+		threads_.create_thread(boost::bind(&NetReactor::Run, this, boost::ref(*loopPtr)));
+}
+
+std::shared_ptr<NetConnection> NetReactor::Connect(string const& host, uint16_t port,
+	AVIOInterruptCB const& interrupt)
+{
+	addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_protocol = IPPROTO_TCP;
+
+	addrinfo *addressesPtr = nullptr;
+	if (::getaddrinfo(host.c_str(), to_string(port).c_str(), &hints, &addressesPtr) != 0)
+		throw runtime_error("getaddrinfo() failed");
+
+	SOCKET socket = INVALID_SOCKET;
+
+	try
+	{
+		for (addrinfo *addressPtr = addressesPtr; addressPtr != nullptr; addressPtr = addressPtr->ai_next)
+		{
+			socket = ::socket(addressPtr->ai_family, addressPtr->ai_socktype, addressPtr->ai_protocol);
+			if (socket == INVALID_SOCKET)
+				continue;
+
+			u_long nonBlocking = 1;
+			::ioctlsocket(socket, FIONBIO, &nonBlocking);
+
+			if (::connect(socket, addressPtr->ai_addr, static_cast<int>(addressPtr->ai_addrlen)) == SOCKET_ERROR &&
+				::WSAGetLastError() != WSAEWOULDBLOCK)
+			{
+				::closesocket(socket);
+				socket = INVALID_SOCKET;
+				continue;
+			}
+
+			WaitForSocket(socket, POLLWRNORM, interrupt);
+
+			int error = 0;
+			int errorSize = sizeof(error);
+			::getsockopt(socket, SOL_SOCKET, SO_ERROR, reinterpret_cast<char *>(&error), &errorSize);
+
+			if (error == 0)
+				break;
+
+			::closesocket(socket);
+			socket = INVALID_SOCKET;
+		}
+	}
+	catch (runtime_error&)
+	{
+		if (socket != INVALID_SOCKET)
+			::closesocket(socket);
+
+		::freeaddrinfo(addressesPtr);
+		throw;
+	}
+
+	::freeaddrinfo(addressesPtr);
+
+	if (socket == INVALID_SOCKET)
+		throw runtime_error("connect() failed");
+
+	return std::make_shared<NetConnection>(socket);
+}
+
+void NetReactor::Add(std::shared_ptr<NetConnection> const& connectionPtr)
+{
+	if (loops_.empty())
+		throw runtime_error("the reactor is not started");
+
+	// The counts may change right after they are read, a rough balance is enough.
+	Loop *loopPtr = nullptr;
+	size_t connectionCount = 0;
+
+	for (auto& candidatePtr : loops_)
+	{
+		boost::unique_lock<boost::mutex> lock(candidatePtr->mutex);
+
+		if (loopPtr == nullptr || candidatePtr->connections.size() < connectionCount)
+		{
+			loopPtr = candidatePtr.get();
+			connectionCount = candidatePtr->connections.size();
+		}
+	}
+
+	connectionPtr->wake_ = [loopPtr]() { Wake(*loopPtr); };
+
+	{
+		boost::unique_lock<boost::mutex> lock(loopPtr->mutex);
+		loopPtr->connections.push_back(connectionPtr);
+	}
+
+	Wake(*loopPtr);
+}
+
+void NetReactor::Remove(std::shared_ptr<NetConnection> const& connectionPtr)
+{
+	for (auto& loopPtr : loops_)
+	{
+		boost::unique_lock<boost::mutex> lock(loopPtr->mutex);
+
+		auto position = find(loopPtr->connections.begin(), loopPtr->connections.end(), connectionPtr);
+		if (position != loopPtr->connections.end())
+		{
+			loopPtr->connections.erase(position);
+			lock.unlock();
+
+			// The thread may be polling the socket, it lets it go on its next round.
+			Wake(*loopPtr);
+			return;
+		}
+	}
+}
+
+void NetReactor::Run(Loop &loop)
+{
+	std::vector<std::shared_ptr<NetConnection>> connections;
+	std::vector<WSAPOLLFD> pollFds;
+
+	while (!stopRequested_)
+	{
+		{
+			boost::unique_lock<boost::mutex> lock(loop.mutex);
+			connections = loop.connections;
+		}
+
+		pollFds.clear();
+		pollFds.push_back(WSAPOLLFD{ loop.wakeSocket, POLLRDNORM, 0 });
+
+		std::vector<NetConnection *> polledConnections;
+		for (auto& connectionPtr : connections)
+		{
+			boost::unique_lock<boost::mutex> lock(connectionPtr->mutex_);
+			if (connectionPtr->ended_ || !connectionPtr->WantsInput())
+				continue;
+
+			pollFds.push_back(WSAPOLLFD{ connectionPtr->socket_, POLLRDNORM, 0 });
+			polledConnections.push_back(connectionPtr.get());
+		}
+
+		const int result = ::WSAPoll(pollFds.data(), static_cast<ULONG>(pollFds.size()), 1000);
+		if (result <= 0)
+			continue;
+
+		if (pollFds[0].revents != 0)
+		{
+			// A wake up left in the socket only makes the next poll return at once.
+			char wakeByte;
+			::recvfrom(loop.wakeSocket, &wakeByte, 1, 0, nullptr, nullptr);
+		}
+
+		for (size_t i = 1; i < pollFds.size(); ++i)
+		{
+			if ((pollFds[i].revents & (POLLRDNORM | POLLHUP | POLLERR)) != 0)
+				polledConnections[i - 1]->Receive();
+		}
+
+		// The connections the readers released are closed here, after the poll.
+		connections.clear();
+	}
+}
+
+void NetReactor::Wake(Loop &loop)
+{
+	const char wakeByte = 0;
+	::sendto(loop.wakeSocket, &wakeByte, 1, 0,
+		reinterpret_cast<sockaddr const *>(&loop.wakeAddress), sizeof(loop.wakeAddress));
+}
+
+void NetReactor::Shutdown()
+{
+	if (!winsockStarted_)
+		return;
+
+	stopRequested_ = true;
+
+	for (auto& loopPtr : loops_)
+	{
+		if (loopPtr->wakeSocket != INVALID_SOCKET)
+			Wake(*loopPtr);
+	}
+
+	threads_.join_all();
+
+	for (auto& loopPtr : loops_)
+	{
+		if (loopPtr->wakeSocket != INVALID_SOCKET)
+			::closesocket(loopPtr->wakeSocket);
+	}
+
+	loops_.clear();
+
+	winsockStarted_ = false;
+	::WSACleanup();
+}
+
+NetReactor::~NetReactor()
+{
+	Shutdown();
+}
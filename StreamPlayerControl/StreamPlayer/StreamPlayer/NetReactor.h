@@ -0,0 +1,163 @@
+#ifndef FFMPEG_FACADE_NETREACTOR_H
+#define FFMPEG_FACADE_NETREACTOR_H
+
+#include <cstdint>
+#include <string>
+#include <memory>
+#include <vector>
+#include <functional>
+#include <boost/noncopyable.hpp>
+
+#pragma warning( push )
+#pragma warning( disable : 4100 )
+
+#include <boost/thread.hpp>
+
+#pragma warning( pop )
+
+#include <boost/atomic.hpp>
+
+#include <winsock2.h>
+
+#include "inputsource.h"
+
+namespace FFmpeg
+{
+	namespace Facade
+	{
+		class NetReactor;
+
+		/// <summary>
+		/// A NetConnection class is a TCP connection whose socket is read by a reactor thread
+		/// into a buffer, the reader takes the bytes from the buffer.
+		/// </summary>
+		class NetConnection : private boost::noncopyable
+		{
+		public:
+			/// <summary>
+			/// Initializes a new instance of the NetConnection class over a connected non-blocking socket.
+			/// </summary>
+			explicit NetConnection(SOCKET socket);
+
+			/// <summary>
+			/// Sends bytes on the calling thread, before the connection is added to a reactor.
+			/// </summary>
+			void Send(std::string const& data, AVIOInterruptCB const& interrupt);
+
+			/// <summary>
+			/// Reads buffered bytes, blocking until at least one is available.
+			/// </summary>
+			/// <returns>The number of bytes read, AVERROR_EOF once the peer closed or a negative AVERROR code.</returns>
+			int32_t Read(uint8_t *bufferPtr, int32_t size, AVIOInterruptCB const& interrupt);
+
+			/// <summary>
+			/// Gets the number of buffered bytes.
+			/// </summary>
+			size_t Available() const;
+
+			/// <summary>
+			/// Gets whether the peer closed the connection or it failed.
+			/// </summary>
+			bool Ended() const;
+
+			/// <summary>
+			/// Closes the socket.
+			/// </summary>
+			~NetConnection();
+
+		private:
+			friend class NetReactor;
+
+			// Called by the reactor thread when the socket is readable.
+			void Receive();
+
+			// Whether the buffer has room, a full buffer is not read and TCP slows the sender down.
+			bool WantsInput() const;
+
+			const SOCKET socket_;
+
+			mutable boost::mutex mutex_;
+			boost::condition_variable dataCondition_;
+			std::vector<uint8_t> buffer_;
+			size_t readPosition_;
+			bool ended_;
+			bool failed_;
+
+			// Wakes the reactor thread up once a full buffer has room again, set by the reactor.
+			std::function<void()> wake_;
+		};
+
+		/// <summary>
+		/// A NetReactor class reads the sockets of many streams on a few threads, each thread
+		/// waits on all its sockets at once with WSAPoll.
+		/// </summary>
+		class NetReactor : private boost::noncopyable
+		{
+		public:
+			/// <summary>
+			/// Initializes a new instance of the NetReactor class, no thread is started.
+			/// </summary>
+			NetReactor();
+
+			/// <summary>
+			/// Starts the threads if they are not running.
+			/// </summary>
+			/// <param name="threadCount">The number of threads, zero for one per four cores.</param>
+			void Start(uint32_t threadCount);
+
+			/// <summary>
+			/// Connects to a server on the calling thread.
+			/// </summary>
+			/// <param name="host">The host name or address.</param>
+			/// <param name="port">The TCP port.</param>
+			/// <param name="interrupt">Polled while connecting, the connection is abandoned when it returns non-zero.</param>
+			/// <returns>The connection, not yet read by the reactor.</returns>
+			std::shared_ptr<NetConnection> Connect(std::string const& host, uint16_t port,
+				AVIOInterruptCB const& interrupt);
+
+			/// <summary>
+			/// Starts reading a connection on the least loaded thread.
+			/// </summary>
+			void Add(std::shared_ptr<NetConnection> const& connectionPtr);
+
+			/// <summary>
+			/// Stops reading a connection.
+			/// </summary>
+			void Remove(std::shared_ptr<NetConnection> const& connectionPtr);
+
+			/// <summary>
+			/// Stops the threads.
+			/// </summary>
+			void Shutdown();
+
+			/// <summary>
+			/// Releases all resources used by the reactor.
+			/// </summary>
+			~NetReactor();
+
+		private:
+			struct Loop
+			{
+				Loop() : wakeSocket(INVALID_SOCKET) {}
+
+				boost::mutex mutex;
+				std::vector<std::shared_ptr<NetConnection>> connections;
+				// A loopback datagram to this socket interrupts WSAPoll.
+				SOCKET wakeSocket;
+				sockaddr_in wakeAddress;
+			};
+
+			void Run(Loop &loop);
+
+			static void Wake(Loop &loop);
+
+			std::vector<std::unique_ptr<Loop>> loops_;
+			boost::thread_group threads_;
+			boost::atomic<bool> stopRequested_;
+			// Set between WSAStartup and WSACleanup, a failed Start may leave no loops behind.
+			bool winsockStarted_;
+		};
+	}
+}
+
+#endif // FFMPEG_FACADE_NETREACTOR_H
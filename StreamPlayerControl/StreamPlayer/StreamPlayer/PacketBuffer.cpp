@@ -0,0 +1,164 @@
+#include "packetbuffer.h"
+#include <stdexcept>
+#include <vector>
+#include <boost/thread/locks.hpp>
+
+#include "muxer.h"
+
+using namespace std;
+using namespace boost;
+using namespace FFmpeg;
+using namespace FFmpeg::Facade;
+
+PacketBuffer::PacketBuffer()
+	: bytes_(0), maxDurationInMilliseconds_(0), maxBytes_(0),
+	codecCtxPtr_(nullptr), timeBase_(AVRational{ 1, 1 }) {}
+
+void PacketBuffer::SetLimits(uint32_t durationInMilliseconds, uint32_t maxBytes)
+{
+	boost::unique_lock<boost::mutex> lock(mutex_);
+
+	maxDurationInMilliseconds_ = durationInMilliseconds;
+	maxBytes_ = maxBytes;
+
+	if (maxDurationInMilliseconds_ == 0)
+		ClearUnlocked();
+}
+
+void PacketBuffer::StreamOpened(AVStream const *streamPtr)
+{
+	boost::unique_lock<boost::mutex> lock(mutex_);
+
+	ClearUnlocked();
+
+	if (codecCtxPtr_ == nullptr)
+		codecCtxPtr_ = avcodec_alloc_context3(nullptr);
+
+	if (codecCtxPtr_ == nullptr || avcodec_copy_context(codecCtxPtr_, streamPtr->codec) < 0)
+		throw runtime_error("avcodec_copy_context() failed");
+
+	timeBase_ = streamPtr->time_base;
+}
+
+void PacketBuffer::PacketReceived(AVPacket const &packet)
+{
+	boost::unique_lock<boost::mutex> lock(mutex_);
+
+	if (maxDurationInMilliseconds_ == 0)
+		return;
+
+	const bool keyframe = (packet.flags & AV_PKT_FLAG_KEY) != 0;
+	if (entries_.empty() && !keyframe)
+	{
+		// Nothing can be decoded until the first keyframe.
+		return;
+	}
+
+	Entry entry;
+	av_init_packet(&entry.packet);
+	if (av_copy_packet(&entry.packet, &packet) < 0)
+		return;
+
+	entry.received = Clock::now();
+	entries_.push_back(entry);
+	bytes_ += packet.size;
+
+	if (keyframe)
+		keyframeTimes_.push_back(entry.received);
+
+	// A GOP is dropped only if the remaining ones still cover the requested duration,
+	// the most recent GOP is always kept.
+	const auto maxDuration = boost::chrono::milliseconds(maxDurationInMilliseconds_);
+	while (keyframeTimes_.size() > 1 &&
+		((maxBytes_ > 0 && bytes_ > maxBytes_) || entry.received - keyframeTimes_[1] >= maxDuration))
+	{
+		DropOldestGop();
+	}
+}
+
+void PacketBuffer::ExportClip(string const& fileName)
+{
+	vector<AVPacket> packets;
+	AVCodecContext *codecCtxPtr = nullptr;
+	AVRational timeBase;
+
+	{
+		boost::unique_lock<boost::mutex> lock(mutex_);
+
+		if (entries_.empty())
+			throw runtime_error("no packets");
+
+		// Copy the packets out so that the decoding thread is not blocked by the disk.
+		codecCtxPtr = avcodec_alloc_context3(nullptr);
+		if (codecCtxPtr == nullptr || avcodec_copy_context(codecCtxPtr, codecCtxPtr_) < 0)
+		{
+			avcodec_free_context(&codecCtxPtr);
+			throw runtime_error("avcodec_copy_context() failed");
+		}
+
+		timeBase = timeBase_;
+
+		packets.reserve(entries_.size());
+		for (auto const& entry : entries_)
+		{
+			AVPacket packet;
+			av_init_packet(&packet);
+			if (av_copy_packet(&packet, &entry.packet) < 0)
+				break;
+
+			packets.push_back(packet);
+		}
+	}
+
+	try
+	{
+		Muxer muxer(fileName, codecCtxPtr, timeBase);
+		for (auto const& packet : packets)
+			muxer.WritePacket(packet);
+	}
+	catch (runtime_error&)
+	{
+		for (auto& packet : packets)
+			av_free_packet(&packet);
+		avcodec_free_context(&codecCtxPtr);
+		throw;
+	}
+
+	for (auto& packet : packets)
+		av_free_packet(&packet);
+	avcodec_free_context(&codecCtxPtr);
+}
+
+void PacketBuffer::Clear()
+{
+	boost::unique_lock<boost::mutex> lock(mutex_);
+	ClearUnlocked();
+}
+
+void PacketBuffer::ClearUnlocked()
+{
+	for (auto& entry : entries_)
+		av_free_packet(&entry.packet);
+
+	entries_.clear();
+	keyframeTimes_.clear();
+	bytes_ = 0;
+}
+
+void PacketBuffer::DropOldestGop()
+{
+	do
+	{
+		bytes_ -= entries_.front().packet.size;
+		av_free_packet(&entries_.front().packet);
+		entries_.pop_front();
+	} while (!entries_.empty() && !(entries_.front().packet.flags & AV_PKT_FLAG_KEY));
+
+	keyframeTimes_.pop_front();
+}
+
+PacketBuffer::~PacketBuffer()
+{
+	ClearUnlocked();
+	avcodec_free_context(&codecCtxPtr_);
+}
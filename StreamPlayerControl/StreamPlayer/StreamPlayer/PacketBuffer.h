@@ -0,0 +1,91 @@
+#ifndef FFMPEG_FACADE_PACKETBUFFER_H
+#define FFMPEG_FACADE_PACKETBUFFER_H
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <boost/noncopyable.hpp>
+#include <boost/chrono.hpp>
+
+#pragma warning( push )
+#pragma warning( disable : 4100 )
+
+#include <boost/thread/mutex.hpp>
+
+#pragma warning( pop )
+
+#include "packetsink.h"
+
+namespace FFmpeg
+{
+	namespace Facade
+	{
+		/// <summary>
+		/// A PacketBuffer class keeps the most recent compressed packets of a stream,
+		/// bounded by duration and size, so that the moments before an event can be saved.
+		/// The buffered packets always start at a keyframe.
+		/// </summary>
+		class PacketBuffer : public PacketSink, private boost::noncopyable
+		{
+		public:
+			/// <summary>
+			/// Initializes a new instance of the PacketBuffer class. The buffer is disabled until limits are set.
+			/// </summary>
+			PacketBuffer();
+
+			/// <summary>
+			/// Sets the buffer limits. The oldest GOP is dropped once either limit is exceeded.
+			/// </summary>
+			/// <param name="durationInMilliseconds">The duration to keep, zero disables the buffer.</param>
+			/// <param name="maxBytes">The maximum size of the buffered packets, in bytes, zero for no size limit.</param>
+			void SetLimits(uint32_t durationInMilliseconds, uint32_t maxBytes);
+
+			virtual void StreamOpened(AVStream const *streamPtr) override;
+
+			virtual void PacketReceived(AVPacket const &packet) override;
+
+			/// <summary>
+			/// Writes the buffered packets to a file without re-encoding.
+			/// </summary>
+			/// <param name="fileName">The file to write, the container format is guessed from its extension.</param>
+			void ExportClip(std::string const& fileName);
+
+			/// <summary>
+			/// Discards all the buffered packets.
+			/// </summary>
+			void Clear();
+
+			/// <summary>
+			/// Releases all resources used by the buffer.
+			/// </summary>
+			~PacketBuffer();
+
+		private:
+			typedef boost::chrono::steady_clock Clock;
+
+			struct Entry
+			{
+				AVPacket packet;
+				Clock::time_point received;
+			};
+
+			void ClearUnlocked();
+
+			void DropOldestGop();
+
+			boost::mutex mutex_;
+			std::deque<Entry> entries_;
+			// Arrival times of the buffered keyframes, one per GOP.
+			std::deque<Clock::time_point> keyframeTimes_;
+			size_t bytes_;
+
+			uint32_t maxDurationInMilliseconds_;
+			uint32_t maxBytes_;
+
+			AVCodecContext *codecCtxPtr_;
+			AVRational timeBase_;
+		};
+	}
+}
+
+#endif // FFMPEG_FACADE_PACKETBUFFER_H
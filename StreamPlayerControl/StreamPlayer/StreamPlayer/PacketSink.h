@@ -0,0 +1,51 @@
+#ifndef FFMPEG_FACADE_PACKETSINK_H
+#define FFMPEG_FACADE_PACKETSINK_H
+
+#include <deque>
+
+namespace FFmpeg
+{
+
+#pragma warning( push )
+#pragma warning( disable : 4244 )
+
+	extern "C"
+	{
+#include <libavformat/avformat.h>
+	}
+
+#pragma warning( pop )
+
+	namespace Facade
+	{
+		/// <summary>
+		/// A PacketSink interface receives the compressed packets of a video stream as they are demuxed.
+		/// </summary>
+		class PacketSink
+		{
+		public:
+			/// <summary>
+			/// Called once the stream is opened, before any of its packets is delivered.
+			/// </summary>
+			/// <param name="streamPtr">The video stream the packets belong to.</param>
+			virtual void StreamOpened(AVStream const *streamPtr) = 0;
+
+			/// <summary>
+			/// Called on the decoding thread for every packet of the video stream.
+			/// </summary>
+			/// <param name="packet">The packet, its timestamps are in the stream time base.</param>
+			virtual void PacketReceived(AVPacket const &packet) = 0;
+
+			/// <summary>
+			/// Called on the decoding thread with the cached packets of the group of pictures in progress,
+			/// for a sink that asked a GopCache for them, before the next packet.
+			/// </summary>
+			/// <param name="packets">The packets from the keyframe on, empty if no group is cached.</param>
+			virtual void GopReceived(std::deque<AVPacket> const & /*packets*/) {}
+
+			virtual ~PacketSink() {}
+		};
+	}
+}
+
+#endif // FFMPEG_FACADE_PACKETSINK_H
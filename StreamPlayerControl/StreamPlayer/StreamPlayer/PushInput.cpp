@@ -0,0 +1,157 @@
+#include "pushinput.h"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+using namespace std;
+using namespace FFmpeg;
+using namespace FFmpeg::Facade;
+
+namespace
+{
+	// How often a waiting read polls its interrupt callback.
+	const int32_t PollIntervalInMilliseconds = 50;
+
+	AVInputFormat *FindFormat(string const& formatName)
+	{
+		if (formatName.empty())
+			return nullptr;
+
+		AVInputFormat *formatPtr = av_find_input_format(formatName.c_str());
+		if (formatPtr == nullptr)
+			throw runtime_error("unknown input format " + formatName);
+
+		return formatPtr;
+	}
+}
+
+PushInput::PushInput(uint32_t capacity, string const& formatName)
+	: queue_(capacity), availableBytes_(0), ended_(false), formatPtr_(FindFormat(formatName)),
+	currentOffset_(0), hasCurrent_(false), readerWaiting_(false) {}
+
+bool PushInput::Push(uint8_t const *dataPtr, int32_t size, BufferReleasedCallback released, void *context)
+{
+	if (ended_ || size <= 0)
+		return false;
+
+	const Buffer buffer = { dataPtr, size, released, context };
+	if (!queue_.push(buffer))
+		return false;
+
+	availableBytes_ += size;
+
+	if (readerWaiting_)
+	{
+		boost::unique_lock<boost::mutex> lock(mutex_);
+		dataCondition_.notify_one();
+	}
+
+	return true;
+}
+
+void PushInput::End()
+{
+	ended_ = true;
+
+	boost::unique_lock<boost::mutex> lock(mutex_);
+	dataCondition_.notify_one();
+}
+
+int32_t PushInput::Read(uint8_t *bufferPtr, int32_t size, AVIOInterruptCB const& interrupt)
+{
+	while (!hasCurrent_)
+	{
+		if (queue_.pop(current_))
+		{
+			hasCurrent_ = true;
+			currentOffset_ = 0;
+			break;
+		}
+
+		// The last buffers are pushed before the end, so the queue is checked once more.
+		if (ended_)
+		{
+			if (queue_.pop(current_))
+				continue;
+
+			return AVERROR_EOF;
+		}
+
+		if (interrupt.callback != nullptr && interrupt.callback(interrupt.opaque) != 0)
+			return AVERROR_EXIT;
+
+		boost::unique_lock<boost::mutex> lock(mutex_);
+		readerWaiting_ = true;
+
+		if (queue_.read_available() == 0 && !ended_)
+			dataCondition_.wait_for(lock, boost::chrono::milliseconds(PollIntervalInMilliseconds));
+
+		readerWaiting_ = false;
+	}
+
+	// The one copy, into the demuxer buffer.
+	const int32_t count = min(size, current_.size - currentOffset_);
+	memcpy(bufferPtr, current_.dataPtr + currentOffset_, count);
+	currentOffset_ += count;
+	availableBytes_ -= count;
+
+	if (currentOffset_ == current_.size)
+	{
+		Release(current_);
+		hasCurrent_ = false;
+	}
+
+	return count;
+}
+
+size_t PushInput::Available() const
+{
+	return static_cast<size_t>(availableBytes_);
+}
+
+bool PushInput::Ended() const
+{
+	return ended_;
+}
+
+void PushInput::Release(Buffer const& buffer)
+{
+	if (buffer.released != nullptr)
+		buffer.released(buffer.context, buffer.dataPtr);
+}
+
+PushInput::~PushInput()
+{
+	if (hasCurrent_)
+		Release(current_);
+
+	Buffer buffer;
+	while (queue_.pop(buffer))
+		Release(buffer);
+}
+
+CallbackInput::CallbackInput(ReadCallback read, void *context, string const& formatName)
+	: read_(read), context_(context), formatPtr_(FindFormat(formatName)), ended_(false)
+{
+	if (read_ == nullptr)
+		throw runtime_error("no read callback");
+}
+
+int32_t CallbackInput::Read(uint8_t *bufferPtr, int32_t size, AVIOInterruptCB const& interrupt)
+{
+	if (interrupt.callback != nullptr && interrupt.callback(interrupt.opaque) != 0)
+		return AVERROR_EXIT;
+
+	const int32_t result = read_(context_, bufferPtr, size);
+	if (result > 0)
+		return result;
+
+	ended_ = true;
+	return result == 0 ? AVERROR_EOF : AVERROR(EIO);
+}
+
+size_t CallbackInput::Available() const
+{
+	return numeric_limits<size_t>::max();
+}
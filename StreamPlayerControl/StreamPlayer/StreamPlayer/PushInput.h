@@ -0,0 +1,135 @@
+#ifndef FFMPEG_FACADE_PUSHINPUT_H
+#define FFMPEG_FACADE_PUSHINPUT_H
+
+#include <cstdint>
+#include <string>
+#include <boost/noncopyable.hpp>
+
+#pragma warning( push )
+#pragma warning( disable : 4100 )
+
+#include <boost/thread.hpp>
+
+#pragma warning( pop )
+
+#include <boost/atomic.hpp>
+#include <boost/lockfree/spsc_queue.hpp>
+
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+
+#include "inputsource.h"
+
+namespace FFmpeg
+{
+	namespace Facade
+	{
+		typedef void(__stdcall *BufferReleasedCallback)(void *context, uint8_t const *dataPtr);
+		typedef int32_t(__stdcall *ReadCallback)(void *context, uint8_t *bufferPtr, int32_t size);
+
+		/// <summary>
+		/// A PushInput class is a stream whose bytes an application pushes as buffers it owns.
+		/// The buffers are queued as they are, with no copy, and released once the demuxer read them.
+		/// </summary>
+		class PushInput : public InputSource, private boost::noncopyable
+		{
+		public:
+			/// <summary>
+			/// Initializes a new instance of the PushInput class.
+			/// </summary>
+			/// <param name="capacity">The number of buffers the queue holds.</param>
+			/// <param name="formatName">The demuxer name, e.g. h264 or mpegts, empty to probe the stream.</param>
+			PushInput(uint32_t capacity, std::string const& formatName);
+
+			/// <summary>
+			/// Queues a buffer, called by a single producer thread. Lock-free and never blocks.
+			/// </summary>
+			/// <param name="dataPtr">The bytes, they should stay valid until released.</param>
+			/// <param name="size">The number of bytes.</param>
+			/// <param name="released">Called on the decoding thread once the buffer is read, or nullptr.</param>
+			/// <param name="context">Passed to the released callback.</param>
+			/// <returns>false if the queue is full or the input ended, the buffer is then not taken.</returns>
+			bool Push(uint8_t const *dataPtr, int32_t size, BufferReleasedCallback released, void *context);
+
+			/// <summary>
+			/// Ends the input, the stream stops once the queued buffers are read.
+			/// </summary>
+			void End();
+
+			virtual int32_t Read(uint8_t *bufferPtr, int32_t size, AVIOInterruptCB const& interrupt) override;
+
+			virtual size_t Available() const override;
+
+			virtual bool Ended() const override;
+
+			virtual AVInputFormat *Format() const override { return formatPtr_; }
+
+			/// <summary>
+			/// Releases the buffers left.
+			/// </summary>
+			virtual ~PushInput();
+
+		private:
+			struct Buffer
+			{
+				uint8_t const *dataPtr;
+				int32_t size;
+				BufferReleasedCallback released;
+				void *context;
+			};
+
+			static void Release(Buffer const& buffer);
+
+			boost::lockfree::spsc_queue<Buffer> queue_;
+			boost::atomic<int64_t> availableBytes_;
+			boost::atomic<bool> ended_;
+			AVInputFormat *formatPtr_;
+
+			// The buffer being read, owned by the consumer.
+			Buffer current_;
+			int32_t currentOffset_;
+			bool hasCurrent_;
+
+			// The consumer sleeps only while the queue is empty, the producer takes the mutex only to wake it.
+			boost::atomic<bool> readerWaiting_;
+			boost::mutex mutex_;
+			boost::condition_variable dataCondition_;
+		};
+
+		/// <summary>
+		/// A CallbackInput class is a stream the demuxer pulls from an application callback,
+		/// which writes straight into the demuxer buffer.
+		/// </summary>
+		class CallbackInput : public InputSource, private boost::noncopyable
+		{
+		public:
+			/// <summary>
+			/// Initializes a new instance of the CallbackInput class.
+			/// </summary>
+			/// <param name="read">Fills a buffer and returns the number of bytes, zero at the end of the stream
+			/// and a negative value on error. Called on the decoding thread, it may block.</param>
+			/// <param name="context">Passed to the callback.</param>
+			/// <param name="formatName">The demuxer name, empty to probe the stream.</param>
+			CallbackInput(ReadCallback read, void *context, std::string const& formatName);
+
+			virtual int32_t Read(uint8_t *bufferPtr, int32_t size, AVIOInterruptCB const& interrupt) override;
+
+			/// <summary>
+			/// Unknown, so the next read counts as ready.
+			/// </summary>
+			virtual size_t Available() const override;
+
+			virtual bool Ended() const override { return ended_; }
+
+			virtual AVInputFormat *Format() const override { return formatPtr_; }
+
+		private:
+			const ReadCallback read_;
+			void *const context_;
+			AVInputFormat *formatPtr_;
+			bool ended_;
+		};
+	}
+}
+
+#endif // FFMPEG_FACADE_PUSHINPUT_H
@@ -0,0 +1,278 @@
+#include "recorder.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <stdexcept>
+#include <boost/chrono.hpp>
+
+#include "muxer.h"
+
+using namespace std;
+using namespace FFmpeg;
+using namespace FFmpeg::Facade;
+
+Recorder::StreamInfo::StreamInfo(AVStream const *streamPtr)
+	: codecCtxPtr(avcodec_alloc_context3(nullptr)), timeBase(streamPtr->time_base)
+{
+	if (codecCtxPtr == nullptr || avcodec_copy_context(codecCtxPtr, streamPtr->codec) < 0)
+	{
+		avcodec_free_context(&codecCtxPtr);
+		throw runtime_error("avcodec_copy_context() failed");
+	}
+}
+
+Recorder::StreamInfo::~StreamInfo()
+{
+	avcodec_free_context(&codecCtxPtr);
+}
+
+Recorder::Recorder()
+	: queuedBytes_(0), recording_(false), waitingForKeyframe_(true), waitingForGop_(false),
+	segmentSeconds_(0), segmentBytes_(0), segmentNum_(0) {}
+
+void Recorder::Start(string const& filePath, uint32_t segmentSeconds, uint64_t segmentBytes,
+	bool fromCachedGop)
+{
+	Stop();
+
+	boost::unique_lock<boost::mutex> lock(mutex_);
+
+	filePath_ = filePath;
+	segmentSeconds_ = segmentSeconds;
+	segmentBytes_ = segmentBytes;
+	segmentNum_ = 0;
+	waitingForKeyframe_ = true;
+	waitingForGop_ = fromCachedGop;
+	recording_ = true;
+
+	writerThread_ = boost::thread(&Recorder::Write, this);
+}
+
+void Recorder::Stop()
+{
+	{
+		boost::unique_lock<boost::mutex> lock(mutex_);
+		recording_ = false;
+		waitingForGop_ = false;
+	}
+
+	queueCondition_.notify_one();
+
+	if (writerThread_.joinable())
+		writerThread_.join();
+}
+
+void Recorder::StreamOpened(AVStream const *streamPtr)
+{
+	auto streamInfoPtr = make_shared<StreamInfo>(streamPtr);
+
+	boost::unique_lock<boost::mutex> lock(mutex_);
+	streamInfoPtr_ = streamInfoPtr;
+	waitingForKeyframe_ = true;
+
+	// A group asked of the previous stream is not coming, this one starts at its first keyframe.
+	waitingForGop_ = false;
+}
+
+void Recorder::PacketReceived(AVPacket const &packet)
+{
+	boost::unique_lock<boost::mutex> lock(mutex_);
+
+	// The packets until the cached group arrives are in it.
+	if (!recording_ || waitingForGop_)
+		return;
+
+	if (!QueuePacket(packet))
+		return;
+
+	lock.unlock();
+	queueCondition_.notify_one();
+}
+
+void Recorder::GopReceived(std::deque<AVPacket> const &packets)
+{
+	boost::unique_lock<boost::mutex> lock(mutex_);
+
+	if (!recording_ || !waitingForGop_)
+		return;
+
+	waitingForGop_ = false;
+
+	// The group starts at a keyframe, without one the recording starts at the next.
+	for (auto const& packet : packets)
+		QueuePacket(packet);
+
+	lock.unlock();
+	queueCondition_.notify_one();
+}
+
+bool Recorder::QueuePacket(AVPacket const &packet)
+{
+	if (waitingForKeyframe_)
+	{
+		if (!(packet.flags & AV_PKT_FLAG_KEY))
+			return false;
+
+		waitingForKeyframe_ = false;
+	}
+
+	if (queuedBytes_ + packet.size > MaxQueuedBytes)
+	{
+		// The disk cannot keep up, skip the rest of the GOP rather than block the decoder.
+		waitingForKeyframe_ = true;
+		return false;
+	}
+
+	QueuedPacket queuedPacket;
+	av_init_packet(&queuedPacket.packet);
+	if (av_copy_packet(&queuedPacket.packet, &packet) < 0)
+	{
+		waitingForKeyframe_ = true;
+		return false;
+	}
+
+	queuedPacket.wallClockMs = boost::chrono::duration_cast<boost::chrono::milliseconds>(
+		boost::chrono::system_clock::now().time_since_epoch()).count();
+	queuedPacket.streamInfoPtr = streamInfoPtr_;
+	queue_.push_back(queuedPacket);
+	queuedBytes_ += packet.size;
+
+	return true;
+}
+
+void Recorder::Write()
+{
+	for (;;)
+	{
+		QueuedPacket queuedPacket;
+
+		{
+			boost::unique_lock<boost::mutex> lock(mutex_);
+
+			while (queue_.empty() && recording_)
+				queueCondition_.wait(lock);
+
+			if (queue_.empty())
+			{
+				// Stopped and everything queued is written.
+				break;
+			}
+
+			queuedPacket = queue_.front();
+			queue_.pop_front();
+			queuedBytes_ -= queuedPacket.packet.size;
+		}
+
+		try
+		{
+			// Segments are switched at keyframes only, so every segment is playable on its own.
+			if (queuedPacket.packet.flags & AV_PKT_FLAG_KEY)
+			{
+				if (muxerPtr_ != nullptr &&
+					(queuedPacket.streamInfoPtr != muxerStreamInfoPtr_ ||
+					(segmentSeconds_ > 0 && muxerPtr_->DurationInMilliseconds() >= segmentSeconds_ * 1000LL) ||
+					(segmentBytes_ > 0 && static_cast<uint64_t>(muxerPtr_->BytesWritten()) >= segmentBytes_)))
+				{
+					CloseSegment();
+				}
+
+				if (muxerPtr_ == nullptr)
+					OpenSegment(queuedPacket.streamInfoPtr, queuedPacket.wallClockMs);
+			}
+
+			if (muxerPtr_ != nullptr)
+			{
+				PacketWriting(queuedPacket.packet, queuedPacket.wallClockMs, *muxerPtr_);
+				muxerPtr_->WritePacket(queuedPacket.packet);
+			}
+		}
+		catch (runtime_error&)
+		{
+			// The segment is abandoned, the next one starts at the next keyframe.
+			CloseSegment();
+		}
+
+		av_free_packet(&queuedPacket.packet);
+	}
+
+	CloseSegment();
+}
+
+void Recorder::OpenSegment(shared_ptr<StreamInfo> const& streamInfoPtr, int64_t wallClockMs)
+{
+	muxerPtr_ = CreateSegment(streamInfoPtr->codecCtxPtr, streamInfoPtr->timeBase, wallClockMs);
+	muxerStreamInfoPtr_ = streamInfoPtr;
+}
+
+void Recorder::CloseSegment()
+{
+	if (muxerPtr_ == nullptr)
+		return;
+
+	muxerPtr_.reset();
+	muxerStreamInfoPtr_.reset();
+
+	SegmentClosed();
+}
+
+unique_ptr<Muxer> Recorder::CreateSegment(AVCodecContext const *codecCtxPtr,
+	AVRational timeBase, int64_t /*wallClockMs*/)
+{
+	const string fileName = SegmentFileName(++segmentNum_);
+
+	string extension = fileName.substr(fileName.find_last_of('.') + 1);
+	transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+	AVDictionary *formatOpts = nullptr;
+	if (extension == "mp4" || extension == "mov")
+	{
+		// Fragmented output has no index to write at the end, a crash loses the last fragment only.
+		av_dict_set(&formatOpts, "movflags", "frag_keyframe+empty_moov+default_base_moof", 0);
+	}
+
+	unique_ptr<Muxer> muxerPtr;
+	try
+	{
+		muxerPtr = make_unique<Muxer>(fileName, codecCtxPtr, timeBase, formatOpts);
+	}
+	catch (runtime_error&)
+	{
+		av_dict_free(&formatOpts);
+		throw;
+	}
+
+	av_dict_free(&formatOpts);
+	return muxerPtr;
+}
+
+string Recorder::SegmentFileName(uint32_t segmentNum) const
+{
+	char suffix[16];
+	sprintf_s(suffix, "_%05u", segmentNum);
+
+	const size_t separatorPos = filePath_.find_last_of("\\/");
+	const size_t extensionPos = filePath_.find_last_of('.');
+
+	if (extensionPos == string::npos ||
+		(separatorPos != string::npos && extensionPos < separatorPos))
+	{
+		return filePath_ + suffix + ".mkv";
+	}
+
+	return filePath_.substr(0, extensionPos) + suffix + filePath_.substr(extensionPos);
+}
+
+void Recorder::ClearQueue()
+{
+	for (auto& queuedPacket : queue_)
+		av_free_packet(&queuedPacket.packet);
+
+	queue_.clear();
+	queuedBytes_ = 0;
+}
+
+Recorder::~Recorder()
+{
+	Stop();
+	ClearQueue();
+}
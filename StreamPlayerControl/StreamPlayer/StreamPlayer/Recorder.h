@@ -0,0 +1,147 @@
+#ifndef FFMPEG_FACADE_RECORDER_H
+#define FFMPEG_FACADE_RECORDER_H
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <boost/noncopyable.hpp>
+
+#pragma warning( push )
+#pragma warning( disable : 4100 )
+
+#include <boost/thread.hpp>
+
+#pragma warning( pop )
+
+#include "packetsink.h"
+
+namespace FFmpeg
+{
+	namespace Facade
+	{
+		class Muxer;
+
+		/// <summary>
+		/// A Recorder class remuxes the packets of a stream to segmented files without re-encoding.
+		/// Packets are written on a dedicated thread, so disk latency never stalls decoding.
+		/// </summary>
+		class Recorder : public PacketSink, private boost::noncopyable
+		{
+		public:
+			/// <summary>
+			/// Initializes a new instance of the Recorder class.
+			/// </summary>
+			Recorder();
+
+			/// <summary>
+			/// Starts recording at the next keyframe, or from the group of pictures in progress.
+			/// </summary>
+			/// <param name="filePath">The output file path, segments get a sequence number appended to the name.
+			/// MP4 and MOV files are written fragmented, so they stay playable if the process dies.</param>
+			/// <param name="segmentSeconds">The segment duration limit, zero for no limit.</param>
+			/// <param name="segmentBytes">The segment size limit, zero for no limit.</param>
+			/// <param name="fromCachedGop">Whether to start from the packets the recorder asked a GopCache for.
+			/// They replace the packets received until then, which the cache holds as well.</param>
+			void Start(std::string const& filePath, uint32_t segmentSeconds, uint64_t segmentBytes,
+				bool fromCachedGop = false);
+
+			/// <summary>
+			/// Writes the queued packets, closes the current segment and stops recording.
+			/// </summary>
+			void Stop();
+
+			virtual void StreamOpened(AVStream const *streamPtr) override;
+
+			virtual void PacketReceived(AVPacket const &packet) override;
+
+			virtual void GopReceived(std::deque<AVPacket> const &packets) override;
+
+			/// <summary>
+			/// Stops recording and releases all resources used by the recorder.
+			/// </summary>
+			virtual ~Recorder();
+
+		protected:
+			/// <summary>
+			/// Creates the muxer of a new segment, called on the writer thread.
+			/// </summary>
+			/// <param name="codecCtxPtr">The codec context of the stream.</param>
+			/// <param name="timeBase">The time base of the packets.</param>
+			/// <param name="wallClockMs">The arrival time of the segment's first packet, in milliseconds since the Unix epoch.</param>
+			virtual std::unique_ptr<Muxer> CreateSegment(AVCodecContext const *codecCtxPtr,
+				AVRational timeBase, int64_t wallClockMs);
+
+			/// <summary>
+			/// Called on the writer thread before a packet is written to the current segment.
+			/// </summary>
+			virtual void PacketWriting(AVPacket const & /*packet*/, int64_t /*wallClockMs*/, Muxer & /*muxer*/) {}
+
+			/// <summary>
+			/// Called on the writer thread after the current segment is closed.
+			/// </summary>
+			virtual void SegmentClosed() {}
+
+		private:
+			/// <summary>
+			/// The codec parameters the queued packets were demuxed with.
+			/// </summary>
+			struct StreamInfo : private boost::noncopyable
+			{
+				explicit StreamInfo(AVStream const *streamPtr);
+				~StreamInfo();
+
+				AVCodecContext *codecCtxPtr;
+				AVRational timeBase;
+			};
+
+			struct QueuedPacket
+			{
+				AVPacket packet;
+				int64_t wallClockMs;
+				std::shared_ptr<StreamInfo> streamInfoPtr;
+			};
+
+			void Write();
+
+			void OpenSegment(std::shared_ptr<StreamInfo> const& streamInfoPtr, int64_t wallClockMs);
+
+			void CloseSegment();
+
+			std::string SegmentFileName(uint32_t segmentNum) const;
+
+			void ClearQueue();
+
+			/// <summary>
+			/// Queues a packet for the writer thread, called with the lock held.
+			/// </summary>
+			/// <returns>false if the packet is dropped.</returns>
+			bool QueuePacket(AVPacket const &packet);
+
+			// Packets are dropped once the queue grows beyond this size.
+			static const size_t MaxQueuedBytes = 64 * 1024 * 1024;
+
+			boost::mutex mutex_;
+			boost::condition_variable queueCondition_;
+			std::deque<QueuedPacket> queue_;
+			size_t queuedBytes_;
+			bool recording_;
+			bool waitingForKeyframe_;
+			bool waitingForGop_;
+			std::shared_ptr<StreamInfo> streamInfoPtr_;
+
+			std::string filePath_;
+			uint32_t segmentSeconds_;
+			uint64_t segmentBytes_;
+
+			// Accessed by the writer thread only.
+			std::unique_ptr<Muxer> muxerPtr_;
+			std::shared_ptr<StreamInfo> muxerStreamInfoPtr_;
+			uint32_t segmentNum_;
+
+			boost::thread writerThread_;
+		};
+	}
+}
+
+#endif // FFMPEG_FACADE_RECORDER_H
@@ -1,12 +1,24 @@
 #include "streamplayer.h"
 #include <cassert>
+#include <algorithm>
+#include <random>
 
 #include "decoder.h"
+#include "decoderloader.h"
+#include "archivereader.h"
 
 #define WM_INVALIDATE    WM_USER + 1
-#define WM_STREAMSTARTED WM_USER + 2
-#define WM_STREAMSTOPPED WM_USER + 3
-#define WM_STREAMFAILED  WM_USER + 4
+#define WM_PLAYEREVENTS  WM_USER + 2
+
+#define REPAINT_TIMER_ID 0x5350
+
+// How often a scheduled stream checks whether the reactor buffered its next packet.
+#define INPUT_POLL_INTERVAL_MS 5
+#define RECONNECT_POLL_INTERVAL_MS 50
+#define LOSS_WINDOW_MS 2000
+#define LOSSY_WINDOWS 3
+// How long a stopped stream may finish the packet it reads, so that its decoder can be parked.
+#define PARK_TIMEOUT_MS 500
 
 using namespace std;
 using namespace boost;
@@ -16,21 +28,41 @@ using namespace FFmpeg::Facade;
 WNDPROC StreamPlayer::originalWndProc_ = nullptr;
 
 StreamPlayer::StreamPlayer()
-	: stopRequested_(false) {}
+	: stopRequested_(false), stopRequestedPiP_(false), stopDeadline_(Decoder::NoCancelDeadline),
+	stopDeadlinePiP_(Decoder::NoCancelDeadline), motionStartedCallback_(nullptr), motionStoppedCallback_(nullptr),
+	repaintPending_(false), repaintTimerSet_(false), displayInterval_(0), eventsPending_(false), frameOutput_(false),
+	profileWidthThreshold_(640), switchRequested_(false), schedulerEnabled_(false), schedulerWorkerCount_(0),
+	stallTimeoutInMilliseconds_(0), retryDelayInMilliseconds_(500), maxRetryDelayInMilliseconds_(30000), maxReconnectAttempts_(0),
+	decoderPoolEnabled_(false),
+	visible_(true), visiblePiP_(true), minimized_(false), standby_(false), standbyPiP_(false),
+	priority_(NormalPriority), priorityPiP_(NormalPriority)
+{
+	for (auto& cycles : priorityCycles_)
+		cycles = 0;
+
+	motionDetector_.SetHandler([this](uint32_t zoneNum, bool motion)
+	{
+		PostEvent(motion ? MotionStartedEvent : MotionStoppedEvent, 0, zoneNum);
+	});
+
+	motionDetectorPiP_.SetHandler([this](uint32_t zoneNum, bool motion)
+	{
+		PostEvent(motion ? MotionStartedEvent : MotionStoppedEvent, 1, zoneNum);
+	});
+}
 
 void StreamPlayer::Initialize(StreamPlayerParams params)
 {
-	assert(params.window != nullptr);
-    assert(params.streamStartedCallback != nullptr);
-	assert(params.streamStoppedCallback != nullptr);
-	assert(params.streamFailedCallback != nullptr);    
-    
     playerParams_ = params;
 
-    ::SetWindowLongPtr(playerParams_.window, GWLP_USERDATA, reinterpret_cast<LONG_PTR>(this));
+	// Without a window nothing is drawn and the events are taken with PollEvent or WaitEvent.
+	if (playerParams_.window != nullptr)
+	{
+		::SetWindowLongPtr(playerParams_.window, GWLP_USERDATA, reinterpret_cast<LONG_PTR>(this));
 
-    originalWndProc_ = reinterpret_cast<WNDPROC>(::SetWindowLongPtr(playerParams_.window, GWLP_WNDPROC,
-        reinterpret_cast<LONG_PTR>(WndProc)));
+		originalWndProc_ = reinterpret_cast<WNDPROC>(::SetWindowLongPtr(playerParams_.window, GWLP_WNDPROC,
+			reinterpret_cast<LONG_PTR>(WndProc)));
+	}
 
 	pip_left_ = 0;
 	pip_top_ = 0;
@@ -38,67 +70,753 @@ void StreamPlayer::Initialize(StreamPlayerParams params)
 	we_have_pip_ = false;
 	zoom_ = 1;
 	cross_ = 0;
+	repaintPending_ = false;
+	repaintTimerSet_ = false;
+
+	ClearEvents();
 }
 
 void StreamPlayer::StartPlay(string const& streamUrl)
 {
-	workerThread_ = boost::thread(&StreamPlayer::Play, this, streamUrl);
+	subUrl_.clear();
+
+	StartStream(0, streamUrl);
+}
+
+void StreamPlayer::StartPlayProfile(string const& mainUrl, string const& subUrl)
+{
+	mainUrl_ = mainUrl;
+	subUrl_ = subUrl;
+
+	// With no window to fit, the main stream is played.
+	RECT rc = { 0, 0, profileWidthThreshold_, 0 };
+	if (playerParams_.window != nullptr)
+		::GetClientRect(playerParams_.window, &rc);
+
+	currentUrl_ = ProfileUrl(rc.right - rc.left);
+
+	StartStream(0, currentUrl_);
+}
+
+void StreamPlayer::StartPlayPiPProfile(string const& mainUrl, string const& subUrl)
+{
+	// The PiP is always small, so it plays the substream when there is one.
+	StartPlayPiP(subUrl.empty() ? mainUrl : subUrl);
 }
 
 void StreamPlayer::StartPlayPiP(string const& streamUrl)
 {
-	workerThreadPiP_ = boost::thread(&StreamPlayer::PlayPiP, this, streamUrl);
+	StartStream(1, streamUrl);
 }
 
-void StreamPlayer::Play(string const& streamUrl)
+void StreamPlayer::StartPlayCustom(uint32_t streamNum, string const& formatName, int32_t *queueCapacity,
+	void **inputHandle)
 {
-	boost::unique_lock<boost::mutex> lock(mutex_, boost::defer_lock);
+	if (*queueCapacity <= 0)
+		throw runtime_error("invalid queue capacity");
+
+	std::shared_ptr<PushInput> inputPtr = std::make_shared<PushInput>(*queueCapacity, formatName);
+
+	if (streamNum == 0)
+		subUrl_.clear();
+
+	// A handle to an input no stream reads would only fill up.
+	if (!StartStream(streamNum, "push:", inputPtr))
+		throw runtime_error("the stream is playing");
+
+	{
+		boost::unique_lock<boost::mutex> lock(pushInputsMutex_);
+		pushInputs_.push_back(inputPtr);
+	}
+
+	*inputHandle = inputPtr.get();
+}
+
+bool StreamPlayer::PushData(void *inputHandle, uint8_t const *dataPtr, int32_t size,
+	BufferReleasedCallback released, void *context)
+{
+	std::shared_ptr<PushInput> inputPtr;
+
+	{
+		boost::unique_lock<boost::mutex> lock(pushInputsMutex_);
+
+		auto position = find_if(pushInputs_.begin(), pushInputs_.end(),
+			[inputHandle](std::shared_ptr<PushInput> const& candidatePtr) { return candidatePtr.get() == inputHandle; });
+
+		if (position == pushInputs_.end())
+			return false;
+
+		inputPtr = *position;
+	}
+
+	return inputPtr->Push(dataPtr, size, released, context);
+}
+
+void StreamPlayer::EndData(void *inputHandle)
+{
+	boost::unique_lock<boost::mutex> lock(pushInputsMutex_);
+
+	auto position = find_if(pushInputs_.begin(), pushInputs_.end(),
+		[inputHandle](std::shared_ptr<PushInput> const& candidatePtr) { return candidatePtr.get() == inputHandle; });
+
+	if (position == pushInputs_.end())
+		return;
+
+	// The stream keeps its own reference until it has read the queued buffers.
+	(*position)->End();
+	pushInputs_.erase(position);
+}
+
+void StreamPlayer::StartPlayCallback(uint32_t streamNum, ReadCallback read, void *context,
+	string const& formatName)
+{
+	std::shared_ptr<CallbackInput> inputPtr = std::make_shared<CallbackInput>(read, context, formatName);
+
+	if (streamNum == 0)
+		subUrl_.clear();
+
+	StartStream(streamNum, "callback:", inputPtr);
+}
+
+void StreamPlayer::StartPlayArchive(string const& directory, int64_t *timestamp)
+{
+	stopRequested_ = false;
+	workerThread_ = boost::thread(&StreamPlayer::PlayArchive, this, directory, *timestamp);
+}
+
+struct StreamPlayer::Session
+{
+	std::unique_ptr<Decoder> decoderPtr;
+	// The application input to demux instead of the url, or nullptr.
+	std::shared_ptr<InputSource> inputPtr;
+	// Loads the other stream of a camera profile.
+	DecoderLoader loader;
+	std::string url;
+	std::string targetUrl;
+	bool firstFrame;
+	uint64_t cpuCycles;
+
+	// The stream url then the backup ones, and what opening each found out.
+	std::vector<std::string> urls;
+	std::vector<StreamInfo> streamInfos;
+	size_t urlIndex;
+	bool watchdog;
+	Clock::time_point connectTime;
+	Clock::time_point lastFrameTime;
+	// When the next attempt to connect is due.
+	Clock::time_point reconnectTime;
+	// The attempts that failed since the last frame.
+	uint32_t failedAttempts;
+	int32_t reconnects;
+	int64_t recoveryMilliseconds;
+	std::minstd_rand random;
+
+	TransportProfile transport;
+	// Whether the loader holds the TCP stream of a transport fallback.
+	bool transportFallback;
+	// The damaged packets are counted over windows, the stream falls back to TCP
+	// after a few lossy windows in a row.
+	Clock::time_point lossWindowStart;
+	int64_t lossWindowPackets;
+	int64_t lossWindowCorruptPackets;
+	uint32_t lossyWindows;
+
+	void ResetLossWindow()
+	{
+		// The counters are those of the decoder, which starts over.
+		lossWindowStart = Clock::now();
+		lossWindowPackets = 0;
+		lossWindowCorruptPackets = 0;
+		lossyWindows = 0;
+	}
+};
+
+class StreamPlayer::StreamTask : public DecodeScheduler::Task
+{
+public:
+	StreamTask(StreamPlayer &player, uint32_t streamNum, string const& streamUrl,
+		std::shared_ptr<InputSource> const& inputPtr);
+
+	virtual bool Step(DecodeScheduler::Clock::time_point &nextStep) override;
+
+	virtual int32_t Priority() const override;
+
+	/// <summary>
+	/// Gets whether the stream ended.
+	/// </summary>
+	bool Finished();
+
+	/// <summary>
+	/// Waits until the stream ends.
+	/// </summary>
+	void Wait();
+
+	virtual ~StreamTask();
+
+private:
+	void Finish();
+
+	StreamPlayer &player_;
+	const uint32_t streamNum_;
+	const std::string streamUrl_;
+	const std::shared_ptr<InputSource> inputPtr_;
+	std::unique_ptr<Session> sessionPtr_;
+
+	boost::mutex mutex_;
+	boost::condition_variable finishedCondition_;
+	bool finished_;
+};
+
+bool StreamPlayer::StartStream(uint32_t streamNum, string const& streamUrl,
+	std::shared_ptr<InputSource> const& inputPtr)
+{
+	if (!schedulerEnabled_)
+	{
+		boost::thread &workerThread = streamNum == 0 ? workerThread_ : workerThreadPiP_;
+		if (workerThread.joinable() && !workerThread.try_join_for(boost::chrono::milliseconds(0)))
+		{
+			// Skip subsequent calls until a stream fails or stopped.  
+			return false;
+		}
+
+		// Cleared here rather than by the stream, so that a Stop right after the start is not lost.
+		(streamNum == 0 ? stopRequested_ : stopRequestedPiP_) = false;
+		(streamNum == 0 ? stopDeadline_ : stopDeadlinePiP_) = Decoder::NoCancelDeadline;
+
+		// The input goes with the stream, a later start does not swap it under the reads.
+		workerThread = boost::thread(&StreamPlayer::Play, this, streamNum, streamUrl, inputPtr);
+		return true;
+	}
+
+	std::shared_ptr<StreamTask> &taskPtr = streamNum == 0 ? streamTaskPtr_ : streamTaskPiPPtr_;
+	if (taskPtr != nullptr && !taskPtr->Finished())
+	{
+		// Skip subsequent calls until a stream fails or stopped.  
+		return false;
+	}
+
+	(streamNum == 0 ? stopRequested_ : stopRequestedPiP_) = false;
+	(streamNum == 0 ? stopDeadline_ : stopDeadlinePiP_) = Decoder::NoCancelDeadline;
+	taskPtr = std::make_shared<StreamTask>(*this, streamNum, streamUrl, inputPtr);
+
+	scheduler_.Start(schedulerWorkerCount_);
+	scheduler_.Submit(taskPtr);
+
+	return true;
+}
+
+void StreamPlayer::Play(uint32_t streamNum, string const& streamUrl, std::shared_ptr<InputSource> inputPtr)
+{
+	boost::unique_lock<boost::mutex> lock(streamNum == 0 ? mutex_ : mutexPiP_, boost::defer_lock);
 	if (!lock.try_lock())
 	{
 		// Skip subsequent calls until a stream fails or stopped.  
 		return;
 	}
 
-	try
-	{
-		Decoder decoder(streamUrl);
+	bool failed = false;
 
-		stopRequested_ = false;
-		bool firstFrame = true;
+	Session session;
+	OpenSession(streamNum, streamUrl, inputPtr, session);
 
-		framePtr_.reset();
-		
-		for (;;)
+	int32_t threadPriority = NormalPriority;
+
+	for (;;)
+	{
+		try
 		{
-			decoder.GetNextFrame(framePtr_);
+			if (session.decoderPtr == nullptr)
+				ConnectSession(streamNum, session);
+			else
+				CheckStall(session);
 
-			if (stopRequested_ || framePtr_ == nullptr)
+			// A stream stopped between two reads is parked before it reads again.
+			Clock::duration delay;
+			if (StopRequested(streamNum) || !StepSession(streamNum, session, delay))
 			{
-				::PostMessage(playerParams_.window, WM_STREAMSTOPPED, 0, 0);
+				ParkSession(streamNum, session);
 				break;
 			}
 
-			::PostMessage(playerParams_.window, WM_INVALIDATE, 0, 0);
+			// The stream owns the thread, so the system scheduler favors it by its priority.
+			const int32_t priority = streamNum == 0 ? priority_ : priorityPiP_;
+			if (priority != threadPriority)
+			{
+				::SetThreadPriority(::GetCurrentThread(), priority == FocusedPriority ? THREAD_PRIORITY_ABOVE_NORMAL :
+					priority == BackgroundPriority ? THREAD_PRIORITY_BELOW_NORMAL : THREAD_PRIORITY_NORMAL);
+				threadPriority = priority;
+			}
+
+			boost::this_thread::sleep_for(delay);
+		}
+		catch (runtime_error&)
+		{
+			// An interrupted read is a stop, not a failure.
+			failed = !StopRequested(streamNum);
+
+			if (!failed || !ReconnectSession(streamNum, session))
+				break;
+
+			failed = false;
+
+			// Waited in short steps, so that a stop does not wait for the next attempt.
+			while (!StopRequested(streamNum) && Clock::now() < session.reconnectTime)
+				boost::this_thread::sleep_for(boost::chrono::milliseconds(RECONNECT_POLL_INTERVAL_MS));
+		}
+	}
+
+	CloseSession(streamNum, failed);
+}
+
+void StreamPlayer::OpenSession(uint32_t streamNum, string const& streamUrl,
+	std::shared_ptr<InputSource> const& inputPtr, Session &session)
+{
+	std::vector<string> const& backupUrls = streamNum == 0 ? backupUrls_ : backupUrlsPiP_;
+
+	session.urls.assign(1, streamUrl);
+	session.urls.insert(session.urls.end(), backupUrls.begin(), backupUrls.end());
+	session.streamInfos.assign(session.urls.size(), StreamInfo());
+	session.urlIndex = 0;
+
+	// An application input is read once, there is nothing to reconnect to.
+	session.inputPtr = inputPtr;
+	session.watchdog = stallTimeoutInMilliseconds_ > 0 && inputPtr == nullptr;
+
+	session.lastFrameTime = Clock::now();
+	session.reconnectTime = session.lastFrameTime;
+	session.failedAttempts = 0;
+	session.reconnects = 0;
+	session.recoveryMilliseconds = 0;
+	session.random.seed(static_cast<uint32_t>(session.lastFrameTime.time_since_epoch().count()) + streamNum);
+	session.transport = streamNum == 0 ? transportProfile_ : transportProfilePiP_;
+	session.transportFallback = false;
+
+	session.url = streamUrl;
+	session.targetUrl = streamUrl;
+	session.firstFrame = true;
+	session.cpuCycles = 0;
 
-			const auto millisecondsToWait = decoder.InterframeDelayInMilliseconds();
-			boost::this_thread::sleep_for(boost::chrono::milliseconds(millisecondsToWait));
+	if (streamNum == 0)
+	{
+		switchRequested_ = false;
+
+		framePtr_.reset();
+		frameSignal_.Open();
+	}
+	else
+	{
+		framePiPPtr_.reset();
+		frameSignalPiP_.Open();
+	}
+
+	UpdateStats(streamNum, StreamStats());
+}
 
-			if (firstFrame)
+void StreamPlayer::ConnectSession(uint32_t streamNum, Session &session)
+{
+	if (StopRequested(streamNum))
+		throw runtime_error("stream stopped");
+
+	string const& streamUrl = session.urls[session.urlIndex];
+
+	DecoderParams decoderParams = SessionDecoderParams(session);
+	decoderParams.inputPtr = session.inputPtr;
+	decoderParams.streamInfo = session.streamInfos[session.urlIndex];
+
+	// A decoder parked in the pool resumes from the group of pictures it kept.
+	if (decoderPoolEnabled_ && decoderParams.inputPtr == nullptr)
+		session.decoderPtr = decoderPool_.Take(streamUrl);
+
+	GopCache &otherGopCache = streamNum == 0 ? gopCachePiP_ : gopCache_;
+
+	if (session.decoderPtr != nullptr)
+	{
+		session.decoderPtr->SetCancelDeadline(streamNum == 0 ? &stopDeadline_ : &stopDeadlinePiP_);
+	}
+	else
+	{
+		session.decoderPtr = std::make_unique<Decoder>(streamUrl, decoderParams, nullptr,
+			streamNum == 0 ? &stopDeadline_ : &stopDeadlinePiP_);
+
+		// The other stream plays the same camera, its cached group starts this one.
+		if (decoderParams.inputPtr == nullptr && otherGopCache.Url() == streamUrl)
+			session.decoderPtr->FollowSource(&otherGopCache);
+	}
+
+	AddSinks(streamNum, *session.decoderPtr);
+	(streamNum == 0 ? gopCache_ : gopCachePiP_).SetUrl(streamUrl);
+	session.ResetLossWindow();
+
+	session.streamInfos[session.urlIndex] = session.decoderPtr->Info();
+	session.url = streamUrl;
+	session.targetUrl = streamUrl;
+	session.connectTime = Clock::now();
+}
+
+void StreamPlayer::ParkSession(uint32_t streamNum, Session &session)
+{
+	// Only a stream stopped between two reads is kept, one that ended has nothing left to read
+	// and an application input is read once.
+	if (!decoderPoolEnabled_ || session.decoderPtr == nullptr || !StopRequested(streamNum) ||
+		session.inputPtr != nullptr)
+	{
+		return;
+	}
+
+	session.decoderPtr->RemoveSinks();
+	decoderPool_.Park(session.url, std::move(session.decoderPtr));
+}
+
+DecoderParams StreamPlayer::SessionDecoderParams(Session const& session) const
+{
+	DecoderParams decoderParams = StreamDecoderParams();
+	decoderParams.transport = session.transport;
+
+	// A read blocks no longer than the watchdog waits for a frame.
+	if (session.watchdog && (decoderParams.readTimeoutInMilliseconds == 0 ||
+		decoderParams.readTimeoutInMilliseconds > stallTimeoutInMilliseconds_))
+	{
+		decoderParams.readTimeoutInMilliseconds = stallTimeoutInMilliseconds_;
+	}
+
+	// Nor do the reads go on longer than that when none of them brings a frame.
+	if (session.watchdog)
+		decoderParams.frameTimeoutInMilliseconds = stallTimeoutInMilliseconds_;
+
+	return decoderParams;
+}
+
+bool StreamPlayer::LossSustained(Session &session, StreamStats const& stats) const
+{
+	if (session.transport.fallbackLossPercent <= 0 || session.transport.transport == TcpTransport ||
+		session.url.compare(0, 7, "rtsp://") != 0)
+	{
+		return false;
+	}
+
+	const Clock::time_point now = Clock::now();
+	if (now - session.lossWindowStart < boost::chrono::milliseconds(LOSS_WINDOW_MS))
+		return false;
+
+	const int64_t packets = stats.receivedPackets - session.lossWindowPackets;
+	const int64_t corruptPackets = stats.corruptPackets - session.lossWindowCorruptPackets;
+	const bool lossy = packets > 0 && corruptPackets * 100 >= packets * session.transport.fallbackLossPercent;
+
+	session.lossyWindows = lossy ? session.lossyWindows + 1 : 0;
+	session.lossWindowStart = now;
+	session.lossWindowPackets = stats.receivedPackets;
+	session.lossWindowCorruptPackets = stats.corruptPackets;
+
+	return session.lossyWindows >= LOSSY_WINDOWS;
+}
+
+void StreamPlayer::CheckStall(Session const& session) const
+{
+	if (!session.watchdog)
+		return;
+
+	const Clock::time_point lastActivity = (std::max)(session.connectTime, session.lastFrameTime);
+	if (Clock::now() - lastActivity > boost::chrono::milliseconds(stallTimeoutInMilliseconds_))
+		throw runtime_error("stream stalled");
+}
+
+bool StreamPlayer::ReconnectSession(uint32_t streamNum, Session &session)
+{
+	session.decoderPtr.reset();
+	(streamNum == 0 ? gopCache_ : gopCachePiP_).Clear();
+
+	if (!session.watchdog || (maxReconnectAttempts_ > 0 && session.failedAttempts >= maxReconnectAttempts_))
+		return false;
+
+	// A stream that played is retried on its url at once, a failed attempt moves on to the next url.
+	int64_t delayInMilliseconds = 0;
+	if (session.failedAttempts > 0)
+	{
+		session.urlIndex = (session.urlIndex + 1) % session.urls.size();
+
+		const uint32_t doublings = (std::min)(session.failedAttempts - 1, 16u);
+		delayInMilliseconds = (std::min)(static_cast<int64_t>(retryDelayInMilliseconds_) << doublings,
+			static_cast<int64_t>(maxRetryDelayInMilliseconds_));
+
+		// Half of the delay is random, so that the cameras behind one failed link do not reconnect at once.
+		std::uniform_int_distribution<int64_t> jitter(0, delayInMilliseconds / 2);
+		delayInMilliseconds = delayInMilliseconds - delayInMilliseconds / 2 + jitter(session.random);
+	}
+
+	++session.failedAttempts;
+	session.reconnectTime = Clock::now() + boost::chrono::milliseconds(delayInMilliseconds);
+
+	return true;
+}
+
+bool StreamPlayer::StepSession(uint32_t streamNum, Session &session, Clock::duration &delay)
+{
+	const int32_t priority = streamNum == 0 ? priority_ : priorityPiP_;
+	session.decoderPtr->SetDecodeMode(StreamDecodeMode(streamNum, priority));
+
+	ULONG64 startCycles = 0;
+	::QueryThreadCycleTime(::GetCurrentThread(), &startCycles);
+
+	std::unique_ptr<Frame> &framePtr = streamNum == 0 ? framePtr_ : framePiPPtr_;
+	const bool frameDecoded = session.decoderPtr->GetNextFrame(framePtr);
+
+	ULONG64 endCycles = startCycles;
+	::QueryThreadCycleTime(::GetCurrentThread(), &endCycles);
+
+	if (StopRequested(streamNum))
+		return false;
+
+	if (!frameDecoded)
+	{
+		// A live camera does not end its stream, the watchdog reconnects it.
+		if (session.watchdog)
+			throw runtime_error("stream ended");
+
+		return false;
+	}
+
+	// A packet left undecoded in standby counts, the stream is alive.
+	const Clock::time_point now = Clock::now();
+	if (session.failedAttempts > 0)
+	{
+		session.recoveryMilliseconds = boost::chrono::duration_cast<boost::chrono::milliseconds>(
+			now - session.lastFrameTime).count();
+		++session.reconnects;
+		session.failedAttempts = 0;
+	}
+
+	session.lastFrameTime = now;
+
+	session.cpuCycles += endCycles - startCycles;
+	AddCpuCycles(priority, endCycles - startCycles);
+
+	StreamStats stats = session.decoderPtr->Stats();
+	stats.decodeMode = session.decoderPtr->CurrentDecodeMode();
+	stats.cpuCycles = static_cast<int64_t>(session.cpuCycles);
+	stats.reconnects = session.reconnects;
+	stats.recoveryMilliseconds = session.recoveryMilliseconds;
+	stats.urlIndex = static_cast<int32_t>(session.urlIndex);
+	stats.transport = session.transport.transport;
+	UpdateStats(streamNum, stats);
+
+	if (session.decoderPtr->FrameChanged())
+	{
+		if (streamNum == 0)
+		{
+			frameSignal_.Publish();
+			RequestRepaint();
+		}
+		else
+		{
+			// The PiP is drawn along with the main stream.
+			frameSignalPiP_.Publish();
+		}
+	}
+
+	delay = boost::chrono::milliseconds(session.decoderPtr->InterframeDelayInMilliseconds());
+
+	if (session.firstFrame)
+	{
+		if (streamNum == 0)
+			PostEvent(StreamStartedEvent, 0);
+		else
+			we_have_pip_ = true;
+
+		session.firstFrame = false;
+	}
+
+	// A profile switch loads the other stream of the camera in the background,
+	// the current one plays until the new decoder is primed to a keyframe.
+	if (streamNum == 0 && switchRequested_.exchange(false))
+	{
+		boost::unique_lock<boost::mutex> profileLock(profileMutex_);
+		session.targetUrl = switchUrl_;
+	}
+
+	if (!session.loader.Loading() && session.targetUrl != session.url)
+		session.loader.Start(session.targetUrl, SessionDecoderParams(session));
+
+	// UDP loss that does not clear up moves the stream to TCP. The TCP stream is loaded in the
+	// background like another profile, the UDP one plays until it is ready.
+	if (!session.loader.Loading() && LossSustained(session, stats))
+	{
+		// The stream stays on its transport until the TCP one replaces it.
+		DecoderParams decoderParams = SessionDecoderParams(session);
+		decoderParams.transport.transport = TcpTransport;
+
+		session.transportFallback = true;
+		session.loader.Start(session.url, decoderParams);
+	}
+
+	if (session.loader.Ready())
+	{
+		// A load outdated by another switch is dropped, the next step starts the next one.
+		const string loadedUrl = session.loader.Url();
+		const bool transportFallback = session.transportFallback;
+		session.transportFallback = false;
+		std::unique_ptr<Decoder> loadedDecoderPtr = session.loader.Take();
+
+		if (loadedDecoderPtr == nullptr)
+		{
+			// The other stream failed, stay on the current one.
+			if (loadedUrl == session.targetUrl)
+				session.targetUrl = session.url;
+
+			// The losses are counted afresh before TCP is tried again.
+			if (transportFallback)
+				session.ResetLossWindow();
+		}
+		else if (loadedUrl == session.targetUrl)
+		{
+			// Opened on the loader's cancel flag, the decoder has to stop with the stream now.
+			session.decoderPtr = std::move(loadedDecoderPtr);
+			session.decoderPtr->SetCancelFlag(nullptr);
+			session.decoderPtr->SetCancelDeadline(streamNum == 0 ? &stopDeadline_ : &stopDeadlinePiP_);
+			AddSinks(streamNum, *session.decoderPtr);
+			(streamNum == 0 ? gopCache_ : gopCachePiP_).SetUrl(loadedUrl);
+			session.url = loadedUrl;
+
+			// The watchdog reconnects to the profile playing.
+			session.urls[session.urlIndex] = loadedUrl;
+			session.streamInfos[session.urlIndex] = session.decoderPtr->Info();
+			session.ResetLossWindow();
+
+			if (transportFallback)
+				session.transport.transport = TcpTransport;
+		}
+	}
+
+	return true;
+}
+
+void StreamPlayer::CloseSession(uint32_t streamNum, bool failed)
+{
+	// A cache left behind would start a later stream of the camera from an old picture.
+	(streamNum == 0 ? gopCache_ : gopCachePiP_).Clear();
+
+	if (streamNum == 0)
+	{
+		PostEvent(failed ? StreamFailedEvent : StreamStoppedEvent, 0);
+		frameSignal_.Close();
+	}
+	else
+	{
+		we_have_pip_ = false;
+		frameSignalPiP_.Close();
+	}
+}
+
+StreamPlayer::StreamTask::StreamTask(StreamPlayer &player, uint32_t streamNum, string const& streamUrl,
+	std::shared_ptr<InputSource> const& inputPtr)
+	: player_(player), streamNum_(streamNum), streamUrl_(streamUrl), inputPtr_(inputPtr), finished_(false) {}
+
+bool StreamPlayer::StreamTask::Step(DecodeScheduler::Clock::time_point &nextStep)
+{
+	bool failed = false;
+
+	try
+	{
+		if (sessionPtr_ == nullptr)
+		{
+			sessionPtr_ = std::make_unique<Session>();
+			player_.OpenSession(streamNum_, streamUrl_, inputPtr_, *sessionPtr_);
+		}
+
+		if (sessionPtr_->decoderPtr == nullptr)
+		{
+			const Clock::time_point now = Clock::now();
+			if (!player_.StopRequested(streamNum_) && now < sessionPtr_->reconnectTime)
 			{
-				::PostMessage(playerParams_.window, WM_STREAMSTARTED, 0, 0);
-				firstFrame = false;
+				// Polled, so that a stop does not wait for the next attempt.
+				nextStep = (std::min)(sessionPtr_->reconnectTime, now + boost::chrono::milliseconds(RECONNECT_POLL_INTERVAL_MS));
+				return true;
 			}
+
+			player_.ConnectSession(streamNum_, *sessionPtr_);
+			nextStep = Clock::now();
+
+			return true;
+		}
+
+		if (!sessionPtr_->decoderPtr->InputReady() && !player_.StopRequested(streamNum_))
+		{
+			player_.CheckStall(*sessionPtr_);
+
+			// Waiting for the network here would hold a worker the other streams need.
+			nextStep = Clock::now() + boost::chrono::milliseconds(INPUT_POLL_INTERVAL_MS);
+			return true;
+		}
+
+		Clock::duration delay;
+		if (!player_.StopRequested(streamNum_) && player_.StepSession(streamNum_, *sessionPtr_, delay))
+		{
+			nextStep = Clock::now() + delay;
+			return true;
 		}
+
+		player_.ParkSession(streamNum_, *sessionPtr_);
 	}
 	catch (runtime_error&)
 	{
-		::PostMessage(playerParams_.window, WM_STREAMFAILED, 0, 0);
+		failed = !player_.StopRequested(streamNum_);
+
+		if (failed && player_.ReconnectSession(streamNum_, *sessionPtr_))
+		{
+			nextStep = Clock::now();
+			return true;
+		}
+	}
+
+	sessionPtr_.reset();
+	player_.CloseSession(streamNum_, failed);
+	Finish();
+
+	return false;
+}
+
+int32_t StreamPlayer::StreamTask::Priority() const
+{
+	return streamNum_ == 0 ? player_.priority_ : player_.priorityPiP_;
+}
+
+bool StreamPlayer::StreamTask::Finished()
+{
+	boost::unique_lock<boost::mutex> lock(mutex_);
+	return finished_;
+}
+
+void StreamPlayer::StreamTask::Wait()
+{
+	boost::unique_lock<boost::mutex> lock(mutex_);
+	while (!finished_)
+		finishedCondition_.wait(lock);
+}
+
+void StreamPlayer::StreamTask::Finish()
+{
+	{
+		boost::unique_lock<boost::mutex> lock(mutex_);
+		finished_ = true;
+	}
+
+	finishedCondition_.notify_all();
+}
+
+StreamPlayer::StreamTask::~StreamTask()
+{
+	// Dropped by a scheduler shutdown in the middle of the stream.
+	if (sessionPtr_ != nullptr)
+	{
+		sessionPtr_.reset();
+		player_.CloseSession(streamNum_, false);
 	}
+
+	Finish();
 }
 
-void StreamPlayer::PlayPiP(string const& streamUrl)
+void StreamPlayer::PlayArchive(string const& directory, int64_t timestamp)
 {
-	boost::unique_lock<boost::mutex> lock(mutexPiP_, boost::defer_lock);
+	boost::unique_lock<boost::mutex> lock(mutex_, boost::defer_lock);
 	if (!lock.try_lock())
 	{
 		// Skip subsequent calls until a stream fails or stopped.  
@@ -107,62 +825,116 @@ void StreamPlayer::PlayPiP(string const& streamUrl)
 
 	try
 	{
-		Decoder decoder(streamUrl);
+		ArchiveReader reader(directory);
+		ArchiveReader::Position position;
+		if (!reader.Seek(timestamp, position))
+			throw runtime_error("no footage");
 
-		stopRequestedPiP_ = false;
 		bool firstFrame = true;
 
-		framePiPPtr_.reset();
+		framePtr_.reset();
+		frameSignal_.Open();
 
-		for (;;)
+		for (bool segmentFound = true; segmentFound && !stopRequested_;
+			segmentFound = reader.NextSegment(position.segmentId, position))
 		{
-			decoder.GetNextFrame(framePiPPtr_);
+			// The index points at a keyframe, so decoding starts without scanning the segment.
+			DecoderParams decoderParams;
+			decoderParams.frameFormat = decoderParams_.frameFormat;
+			decoderParams.convertFrames = StreamDecoderParams().convertFrames;
 
-			if (stopRequestedPiP_ || framePiPPtr_ == nullptr)
-			{
-				we_have_pip_ = false;
-				//::PostMessage(playerParams_.window, WM_STREAMSTOPPED, 0, 0);
-				break;
-			}
+			Decoder decoder(position.segmentFileName, decoderParams, &stopRequested_);
+			decoder.SeekToOffset(position.offset);
 
-			// ::PostMessage(playerParams_.window, WM_INVALIDATE, 0, 1);
+			while (!stopRequested_ && decoder.GetNextFrame(framePtr_))
+			{
+				frameSignal_.Publish();
+				RequestRepaint();
 
-			const auto millisecondsToWait = decoder.InterframeDelayInMilliseconds();
-			boost::this_thread::sleep_for(boost::chrono::milliseconds(millisecondsToWait));
+				const auto millisecondsToWait = decoder.InterframeDelayInMilliseconds();
+				boost::this_thread::sleep_for(boost::chrono::milliseconds(millisecondsToWait));
 
-			if (firstFrame)
-			{
-				we_have_pip_ = true;
-				//::PostMessage(playerParams_.window, WM_STREAMSTARTED, 0, 1);
-				firstFrame = false;
+				if (firstFrame)
+				{
+					PostEvent(StreamStartedEvent, 0);
+					firstFrame = false;
+				}
 			}
 		}
+
+		PostEvent(StreamStoppedEvent, 0);
 	}
 	catch (runtime_error&)
 	{
-		we_have_pip_ = false;
-		//::PostMessage(playerParams_.window, WM_STREAMFAILED, 0, 1);
+		PostEvent(stopRequested_ ? StreamStoppedEvent : StreamFailedEvent, 0);
 	}
+
+	frameSignal_.Close();
 }
 
-void StreamPlayer::Stop()
+void StreamPlayer::RequestStop()
 {
-    stopRequested_ = true;
+	// The blocking reads of the streams poll the deadlines through their interrupt callbacks.
+	// With the pool on they may finish the packet they read first, an interrupted decoder is not parked.
+	const int64_t stopDeadline = Decoder::CancelDeadline(decoderPoolEnabled_ ? PARK_TIMEOUT_MS : 0);
+	stopDeadline_ = stopDeadline;
+	stopDeadlinePiP_ = stopDeadline;
+
+	// The streams check the flags between their steps.
+	stopRequested_ = true;
 	stopRequestedPiP_ = true;
+}
+
+bool StreamPlayer::StopRequested(uint32_t streamNum) const
+{
+	return streamNum == 0 ? stopRequested_ : stopRequestedPiP_;
+}
+
+void StreamPlayer::Stop()
+{
+	RequestStop();
 
     if (workerThread_.joinable())
         workerThread_.join();
 
 	if (workerThreadPiP_.joinable())
 		workerThreadPiP_.join();
+
+	if (streamTaskPtr_ != nullptr)
+		streamTaskPtr_->Wait();
+
+	if (streamTaskPiPPtr_ != nullptr)
+		streamTaskPiPPtr_->Wait();
 }
 
 void StreamPlayer::Uninitialize()
 {
     Stop();
 
+	scheduler_.Shutdown();
+	streamTaskPtr_.reset();
+	streamTaskPiPPtr_.reset();
+	decoderPool_.Clear();
+	netReactor_.Shutdown();
+	decoderParams_.netReactorPtr = nullptr;
+
+	// The buffers still queued are released here, the handles are no longer valid.
+	{
+		boost::unique_lock<boost::mutex> lock(pushInputsMutex_);
+		pushInputs_.clear();
+	}
+
+	recorder_.Stop();
+	recorderPiP_.Stop();
+	archiveWriter_.Stop();
+	archiveWriterPiP_.Stop();
+	frameRing_.Stop();
+	frameRingPiP_.Stop();
+
     if (playerParams_.window != nullptr && originalWndProc_ != nullptr)
     {
+        ::KillTimer(playerParams_.window, REPAINT_TIMER_ID);
+
         // Clear the message queue.
         MSG msg;
         while (::PeekMessage(&msg, playerParams_.window, 0, 0, PM_REMOVE)) {}
@@ -171,10 +943,142 @@ void StreamPlayer::Uninitialize()
         ::SetWindowLongPtr(playerParams_.window, GWLP_WNDPROC,
             reinterpret_cast<LONG_PTR>(originalWndProc_));
     }
+
+	// The WM_PLAYEREVENTS dropped above would leave the events pending for good.
+	ClearEvents();
+}
+
+void StreamPlayer::AddSinks(uint32_t streamNum, Decoder &decoder)
+{
+	// The vectors come with the frames only if the codec was opened to export them.
+	const MotionDetector::Mode mode = decoder.MotionVectorsExported() ?
+		MotionDetector::MotionVectorMode : MotionDetector::LumaMode;
+	(streamNum == 0 ? motionDetector_ : motionDetectorPiP_).SetMode(mode);
+
+	// The cache comes first, the sinks it sends its group to get the next packet after it.
+	if (streamNum == 0)
+	{
+		decoder.SetGopCache(&gopCache_);
+		decoder.AddPacketSink(&packetBuffer_);
+		decoder.AddPacketSink(&recorder_);
+		decoder.AddPacketSink(&archiveWriter_);
+		decoder.AddFrameSink(&motionDetector_);
+		decoder.AddFrameSink(&frameRing_);
+		decoder.AddFrameSink(&frameDispatcher_);
+	}
+	else
+	{
+		decoder.SetGopCache(&gopCachePiP_);
+		decoder.AddPacketSink(&packetBufferPiP_);
+		decoder.AddPacketSink(&recorderPiP_);
+		decoder.AddPacketSink(&archiveWriterPiP_);
+		decoder.AddFrameSink(&motionDetectorPiP_);
+		decoder.AddFrameSink(&frameRingPiP_);
+		decoder.AddFrameSink(&frameDispatcherPiP_);
+	}
+}
+
+void StreamPlayer::RequestRepaint()
+{
+	// At most one WM_INVALIDATE is queued, the paint it leads to draws the latest frame
+	// and frames decoded meanwhile need no message of their own.
+	if (playerParams_.window != nullptr && !repaintPending_.exchange(true))
+		::PostMessage(playerParams_.window, WM_INVALIDATE, 0, 0);
+}
+
+void StreamPlayer::PostEvent(PlayerEventType type, uint32_t streamNum, uint32_t zoneNum)
+{
+	const PlayerEvent event = { type, streamNum, zoneNum };
+	if (!eventQueue_.Push(event))
+		return;
+
+	// The window drains the whole queue per message, so one message is enough until it does.
+	if (playerParams_.window != nullptr && !eventsPending_.exchange(true))
+		::PostMessage(playerParams_.window, WM_PLAYEREVENTS, 0, 0);
+}
+
+void StreamPlayer::ClearEvents()
+{
+	PlayerEvent event;
+	while (eventQueue_.Poll(event)) {}
+
+	eventsPending_ = false;
+}
+
+void StreamPlayer::RaiseEvents()
+{
+	// Cleared before draining, an event queued meanwhile posts another message.
+	eventsPending_ = false;
+
+	PlayerEvent event;
+	while (eventQueue_.Poll(event))
+	{
+		switch (event.type)
+		{
+		case StreamStartedEvent:
+			RaiseStreamStartedEvent(event.streamNum);
+			break;
+
+		case StreamStoppedEvent:
+			RaiseStreamStoppedEvent(event.streamNum);
+			break;
+
+		case StreamFailedEvent:
+			RaiseStreamFailedEvent(event.streamNum);
+			break;
+
+		case MotionStartedEvent:
+			RaiseMotionStartedEvent(event.streamNum, event.zoneNum);
+			break;
+
+		case MotionStoppedEvent:
+			RaiseMotionStoppedEvent(event.streamNum, event.zoneNum);
+			break;
+
+		default: break;
+		}
+	}
+}
+
+bool StreamPlayer::PollEvent(PlayerEvent *eventPtr)
+{
+	return eventQueue_.Poll(*eventPtr);
+}
+
+bool StreamPlayer::WaitEvent(int32_t *timeoutInMilliseconds, PlayerEvent *eventPtr)
+{
+	return eventQueue_.Wait(*eventPtr, *timeoutInMilliseconds > 0 ? *timeoutInMilliseconds : 0);
+}
+
+void StreamPlayer::Invalidate()
+{
+	const Clock::time_point now = Clock::now();
+	const Clock::duration sinceLastPaint = now - lastPaint_;
+
+	if (displayInterval_ > Clock::duration::zero() && sinceLastPaint < displayInterval_)
+	{
+		// Too early for the display rate, the repaint stays pending until the timer fires.
+		if (!repaintTimerSet_)
+		{
+			const auto delay = boost::chrono::duration_cast<boost::chrono::milliseconds>(
+				displayInterval_ - sinceLastPaint);
+
+			::SetTimer(playerParams_.window, REPAINT_TIMER_ID, static_cast<UINT>(delay.count()) + 1, nullptr);
+			repaintTimerSet_ = true;
+		}
+
+		return;
+	}
+
+	::InvalidateRect(playerParams_.window, nullptr, FALSE);
 }
 
 void StreamPlayer::DrawFrame()
 {
+	// Cleared before drawing, a frame decoded during the paint asks for another one.
+	repaintPending_ = false;
+	lastPaint_ = Clock::now();
+
 	if (framePtr_ != nullptr)
 		if (we_have_pip_ && (framePiPPtr_ != nullptr))
 			framePtr_->Draw(playerParams_.window, zoom_, cross_, framePiPPtr_.get(), pip_width_, pip_top_, pip_left_);
@@ -194,23 +1098,33 @@ LRESULT APIENTRY StreamPlayer::WndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPAR
     switch (uMsg)
     {
     case WM_INVALIDATE:
-        ::InvalidateRect(hWnd, nullptr, FALSE);
+        playerPtr->Invalidate();
         break;
 
+	case WM_TIMER:
+		if (wParam == REPAINT_TIMER_ID)
+		{
+			::KillTimer(hWnd, REPAINT_TIMER_ID);
+			playerPtr->repaintTimerSet_ = false;
+			::InvalidateRect(hWnd, nullptr, FALSE);
+			return 0;
+		}
+		break;
+
     case WM_PAINT:
         playerPtr->DrawFrame();
         break;
 
-	case WM_STREAMSTARTED:
-		playerPtr->RaiseStreamStartedEvent(lParam);
+	case WM_PLAYEREVENTS:
+		playerPtr->RaiseEvents();
 		break;
 
-	case WM_STREAMSTOPPED:
-		playerPtr->RaiseStreamStoppedEvent(lParam);
-		break;    
+	case WM_SIZE:
+		playerPtr->minimized_ = wParam == SIZE_MINIMIZED;
 
-	case WM_STREAMFAILED:
-		playerPtr->RaiseStreamFailedEvent(lParam);
+		// A minimized window has no width, the profile stays as it is.
+		if (wParam != SIZE_MINIMIZED)
+			playerPtr->Resize(LOWORD(lParam));
 		break;
 
 	case WM_ERASEBKGND:
@@ -242,6 +1156,15 @@ void StreamPlayer::GetFrameSize(uint32_t *widthPtr, uint32_t *heightPtr)
     *heightPtr = framePtr_->Height();
 }
 
+FrameSignal::WaitResult StreamPlayer::WaitForFrame(uint32_t streamNum, int64_t *lastSequence,
+	int32_t *timeoutInMilliseconds, int64_t *sequence)
+{
+	FrameSignal &frameSignal = streamNum == 0 ? frameSignal_ : frameSignalPiP_;
+	const uint32_t timeout = *timeoutInMilliseconds > 0 ? *timeoutInMilliseconds : 0;
+
+	return frameSignal.Wait(*lastSequence, timeout, *sequence);
+}
+
 void StreamPlayer::SetupPiP(int32_t *pip_width, int32_t *pip_top, int32_t *pip_left)
 {
 	pip_left_ = *pip_left;
@@ -260,6 +1183,358 @@ void StreamPlayer::SetupCross(int32_t *cross)
 	cross_ = *cross;
 }
 
+void StreamPlayer::SetupDisplayRate(int32_t *framesPerSecond)
+{
+	displayInterval_ = *framesPerSecond > 0 ?
+		boost::chrono::duration_cast<Clock::duration>(boost::chrono::microseconds(1000000 / *framesPerSecond)) :
+		Clock::duration::zero();
+}
+
+void StreamPlayer::SetupPreEventBuffer(int32_t *seconds, int32_t *kilobytes)
+{
+	const int64_t durationInMilliseconds = *seconds > 0 ? *seconds * 1000LL : 0;
+	const int64_t maxBytes = *kilobytes > 0 ? *kilobytes * 1024LL : 0;
+
+	// The buffer counts in 32 bits, larger limits would wrap around.
+	if (durationInMilliseconds > UINT32_MAX || maxBytes > UINT32_MAX)
+		throw runtime_error("invalid pre-event buffer limits");
+
+	packetBuffer_.SetLimits(static_cast<uint32_t>(durationInMilliseconds), static_cast<uint32_t>(maxBytes));
+	packetBufferPiP_.SetLimits(static_cast<uint32_t>(durationInMilliseconds), static_cast<uint32_t>(maxBytes));
+}
+
+void StreamPlayer::ExportPreEventClip(uint32_t streamNum, string const& fileName)
+{
+	if (streamNum == 0)
+		packetBuffer_.ExportClip(fileName);
+	else
+		packetBufferPiP_.ExportClip(fileName);
+}
+
+void StreamPlayer::StartRecording(uint32_t streamNum, string const& filePath,
+	int32_t *segmentSeconds, int32_t *segmentMegabytes)
+{
+	uint32_t seconds = *segmentSeconds > 0 ? *segmentSeconds : 0;
+	uint64_t bytes = *segmentMegabytes > 0 ? *segmentMegabytes * 1024ULL * 1024ULL : 0;
+
+	// The recording starts from the keyframe the stream last sent rather than the next one.
+	Recorder &recorder = streamNum == 0 ? recorder_ : recorderPiP_;
+	recorder.Start(filePath, seconds, bytes, true);
+	(streamNum == 0 ? gopCache_ : gopCachePiP_).RequestGop(&recorder);
+}
+
+void StreamPlayer::StopRecording(uint32_t streamNum)
+{
+	if (streamNum == 0)
+		recorder_.Stop();
+	else
+		recorderPiP_.Stop();
+}
+
+void StreamPlayer::StartArchiving(uint32_t streamNum, string const& directory,
+	int32_t *segmentSeconds, int32_t *maxAgeHours, int32_t *quotaMegabytes)
+{
+	uint32_t seconds = *segmentSeconds > 0 ? *segmentSeconds : 0;
+	uint32_t hours = *maxAgeHours > 0 ? *maxAgeHours : 0;
+	uint64_t quotaBytes = *quotaMegabytes > 0 ? *quotaMegabytes * 1024ULL * 1024ULL : 0;
+
+	if (streamNum == 0)
+		archiveWriter_.Start(directory, seconds, hours, quotaBytes);
+	else
+		archiveWriterPiP_.Start(directory, seconds, hours, quotaBytes);
+}
+
+void StreamPlayer::StopArchiving(uint32_t streamNum)
+{
+	if (streamNum == 0)
+		archiveWriter_.Stop();
+	else
+		archiveWriterPiP_.Stop();
+}
+
+void StreamPlayer::StartFrameRing(uint32_t streamNum, string const& name,
+	int32_t *slotCount, int32_t *slotKilobytes)
+{
+	if (*slotCount <= 0 || *slotKilobytes <= 0)
+		throw runtime_error("invalid frame ring size");
+
+	// The slot size is aligned and counted in 32 bits, larger slots would wrap around.
+	const int64_t slotSize = *slotKilobytes * 1024LL;
+	if (slotSize > INT32_MAX)
+		throw runtime_error("invalid frame ring size");
+
+	FrameRing &frameRing = streamNum == 0 ? frameRing_ : frameRingPiP_;
+	frameRing.Start(name, *slotCount, static_cast<uint32_t>(slotSize));
+}
+
+void StreamPlayer::StopFrameRing(uint32_t streamNum)
+{
+	FrameRing &frameRing = streamNum == 0 ? frameRing_ : frameRingPiP_;
+	frameRing.Stop();
+}
+
+void StreamPlayer::SetFrameCallback(uint32_t streamNum, FrameDecodedCallback frameDecodedCallback)
+{
+	FrameDispatcher &frameDispatcher = streamNum == 0 ? frameDispatcher_ : frameDispatcherPiP_;
+
+	if (frameDecodedCallback == nullptr)
+	{
+		frameDispatcher.SetHandler(FrameDispatcher::FrameHandler());
+		return;
+	}
+
+	frameDispatcher.SetHandler([streamNum, frameDecodedCallback](FrameView const& view)
+	{
+		frameDecodedCallback(streamNum, &view);
+	});
+}
+
+void StreamPlayer::SetupMotionDetection(int32_t *enabled, int32_t *startDelay, int32_t *stopDelay)
+{
+	uint32_t startDelayInMilliseconds = *startDelay > 0 ? *startDelay : 0;
+	uint32_t stopDelayInMilliseconds = *stopDelay > 0 ? *stopDelay : 0;
+
+	motionDetector_.Setup(*enabled != 0, startDelayInMilliseconds, stopDelayInMilliseconds);
+	motionDetectorPiP_.Setup(*enabled != 0, startDelayInMilliseconds, stopDelayInMilliseconds);
+}
+
+void StreamPlayer::SetupMotionZone(uint32_t streamNum, int32_t *zoneNum, int32_t *left, int32_t *top,
+	int32_t *right, int32_t *bottom, int32_t *threshold)
+{
+	if (*zoneNum < 0 || *left < 0 || *top < 0 || *right < 0 || *bottom < 0 || *threshold < 0)
+		throw runtime_error("invalid zone");
+
+	MotionDetector &motionDetector = streamNum == 0 ? motionDetector_ : motionDetectorPiP_;
+	motionDetector.SetupZone(*zoneNum, *left, *top, *right, *bottom, *threshold);
+}
+
+void StreamPlayer::SetupStreamSelection(int32_t *maxWidth, int32_t *maxHeight,
+	int32_t *maxKilobitsPerSecond, string const& codecName)
+{
+	decoderParams_.maxWidth = *maxWidth > 0 ? *maxWidth : 0;
+	decoderParams_.maxHeight = *maxHeight > 0 ? *maxHeight : 0;
+	decoderParams_.maxBitRate = *maxKilobitsPerSecond > 0 ? *maxKilobitsPerSecond * 1000LL : 0;
+	decoderParams_.preferredCodec = codecName;
+}
+
+void StreamPlayer::SetupProfileSwitch(int32_t *widthThreshold)
+{
+	if (*widthThreshold < 0)
+		throw runtime_error("invalid width threshold");
+
+	profileWidthThreshold_ = *widthThreshold;
+}
+
+string StreamPlayer::ProfileUrl(int32_t width) const
+{
+	return subUrl_.empty() || width >= profileWidthThreshold_ ? mainUrl_ : subUrl_;
+}
+
+void StreamPlayer::Resize(int32_t width)
+{
+	if (subUrl_.empty())
+		return;
+
+	string url = ProfileUrl(width);
+	if (url == currentUrl_)
+		return;
+
+	currentUrl_ = url;
+
+	boost::unique_lock<boost::mutex> lock(profileMutex_);
+	switchUrl_ = url;
+	switchRequested_ = true;
+}
+
+void StreamPlayer::SetupScheduler(int32_t *enabled, int32_t *workerCount)
+{
+	if (*workerCount < 0)
+		throw runtime_error("invalid worker count");
+
+	schedulerEnabled_ = *enabled != 0;
+	schedulerWorkerCount_ = *workerCount;
+}
+
+void StreamPlayer::SetupNetworkReactor(int32_t *enabled, int32_t *threadCount)
+{
+	if (*threadCount < 0)
+		throw runtime_error("invalid thread count");
+
+	if (*enabled == 0)
+	{
+		decoderParams_.netReactorPtr = nullptr;
+		return;
+	}
+
+	netReactor_.Start(*threadCount);
+	decoderParams_.netReactorPtr = &netReactor_;
+}
+
+void StreamPlayer::SetupWatchdog(int32_t *stallTimeoutInMilliseconds, int32_t *retryDelayInMilliseconds,
+	int32_t *maxRetryDelayInMilliseconds, int32_t *maxAttempts)
+{
+	if (*stallTimeoutInMilliseconds < 0 || *retryDelayInMilliseconds < 0 ||
+		*maxRetryDelayInMilliseconds < *retryDelayInMilliseconds || *maxAttempts < 0)
+	{
+		throw runtime_error("invalid watchdog parameters");
+	}
+
+	stallTimeoutInMilliseconds_ = *stallTimeoutInMilliseconds;
+	retryDelayInMilliseconds_ = *retryDelayInMilliseconds;
+	maxRetryDelayInMilliseconds_ = *maxRetryDelayInMilliseconds;
+	maxReconnectAttempts_ = *maxAttempts;
+}
+
+void StreamPlayer::SetupDecoderPool(int32_t *enabled, int32_t *memoryBudgetInMegabytes)
+{
+	if (*memoryBudgetInMegabytes < 0)
+		throw runtime_error("invalid memory budget");
+
+	decoderPoolEnabled_ = *enabled != 0;
+	decoderPool_.SetBudget(decoderPoolEnabled_ ? *memoryBudgetInMegabytes * 1024LL * 1024 : 0);
+}
+
+void StreamPlayer::GetParkedDecoderCount(int32_t *count)
+{
+	*count = decoderPool_.Count();
+}
+
+void StreamPlayer::SetupTransport(uint32_t streamNum, TransportProfile *profilePtr)
+{
+	if (profilePtr->transport < DefaultTransport || profilePtr->transport > MulticastTransport ||
+		profilePtr->fallbackLossPercent < 0 || profilePtr->fallbackLossPercent > 100)
+	{
+		throw runtime_error("invalid transport profile");
+	}
+
+	(streamNum == 0 ? transportProfile_ : transportProfilePiP_) = *profilePtr;
+}
+
+void StreamPlayer::SetBackupUrls(uint32_t streamNum, std::vector<string> const& urls)
+{
+	(streamNum == 0 ? backupUrls_ : backupUrlsPiP_) = urls;
+}
+
+void StreamPlayer::SetupVisibility(uint32_t streamNum, int32_t *visible, int32_t *priority)
+{
+	if (*priority < 0 || *priority >= PriorityCount)
+		throw runtime_error("invalid priority");
+
+	if (streamNum == 0)
+	{
+		visible_ = *visible != 0;
+		priority_ = *priority;
+	}
+	else
+	{
+		visiblePiP_ = *visible != 0;
+		priorityPiP_ = *priority;
+	}
+}
+
+void StreamPlayer::SetStandby(uint32_t streamNum, int32_t *standby)
+{
+	(streamNum == 0 ? standby_ : standbyPiP_) = *standby != 0;
+}
+
+void StreamPlayer::GetPriorityStats(PriorityStats *statsPtr)
+{
+	boost::unique_lock<boost::mutex> lock(statsMutex_);
+
+	int64_t totalCycles = 0;
+	for (int32_t i = 0; i < PriorityCount; ++i)
+		totalCycles += priorityCycles_[i];
+
+	for (int32_t i = 0; i < PriorityCount; ++i)
+	{
+		statsPtr->cpuCycles[i] = priorityCycles_[i];
+		statsPtr->cpuSharePercent[i] = totalCycles > 0 ?
+			static_cast<int32_t>(priorityCycles_[i] * 100 / totalCycles) : 0;
+	}
+}
+
+void StreamPlayer::AddCpuCycles(int32_t priority, uint64_t cycles)
+{
+	boost::unique_lock<boost::mutex> lock(statsMutex_);
+	priorityCycles_[priority] += cycles;
+}
+
+DecodeMode StreamPlayer::StreamDecodeMode(uint32_t streamNum, int32_t priority)
+{
+	if (streamNum == 0 ? standby_ : standbyPiP_)
+		return NoDecoding;
+
+	if (priority == FocusedPriority)
+		return FullDecoding;
+
+	// The PiP is drawn over the main stream, so it is hidden along with the window.
+	const bool visible = (streamNum == 0 ? visible_ : visiblePiP_) && !minimized_;
+
+	if (visible)
+		return priority == BackgroundPriority && cpuMonitor_.Overloaded() ? KeyframeDecoding : FullDecoding;
+
+	if (priority == BackgroundPriority)
+		return NoDecoding;
+
+	return cpuMonitor_.Overloaded() ? NoDecoding : KeyframeDecoding;
+}
+
+void StreamPlayer::SetupFrameSkipping(int32_t *enabled)
+{
+	decoderParams_.skipUnchangedFrames = *enabled != 0;
+}
+
+void StreamPlayer::GetStreamStats(uint32_t streamNum, StreamStats *statsPtr)
+{
+	boost::unique_lock<boost::mutex> lock(statsMutex_);
+	*statsPtr = streamNum == 0 ? stats_ : statsPiP_;
+}
+
+void StreamPlayer::UpdateStats(uint32_t streamNum, StreamStats const& stats)
+{
+	boost::unique_lock<boost::mutex> lock(statsMutex_);
+	(streamNum == 0 ? stats_ : statsPiP_) = stats;
+}
+
+void StreamPlayer::SetupFrameFormat(int32_t *format)
+{
+	if (*format < 0 || *format >= FrameFormatCount)
+		throw runtime_error("invalid frame format");
+
+	decoderParams_.frameFormat = static_cast<FrameFormat>(*format);
+}
+
+void StreamPlayer::SetupFrameOutput(int32_t *enabled)
+{
+	frameOutput_ = *enabled != 0;
+}
+
+DecoderParams StreamPlayer::StreamDecoderParams() const
+{
+	// Headless, the frames are converted only if SetupFrameOutput asked for them,
+	// GetCurrentFrame has none otherwise. The frame sinks get the decoded ones either way.
+	DecoderParams decoderParams = decoderParams_;
+	decoderParams.convertFrames = decoderParams_.convertFrames &&
+		(playerParams_.window != nullptr || frameOutput_);
+
+	return decoderParams;
+}
+
+void StreamPlayer::SetupMotionVectors(int32_t *enabled, int32_t *skipPixelOutput)
+{
+	decoderParams_.exportMotionVectors = *enabled != 0;
+	decoderParams_.convertFrames = *skipPixelOutput == 0;
+
+	// The detectors switch modes when the next stream opens its codec, see AddSinks.
+}
+
+void StreamPlayer::SetMotionCallbacks(MotionStartedCallback motionStartedCallback,
+	MotionStoppedCallback motionStoppedCallback)
+{
+	motionStartedCallback_ = motionStartedCallback;
+	motionStoppedCallback_ = motionStoppedCallback;
+}
+
 void StreamPlayer::RaiseStreamStartedEvent(uint32_t streamNum)
 {
 	if (playerParams_.streamStartedCallback != nullptr)
@@ -276,4 +1551,16 @@ void StreamPlayer::RaiseStreamFailedEvent(uint32_t streamNum)
 {
 	if (playerParams_.streamFailedCallback != nullptr)
 		playerParams_.streamFailedCallback(streamNum);
+}
+
+void StreamPlayer::RaiseMotionStartedEvent(uint32_t streamNum, uint32_t zoneNum)
+{
+	if (motionStartedCallback_ != nullptr)
+		motionStartedCallback_(streamNum, zoneNum);
+}
+
+void StreamPlayer::RaiseMotionStoppedEvent(uint32_t streamNum, uint32_t zoneNum)
+{
+	if (motionStoppedCallback_ != nullptr)
+		motionStoppedCallback_(streamNum, zoneNum);
 }
\ No newline at end of file
@@ -3,6 +3,7 @@
 
 #include <string>
 #include <memory>
+#include <vector>
 #include <boost/noncopyable.hpp>
 
 #pragma warning( push )
@@ -18,6 +19,21 @@
 #include <Windows.h>
 
 #include "frame.h"
+#include "decoder.h"
+#include "packetbuffer.h"
+#include "recorder.h"
+#include "archivewriter.h"
+#include "motiondetector.h"
+#include "framering.h"
+#include "framedispatcher.h"
+#include "framesignal.h"
+#include "decodescheduler.h"
+#include "cpumonitor.h"
+#include "netreactor.h"
+#include "pushinput.h"
+#include "eventqueue.h"
+#include "decoderpool.h"
+#include "gopcache.h"
 
 namespace FFmpeg
 {
@@ -26,6 +42,42 @@ namespace FFmpeg
 		typedef void(__stdcall *StreamStartedCallback)(uint32_t streamNum);
 		typedef void(__stdcall *StreamStoppedCallback)(uint32_t streamNum);
 		typedef void(__stdcall *StreamFailedCallback)(uint32_t streamNum);
+		typedef void(__stdcall *MotionStartedCallback)(uint32_t streamNum, uint32_t zoneNum);
+		typedef void(__stdcall *MotionStoppedCallback)(uint32_t streamNum, uint32_t zoneNum);
+		typedef void(__stdcall *FrameDecodedCallback)(uint32_t streamNum, FrameView const *viewPtr);
+
+		/// <summary>
+		/// How much a stream matters to the user, it decides how the stream is decoded when it is
+		/// hidden or the CPU is short.
+		/// </summary>
+		enum StreamPriority
+		{
+			// Decoded only while visible and the CPU is not short, demuxed only while hidden.
+			BackgroundPriority,
+			// Keyframes only while hidden, nothing when the CPU is short as well.
+			NormalPriority,
+			// Always fully decoded, e.g. the selected stream or one analysed while hidden.
+			FocusedPriority,
+			PriorityCount
+		};
+
+		/// <summary>
+		/// A PriorityStats structure contains the CPU time the streams of each priority used.
+		/// </summary>
+		struct PriorityStats
+		{
+			PriorityStats()
+			{
+				for (int32_t i = 0; i < PriorityCount; ++i)
+				{
+					cpuCycles[i] = 0;
+					cpuSharePercent[i] = 0;
+				}
+			}
+
+			int64_t cpuCycles[PriorityCount];
+			int32_t cpuSharePercent[PriorityCount];
+		};
 
         struct StreamPlayerParams
         {
@@ -33,6 +85,8 @@ namespace FFmpeg
 				: window(nullptr), streamStartedCallback(nullptr),
 				streamStoppedCallback(nullptr), streamFailedCallback(nullptr) {}
 
+            // Optional, the events are raised through the callbacks on its thread. Without
+            // a window they are taken with PollEvent or WaitEvent.
             HWND window;
             StreamStartedCallback streamStartedCallback;
 			StreamStoppedCallback streamStoppedCallback;
@@ -52,7 +106,8 @@ namespace FFmpeg
             StreamPlayer();
 
             /// <summary>
-            /// Initializes the player.
+            /// Initializes the player. Without a window the player is headless: nothing is drawn
+            /// and frames are converted only if SetupFrameOutput asks for them.
             /// </summary>
 			/// <param name="playerParams">The StreamPlayerParams object that contains the information that is used to initialize the player.</param>
 			void Initialize(StreamPlayerParams playerParams);
@@ -68,12 +123,73 @@ namespace FFmpeg
 			/// </summary>
 			/// <param name="streamUrl">The url of a stream to play.</param>
 			void StartPlayPiP(std::string const& streamUrl);
+
+			/// <summary>
+			/// Asynchronously plays a camera profile, the substream while the window is narrower
+			/// than the switch threshold and the main stream otherwise.
+			/// </summary>
+			/// <param name="mainUrl">The url of the high resolution stream.</param>
+			/// <param name="subUrl">The url of the low resolution stream.</param>
+			void StartPlayProfile(std::string const& mainUrl, std::string const& subUrl);
+
+			/// <summary>
+			/// Asynchronously plays the substream of a camera profile as the PiP stream.
+			/// </summary>
+			/// <param name="mainUrl">The url of the high resolution stream, played if there is no substream.</param>
+			/// <param name="subUrl">The url of the low resolution stream.</param>
+			void StartPlayPiPProfile(std::string const& mainUrl, std::string const& subUrl);
+
+			/// <summary>
+			/// Asynchronously plays a stream the application pushes buffers of, see PushInput.
+			/// </summary>
+			/// <param name="streamNum">The stream number, 0 for the main stream and 1 for the PiP one.</param>
+			/// <param name="formatName">The demuxer name, e.g. h264 or mpegts, empty to probe the stream.</param>
+			/// <param name="queueCapacity">The number of buffers that can be queued.</param>
+			/// <param name="inputHandle">Receives the input to push to, valid until it is ended with EndData or the player is uninitialized.</param>
+			void StartPlayCustom(uint32_t streamNum, std::string const& formatName, int32_t *queueCapacity,
+				void **inputHandle);
+
+			/// <summary>
+			/// Queues a buffer to a stream started with StartPlayCustom, see PushInput::Push.
+			/// </summary>
+			/// <param name="inputHandle">The input StartPlayCustom returned.</param>
+			/// <returns>false if the queue is full, the input ended or the handle is not valid.</returns>
+			bool PushData(void *inputHandle, uint8_t const *dataPtr, int32_t size,
+				BufferReleasedCallback released, void *context);
+
+			/// <summary>
+			/// Ends an input started with StartPlayCustom, the handle is not valid afterwards.
+			/// </summary>
+			/// <param name="inputHandle">The input StartPlayCustom returned.</param>
+			void EndData(void *inputHandle);
+
+			/// <summary>
+			/// Asynchronously plays a stream the decoder pulls from an application callback, see CallbackInput.
+			/// </summary>
+			/// <param name="streamNum">The stream number, 0 for the main stream and 1 for the PiP one.</param>
+			/// <param name="read">The callback that fills the demuxer buffer.</param>
+			/// <param name="context">Passed to the callback.</param>
+			/// <param name="formatName">The demuxer name, empty to probe the stream.</param>
+			void StartPlayCallback(uint32_t streamNum, ReadCallback read, void *context, std::string const& formatName);
+
+			/// <summary>
+			/// Asynchronously plays archived footage, starting at the nearest keyframe before a given time.
+			/// </summary>
+			/// <param name="directory">The archive directory.</param>
+			/// <param name="timestamp">The time to start at, in milliseconds since the Unix epoch.</param>
+			void StartPlayArchive(std::string const& directory, int64_t *timestamp);
 			
 			/// <summary>
             /// Stops a stream.
             /// </summary>
             void Stop();
 
+			/// <summary>
+			/// Asks the streams to stop and returns at once, blocking reads in progress are interrupted.
+			/// Calling it on every player before their Stop() stops them all in parallel.
+			/// </summary>
+			void RequestStop();
+
             /// <summary>
             /// Retrieves the current frame being displayed by the player.
             /// </summary>
@@ -87,6 +203,33 @@ namespace FFmpeg
             /// <param name="heightPtr">A pointer to an int that will receive the height.</param>
             void GetFrameSize(uint32_t *widthPtr, uint32_t *heightPtr);
 
+			/// <summary>
+			/// Waits until a stream decodes a frame newer than a given one.
+			/// </summary>
+			/// <param name="streamNum">The stream number, 0 for the main stream and 1 for the PiP one.</param>
+			/// <param name="lastSequence">The sequence number of the last seen frame, zero for none.</param>
+			/// <param name="timeoutInMilliseconds">How long to wait.</param>
+			/// <param name="sequence">Receives the sequence number of the latest frame.</param>
+			/// <returns>FramePublished, StreamClosed if the stream is not playing, or TimedOut.</returns>
+			FrameSignal::WaitResult WaitForFrame(uint32_t streamNum, int64_t *lastSequence,
+				int32_t *timeoutInMilliseconds, int64_t *sequence);
+
+			/// <summary>
+			/// Takes the oldest player event. With a window the events are raised through
+			/// the callbacks instead and there is nothing to take.
+			/// </summary>
+			/// <param name="eventPtr">A pointer to a PlayerEvent structure that will receive the event.</param>
+			/// <returns>false if there is no event.</returns>
+			bool PollEvent(PlayerEvent *eventPtr);
+
+			/// <summary>
+			/// Takes the oldest player event, waiting for one if there is none.
+			/// </summary>
+			/// <param name="timeoutInMilliseconds">How long to wait.</param>
+			/// <param name="eventPtr">A pointer to a PlayerEvent structure that will receive the event.</param>
+			/// <returns>false on timeout.</returns>
+			bool WaitEvent(int32_t *timeoutInMilliseconds, PlayerEvent *eventPtr);
+
 			/// <summary>
 			/// Set PiP parameters.
 			/// </summary>
@@ -102,23 +245,389 @@ namespace FFmpeg
 			/// </summary>
 			void SetupCross(int32_t *cross);
 
+			/// <summary>
+			/// Set the display frame rate cap, frames decoded faster are not painted.
+			/// </summary>
+			/// <param name="framesPerSecond">The maximal number of paints per second, zero for no cap.</param>
+			void SetupDisplayRate(int32_t *framesPerSecond);
+
+			/// <summary>
+			/// Set pre-event buffer parameters, applied to each stream.
+			/// </summary>
+			/// <param name="seconds">The duration to keep, zero disables the buffer.</param>
+			/// <param name="kilobytes">The size limit, in kilobytes, zero for no size limit.</param>
+			void SetupPreEventBuffer(int32_t *seconds, int32_t *kilobytes);
+
+			/// <summary>
+			/// Saves the pre-event buffer of a stream to a file.
+			/// </summary>
+			/// <param name="streamNum">The stream number, 0 for the main stream and 1 for the PiP one.</param>
+			/// <param name="fileName">The file to write, the container format is guessed from its extension.</param>
+			void ExportPreEventClip(uint32_t streamNum, std::string const& fileName);
+
+			/// <summary>
+			/// Starts recording a stream in parallel with the playback, without re-encoding.
+			/// The recording starts from the last keyframe of the stream.
+			/// </summary>
+			/// <param name="streamNum">The stream number, 0 for the main stream and 1 for the PiP one.</param>
+			/// <param name="filePath">The output file path, segments get a sequence number appended to the name.</param>
+			/// <param name="segmentSeconds">The segment duration limit, zero for no limit.</param>
+			/// <param name="segmentMegabytes">The segment size limit, zero for no limit.</param>
+			void StartRecording(uint32_t streamNum, std::string const& filePath,
+				int32_t *segmentSeconds, int32_t *segmentMegabytes);
+
+			/// <summary>
+			/// Stops recording a stream.
+			/// </summary>
+			/// <param name="streamNum">The stream number, 0 for the main stream and 1 for the PiP one.</param>
+			void StopRecording(uint32_t streamNum);
+
+			/// <summary>
+			/// Starts appending a stream to an archive that supports fast seeks.
+			/// </summary>
+			/// <param name="streamNum">The stream number, 0 for the main stream and 1 for the PiP one.</param>
+			/// <param name="directory">The archive directory.</param>
+			/// <param name="segmentSeconds">The segment duration.</param>
+			/// <param name="maxAgeHours">The age after which footage is evicted, zero for no limit.</param>
+			/// <param name="quotaMegabytes">The disk quota of the archive, zero for no limit.</param>
+			void StartArchiving(uint32_t streamNum, std::string const& directory,
+				int32_t *segmentSeconds, int32_t *maxAgeHours, int32_t *quotaMegabytes);
+
+			/// <summary>
+			/// Stops archiving a stream.
+			/// </summary>
+			/// <param name="streamNum">The stream number, 0 for the main stream and 1 for the PiP one.</param>
+			void StopArchiving(uint32_t streamNum);
+
+			/// <summary>
+			/// Starts publishing the decoded frames of a stream into a named shared memory ring.
+			/// </summary>
+			/// <param name="streamNum">The stream number, 0 for the main stream and 1 for the PiP one.</param>
+			/// <param name="name">The name of the file mapping.</param>
+			/// <param name="slotCount">The number of frames the ring holds.</param>
+			/// <param name="slotKilobytes">The size of a frame slot, in kilobytes.</param>
+			void StartFrameRing(uint32_t streamNum, std::string const& name,
+				int32_t *slotCount, int32_t *slotKilobytes);
+
+			/// <summary>
+			/// Stops publishing the decoded frames of a stream.
+			/// </summary>
+			/// <param name="streamNum">The stream number, 0 for the main stream and 1 for the PiP one.</param>
+			void StopFrameRing(uint32_t streamNum);
+
+			/// <summary>
+			/// Set the callback that receives every decoded frame of a stream, on the decoding thread.
+			/// </summary>
+			/// <param name="streamNum">The stream number, 0 for the main stream and 1 for the PiP one.</param>
+			/// <param name="frameDecodedCallback">The callback, nullptr to remove it.</param>
+			void SetFrameCallback(uint32_t streamNum, FrameDecodedCallback frameDecodedCallback);
+
+			/// <summary>
+			/// Set motion detection parameters, applied to each stream.
+			/// </summary>
+			/// <param name="enabled">Non-zero to enable the detection.</param>
+			/// <param name="startDelay">How long motion should last before it is reported, in milliseconds.</param>
+			/// <param name="stopDelay">How long a zone should stay still before the motion end is reported, in milliseconds.</param>
+			void SetupMotionDetection(int32_t *enabled, int32_t *startDelay, int32_t *stopDelay);
+
+			/// <summary>
+			/// Set a motion detection zone of a stream. Coordinates are percents of the frame size.
+			/// </summary>
+			/// <param name="streamNum">The stream number, 0 for the main stream and 1 for the PiP one.</param>
+			/// <param name="threshold">The mean luma difference that counts as motion, zero removes the zone.</param>
+			void SetupMotionZone(uint32_t streamNum, int32_t *zoneNum, int32_t *left, int32_t *top,
+				int32_t *right, int32_t *bottom, int32_t *threshold);
+
+			/// <summary>
+			/// Set the compressed-domain motion detection, takes effect when a stream is started.
+			/// </summary>
+			/// <param name="enabled">Non-zero to detect motion from the codec motion vectors instead of the luma plane.</param>
+			/// <param name="skipPixelOutput">Non-zero to skip the conversion of frames for display.</param>
+			void SetupMotionVectors(int32_t *enabled, int32_t *skipPixelOutput);
+
+			/// <summary>
+			/// Set the video stream preferences, take effect when a stream is started.
+			/// </summary>
+			/// <param name="maxWidth">The maximal width, zero for no limit.</param>
+			/// <param name="maxHeight">The maximal height, zero for no limit.</param>
+			/// <param name="maxKilobitsPerSecond">The maximal bit rate, zero for no limit.</param>
+			/// <param name="codecName">The preferred decoder name, e.g. h264, empty for no preference.</param>
+			void SetupStreamSelection(int32_t *maxWidth, int32_t *maxHeight,
+				int32_t *maxKilobitsPerSecond, std::string const& codecName);
+
+			/// <summary>
+			/// Set the window width from which a profile plays its main stream.
+			/// </summary>
+			/// <param name="widthThreshold">The width, in pixels.</param>
+			void SetupProfileSwitch(int32_t *widthThreshold);
+
+			/// <summary>
+			/// Set how the streams are decoded, takes effect when a stream is started.
+			/// </summary>
+			/// <param name="enabled">Non-zero to run the streams on a shared pool of workers instead of a thread per stream.</param>
+			/// <param name="workerCount">The number of workers, zero for one per core.</param>
+			void SetupScheduler(int32_t *enabled, int32_t *workerCount);
+
+			/// <summary>
+			/// Set how http:// and tcp:// streams are read, takes effect when a stream is started.
+			/// </summary>
+			/// <param name="enabled">Non-zero to read them on a few shared reactor threads instead of a blocking socket per stream.</param>
+			/// <param name="threadCount">The number of reactor threads, zero for one per four cores.</param>
+			void SetupNetworkReactor(int32_t *enabled, int32_t *threadCount);
+
+			/// <summary>
+			/// Set the stall watchdog, takes effect when a stream is started. A stream that delivers
+			/// no frame within the stall timeout, or fails, is reconnected after a jittered backoff
+			/// that doubles with each failed attempt, going through its backup urls in turn.
+			/// The application inputs are not reconnected.
+			/// </summary>
+			/// <param name="stallTimeoutInMilliseconds">The longest wait for a frame, zero to disable the watchdog.</param>
+			/// <param name="retryDelayInMilliseconds">The backoff after the first failed attempt.</param>
+			/// <param name="maxRetryDelayInMilliseconds">The longest backoff.</param>
+			/// <param name="maxAttempts">The failed attempts in a row before the stream fails, zero for no limit.</param>
+			void SetupWatchdog(int32_t *stallTimeoutInMilliseconds, int32_t *retryDelayInMilliseconds,
+				int32_t *maxRetryDelayInMilliseconds, int32_t *maxAttempts);
+
+			/// <summary>
+			/// Set the pool that keeps stopped streams connected, so that playing one of them again
+			/// resumes it instead of reopening it. A pooled stream keeps the options it was opened with.
+			/// </summary>
+			/// <param name="enabled">Non-zero to keep the stopped streams.</param>
+			/// <param name="memoryBudgetInMegabytes">The memory the kept streams may hold, the least recently stopped ones are closed past it.</param>
+			void SetupDecoderPool(int32_t *enabled, int32_t *memoryBudgetInMegabytes);
+
+			/// <summary>
+			/// Gets the number of stopped streams the pool keeps connected.
+			/// </summary>
+			/// <param name="count">Receives the number of parked decoders.</param>
+			void GetParkedDecoderCount(int32_t *count);
+
+			/// <summary>
+			/// Set how an RTSP stream is received, takes effect when a stream is started.
+			/// </summary>
+			/// <param name="streamNum">The stream number, 0 for the main stream and 1 for the PiP one.</param>
+			/// <param name="profilePtr">A pointer to a TransportProfile structure that contains the options.</param>
+			void SetupTransport(uint32_t streamNum, TransportProfile *profilePtr);
+
+			/// <summary>
+			/// Set the urls a stream fails over to, takes effect when a stream is started.
+			/// </summary>
+			/// <param name="streamNum">The stream number, 0 for the main stream and 1 for the PiP one.</param>
+			/// <param name="urls">The backup urls, in the order they are tried.</param>
+			void SetBackupUrls(uint32_t streamNum, std::vector<std::string> const& urls);
+
+			/// <summary>
+			/// Set whether a stream is on screen and how much it matters, takes effect at once.
+			/// A minimized window hides both streams.
+			/// </summary>
+			/// <param name="streamNum">The stream number, 0 for the main stream and 1 for the PiP one.</param>
+			/// <param name="visible">Non-zero if the stream is visible.</param>
+			/// <param name="priority">A StreamPriority value.</param>
+			void SetupVisibility(uint32_t streamNum, int32_t *visible, int32_t *priority);
+
+			/// <summary>
+			/// Puts a stream into standby or resumes it. In standby the stream stays connected and
+			/// its packets are read, recorded and archived, but nothing is decoded; a resumed stream
+			/// shows the last keyframe at its next frame instead of reconnecting.
+			/// </summary>
+			/// <param name="streamNum">The stream number, 0 for the main stream and 1 for the PiP one.</param>
+			/// <param name="standby">Non-zero for standby, zero to resume.</param>
+			void SetStandby(uint32_t streamNum, int32_t *standby);
+
+			/// <summary>
+			/// Retrieves the CPU time used by the streams of each priority since the player was created.
+			/// </summary>
+			/// <param name="statsPtr">A pointer to a PriorityStats structure that will receive the counters.</param>
+			void GetPriorityStats(PriorityStats *statsPtr);
+
+			/// <summary>
+			/// Set the skipping of unchanged frames, takes effect when a stream is started.
+			/// </summary>
+			/// <param name="enabled">Non-zero to skip the conversion and the repaint of frames that match the previous one.</param>
+			void SetupFrameSkipping(int32_t *enabled);
+
+			/// <summary>
+			/// Retrieves the counters of a stream.
+			/// </summary>
+			/// <param name="streamNum">The stream number, 0 for the main stream and 1 for the PiP one.</param>
+			/// <param name="statsPtr">A pointer to a StreamStats structure that will receive the counters.</param>
+			void GetStreamStats(uint32_t streamNum, StreamStats *statsPtr);
+
+			/// <summary>
+			/// Set the pixel layout of decoded frames, takes effect when a stream is started.
+			/// </summary>
+			/// <param name="format">0 for BGR24, 1 for BGRA32, 2 for GRAY8 and 3 for NV12.</param>
+			void SetupFrameFormat(int32_t *format);
+
+			/// <summary>
+			/// Set whether a player without a window converts frames for GetCurrentFrame,
+			/// takes effect when a stream is started. With a window the frames are always converted.
+			/// </summary>
+			/// <param name="enabled">Non-zero to convert the frames.</param>
+			void SetupFrameOutput(int32_t *enabled);
+
+			/// <summary>
+			/// Set the motion event callbacks.
+			/// </summary>
+			void SetMotionCallbacks(MotionStartedCallback motionStartedCallback,
+				MotionStoppedCallback motionStoppedCallback);
+
 			/// <summary>
             /// Uninitializes the player.
             /// </summary>
             void Uninitialize();
 
         private:
+			typedef boost::chrono::steady_clock Clock;
+
+			/// <summary>
+			/// The state of a playing stream.
+			/// </summary>
+			struct Session;
+
+			/// <summary>
+			/// A StreamTask class plays a stream on the scheduler, a frame per step.
+			/// </summary>
+			class StreamTask;
+
 			/// <summary>
-			/// Plays a stream.
+			/// Starts a stream on its own thread or on the scheduler.
 			/// </summary>
+			/// <param name="streamNum">The stream number, 0 for the main stream and 1 for the PiP one.</param>
 			/// <param name="streamUrl">The url of a stream to play.</param>
-			void Play(std::string const& streamUrl);
+			/// <param name="inputPtr">The input to demux instead of the url, or nullptr.</param>
+			/// <returns>false if the stream is still playing, the call is then skipped.</returns>
+			bool StartStream(uint32_t streamNum, std::string const& streamUrl,
+				std::shared_ptr<InputSource> const& inputPtr = std::shared_ptr<InputSource>());
 
 			/// <summary>
-			/// Plays a second (PiP) stream.
+			/// Plays a stream on the calling thread.
 			/// </summary>
+			/// <param name="streamNum">The stream number, 0 for the main stream and 1 for the PiP one.</param>
 			/// <param name="streamUrl">The url of a stream to play.</param>
-			void PlayPiP(std::string const& streamUrl);
+			/// <param name="inputPtr">The input to demux instead of the url, or nullptr.</param>
+			void Play(uint32_t streamNum, std::string const& streamUrl, std::shared_ptr<InputSource> inputPtr);
+
+			/// <summary>
+			/// Resets the state of a stream, the first step connects it.
+			/// </summary>
+			void OpenSession(uint32_t streamNum, std::string const& streamUrl,
+				std::shared_ptr<InputSource> const& inputPtr, Session &session);
+
+			/// <summary>
+			/// Opens the current url of a stream.
+			/// </summary>
+			void ConnectSession(uint32_t streamNum, Session &session);
+
+			/// <summary>
+			/// Moves the decoder of a stopped stream to the pool.
+			/// </summary>
+			void ParkSession(uint32_t streamNum, Session &session);
+
+			/// <summary>
+			/// Gets the parameters the current stream of a session is opened with.
+			/// </summary>
+			DecoderParams SessionDecoderParams(Session const& session) const;
+
+			/// <summary>
+			/// Gets whether a stream received over UDP kept losing packets for the last windows.
+			/// </summary>
+			bool LossSustained(Session &session, StreamStats const& stats) const;
+
+			/// <summary>
+			/// Throws if a stream delivered no frame within the stall timeout.
+			/// </summary>
+			void CheckStall(Session const& session) const;
+
+			/// <summary>
+			/// Closes a failed stream and schedules the next attempt to open it.
+			/// </summary>
+			/// <returns>false if the stream is not to be reconnected.</returns>
+			bool ReconnectSession(uint32_t streamNum, Session &session);
+
+			/// <summary>
+			/// Decodes the next frame of a stream.
+			/// </summary>
+			/// <param name="delay">Receives how long to wait before the next frame.</param>
+			/// <returns>false if the stream ended or is stopped.</returns>
+			bool StepSession(uint32_t streamNum, Session &session, Clock::duration &delay);
+
+			/// <summary>
+			/// Reports the end of a stream.
+			/// </summary>
+			void CloseSession(uint32_t streamNum, bool failed);
+
+			/// <summary>
+			/// Plays archived footage, segment after segment.
+			/// </summary>
+			/// <param name="directory">The archive directory.</param>
+			/// <param name="timestamp">The time to start at, in milliseconds since the Unix epoch.</param>
+			void PlayArchive(std::string const& directory, int64_t timestamp);
+
+			/// <summary>
+			/// Publishes the counters of a stream.
+			/// </summary>
+			void UpdateStats(uint32_t streamNum, StreamStats const& stats);
+
+			/// <summary>
+			/// Gets whether a stream is asked to stop.
+			/// </summary>
+			bool StopRequested(uint32_t streamNum) const;
+
+			/// <summary>
+			/// Adds the CPU time a stream used to its priority.
+			/// </summary>
+			void AddCpuCycles(int32_t priority, uint64_t cycles);
+
+			/// <summary>
+			/// Gets how much of a stream to decode, by its visibility, its priority and the CPU load.
+			/// </summary>
+			DecodeMode StreamDecodeMode(uint32_t streamNum, int32_t priority);
+
+			/// <summary>
+			/// Gets the profile stream that suits a window width.
+			/// </summary>
+			std::string ProfileUrl(int32_t width) const;
+
+			/// <summary>
+			/// Switches the profile stream when the window crosses the threshold, called on the UI thread.
+			/// </summary>
+			void Resize(int32_t width);
+
+			/// <summary>
+			/// Adds the packet and frame sinks of a stream to its decoder.
+			/// </summary>
+			void AddSinks(uint32_t streamNum, Decoder &decoder);
+
+			/// <summary>
+			/// Asks the UI thread to repaint, called on the decoding threads.
+			/// </summary>
+			void RequestRepaint();
+
+			/// <summary>
+			/// Gets the parameters streams are opened with.
+			/// </summary>
+			DecoderParams StreamDecoderParams() const;
+
+			/// <summary>
+			/// Queues an event, and asks the window to raise it if there is one.
+			/// </summary>
+			void PostEvent(PlayerEventType type, uint32_t streamNum, uint32_t zoneNum = 0);
+
+			/// <summary>
+			/// Drops the queued events, a player initialized again starts with none pending.
+			/// </summary>
+			void ClearEvents();
+
+			/// <summary>
+			/// Raises the queued events through the callbacks, called on the UI thread.
+			/// </summary>
+			void RaiseEvents();
+
+			/// <summary>
+			/// Invalidates the window, or defers it to the display rate, called on the UI thread.
+			/// </summary>
+			void Invalidate();
 
 			/// <summary>
 			/// Draws a frame.
@@ -140,17 +649,76 @@ namespace FFmpeg
 			/// </summary>
 			void RaiseStreamFailedEvent(uint32_t streamNum);
 
+			/// <summary>
+			/// Raises the MotionStarted event.
+			/// </summary>
+			void RaiseMotionStartedEvent(uint32_t streamNum, uint32_t zoneNum);
+
+			/// <summary>
+			/// Raises the MotionStopped event.
+			/// </summary>
+			void RaiseMotionStoppedEvent(uint32_t streamNum, uint32_t zoneNum);
+
             static LRESULT APIENTRY WndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
 
         private:
 			            
             boost::atomic<bool> stopRequested_;
 			boost::atomic<bool> stopRequestedPiP_;
+			// When the reads of the stopped streams are interrupted, see Decoder::SetCancelDeadline.
+			boost::atomic<int64_t> stopDeadline_;
+			boost::atomic<int64_t> stopDeadlinePiP_;
 			StreamPlayerParams playerParams_;
 
             std::unique_ptr<Frame> framePtr_;
 			std::unique_ptr<Frame> framePiPPtr_;
 
+			PacketBuffer packetBuffer_;
+			PacketBuffer packetBufferPiP_;
+
+			Recorder recorder_;
+			Recorder recorderPiP_;
+
+			ArchiveWriter archiveWriter_;
+			ArchiveWriter archiveWriterPiP_;
+
+			FrameRing frameRing_;
+			FrameRing frameRingPiP_;
+
+			FrameSignal frameSignal_;
+			FrameSignal frameSignalPiP_;
+
+			FrameDispatcher frameDispatcher_;
+			FrameDispatcher frameDispatcherPiP_;
+
+			MotionDetector motionDetector_;
+			MotionDetector motionDetectorPiP_;
+			MotionStartedCallback motionStartedCallback_;
+			MotionStoppedCallback motionStoppedCallback_;
+
+			DecoderParams decoderParams_;
+
+			// The inputs handed out by StartPlayCustom, a handle is checked against them before it is used.
+			std::vector<std::shared_ptr<PushInput>> pushInputs_;
+			boost::mutex pushInputsMutex_;
+
+			// Whether a player without a window converts frames.
+			bool frameOutput_;
+
+			StreamStats stats_;
+			StreamStats statsPiP_;
+			int64_t priorityCycles_[PriorityCount];
+			boost::mutex statsMutex_;
+
+			boost::atomic<bool> visible_;
+			boost::atomic<bool> visiblePiP_;
+			boost::atomic<bool> minimized_;
+			boost::atomic<bool> standby_;
+			boost::atomic<bool> standbyPiP_;
+			boost::atomic<int32_t> priority_;
+			boost::atomic<int32_t> priorityPiP_;
+			CpuMonitor cpuMonitor_;
+
             // There is a bug in the Visual Studio std::thread implementation,
             // which prohibits dll unloading, that is why the boost::thread is used instead.
             // https://connect.microsoft.com/VisualStudio/feedback/details/781665/stl-using-std-threading-objects-adds-extra-load-count-for-hosted-dll#tabs 
@@ -160,6 +728,55 @@ namespace FFmpeg
 			boost::thread workerThread_;
 			boost::thread workerThreadPiP_;
 
+			// Reads the sockets of the streams when it is enabled, it outlives their decoders.
+			NetReactor netReactor_;
+
+			// The streams run on the scheduler instead of the worker threads when it is enabled.
+			DecodeScheduler scheduler_;
+			std::shared_ptr<StreamTask> streamTaskPtr_;
+			std::shared_ptr<StreamTask> streamTaskPiPPtr_;
+			bool schedulerEnabled_;
+			uint32_t schedulerWorkerCount_;
+
+			// The stall watchdog, disabled when the timeout is zero.
+			uint32_t stallTimeoutInMilliseconds_;
+			uint32_t retryDelayInMilliseconds_;
+			uint32_t maxRetryDelayInMilliseconds_;
+			uint32_t maxReconnectAttempts_;
+			std::vector<std::string> backupUrls_;
+			std::vector<std::string> backupUrlsPiP_;
+
+			TransportProfile transportProfile_;
+			TransportProfile transportProfilePiP_;
+
+			// Keeps the stopped streams connected when it is enabled, it outlives the sessions.
+			DecoderPool decoderPool_;
+			bool decoderPoolEnabled_;
+
+			// The group of pictures in progress of each stream, a consumer joining a stream starts from it.
+			GopCache gopCache_;
+			GopCache gopCachePiP_;
+
+			// Set while a WM_INVALIDATE is queued or a paint is due.
+			boost::atomic<bool> repaintPending_;
+			bool repaintTimerSet_;
+			Clock::duration displayInterval_;
+			Clock::time_point lastPaint_;
+
+			EventQueue eventQueue_;
+			// Set while a WM_PLAYEREVENTS message is queued.
+			boost::atomic<bool> eventsPending_;
+
+			// The camera profile, subUrl_ is empty when a single stream is played.
+			std::string mainUrl_;
+			std::string subUrl_;
+			std::string currentUrl_;
+			int32_t profileWidthThreshold_;
+			// The stream the play loop switches to, guarded by profileMutex_.
+			std::string switchUrl_;
+			boost::atomic<bool> switchRequested_;
+			boost::mutex profileMutex_;
+
             static WNDPROC originalWndProc_;
 		
 			int pip_width_;
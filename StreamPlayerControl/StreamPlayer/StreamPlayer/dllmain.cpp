@@ -36,6 +36,34 @@ STREAMPLAYER_API int32_t __stdcall StartPlay(const char* url)
     return 0;
 }
 
+STREAMPLAYER_API int32_t __stdcall StartPlayProfile(const char* mainUrl, const char* subUrl)
+{
+	try
+	{
+		player.StartPlayProfile(mainUrl, subUrl);
+	}
+	catch (std::runtime_error &)
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
+STREAMPLAYER_API int32_t __stdcall StartPlayPiPProfile(const char* mainUrl, const char* subUrl)
+{
+	try
+	{
+		player.StartPlayPiPProfile(mainUrl, subUrl);
+	}
+	catch (std::runtime_error &)
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
 STREAMPLAYER_API int32_t __stdcall StartPlayPiP(const char* url)
 {
 	try
@@ -50,6 +78,65 @@ STREAMPLAYER_API int32_t __stdcall StartPlayPiP(const char* url)
 	return 0;
 }
 
+STREAMPLAYER_API int32_t __stdcall StartPlayCustom(uint32_t streamNum, const char* formatName,
+	int32_t* queueCapacity, void** inputHandle)
+{
+	try
+	{
+		player.StartPlayCustom(streamNum, formatName != nullptr ? formatName : "", queueCapacity, inputHandle);
+	}
+	catch (std::runtime_error &)
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
+STREAMPLAYER_API int32_t __stdcall StartPlayCallback(uint32_t streamNum, FFmpeg::Facade::ReadCallback read,
+	void* context, const char* formatName)
+{
+	try
+	{
+		player.StartPlayCallback(streamNum, read, context, formatName != nullptr ? formatName : "");
+	}
+	catch (std::runtime_error &)
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
+// Returns 0 if the buffer is queued and 1 if the queue is full, the input ended or the handle is not valid.
+STREAMPLAYER_API int32_t __stdcall PushData(void* inputHandle, const uint8_t* data, int32_t* size,
+	FFmpeg::Facade::BufferReleasedCallback released, void* context)
+{
+	return player.PushData(inputHandle, data, *size, released, context) ? 0 : 1;
+}
+
+// Ends the input, the handle is not valid afterwards.
+STREAMPLAYER_API int32_t __stdcall EndData(void* inputHandle)
+{
+	player.EndData(inputHandle);
+
+	return 0;
+}
+
+STREAMPLAYER_API int32_t __stdcall StartPlayArchive(const char* directory, int64_t* timestamp)
+{
+	try
+	{
+		player.StartPlayArchive(directory, timestamp);
+	}
+	catch (std::runtime_error &)
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
 STREAMPLAYER_API int32_t __stdcall GetCurrentFrame(uint8_t** bmp_ptr)
 {
     try
@@ -78,6 +165,33 @@ STREAMPLAYER_API int32_t __stdcall GetFrameSize(uint32_t* widthPtr, uint32_t* he
     return 0;
 }
 
+// Returns 0 once a newer frame is decoded, 1 if the stream is not playing and 2 on timeout.
+STREAMPLAYER_API int32_t __stdcall WaitForFrame(uint32_t streamNum, int64_t* lastSequence,
+	int32_t* timeoutInMilliseconds, int64_t* sequence)
+{
+	switch (player.WaitForFrame(streamNum, lastSequence, timeoutInMilliseconds, sequence))
+	{
+	case FFmpeg::Facade::FrameSignal::FramePublished:
+		return 0;
+	case FFmpeg::Facade::FrameSignal::TimedOut:
+		return 2;
+	default:
+		return 1;
+	}
+}
+
+// Returns 0 if an event is taken and 1 if there is none.
+STREAMPLAYER_API int32_t __stdcall PollEvent(FFmpeg::Facade::PlayerEvent* eventPtr)
+{
+	return player.PollEvent(eventPtr) ? 0 : 1;
+}
+
+// Returns 0 if an event is taken and 2 on timeout.
+STREAMPLAYER_API int32_t __stdcall WaitEvent(int32_t* timeoutInMilliseconds, FFmpeg::Facade::PlayerEvent* eventPtr)
+{
+	return player.WaitEvent(timeoutInMilliseconds, eventPtr) ? 0 : 2;
+}
+
 STREAMPLAYER_API int32_t __stdcall SetupPiP(int32_t* width, int32_t* top, int32_t* left)
 {
 	try
@@ -92,6 +206,20 @@ STREAMPLAYER_API int32_t __stdcall SetupPiP(int32_t* width, int32_t* top, int32_
 	return 0;
 }
 
+STREAMPLAYER_API int32_t __stdcall SetupDisplayRate(int32_t* framesPerSecond)
+{
+	try
+	{
+		player.SetupDisplayRate(framesPerSecond);
+	}
+	catch (std::runtime_error &)
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
 STREAMPLAYER_API int32_t __stdcall SetupZoom(int32_t* zoom)
 {
 	try
@@ -120,6 +248,445 @@ STREAMPLAYER_API int32_t __stdcall SetupCross(int32_t* cross)
 	return 0;
 }
 
+STREAMPLAYER_API int32_t __stdcall SetupPreEventBuffer(int32_t* seconds, int32_t* kilobytes)
+{
+	try
+	{
+		player.SetupPreEventBuffer(seconds, kilobytes);
+	}
+	catch (std::runtime_error &)
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
+STREAMPLAYER_API int32_t __stdcall ExportPreEventClip(uint32_t streamNum, const char* fileName)
+{
+	try
+	{
+		player.ExportPreEventClip(streamNum, fileName);
+	}
+	catch (std::runtime_error &)
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
+STREAMPLAYER_API int32_t __stdcall StartRecording(uint32_t streamNum, const char* filePath,
+	int32_t* segmentSeconds, int32_t* segmentMegabytes)
+{
+	try
+	{
+		player.StartRecording(streamNum, filePath, segmentSeconds, segmentMegabytes);
+	}
+	catch (std::runtime_error &)
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
+STREAMPLAYER_API int32_t __stdcall StopRecording(uint32_t streamNum)
+{
+	try
+	{
+		player.StopRecording(streamNum);
+	}
+	catch (std::runtime_error &)
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
+STREAMPLAYER_API int32_t __stdcall StartArchiving(uint32_t streamNum, const char* directory,
+	int32_t* segmentSeconds, int32_t* maxAgeHours, int32_t* quotaMegabytes)
+{
+	try
+	{
+		player.StartArchiving(streamNum, directory, segmentSeconds, maxAgeHours, quotaMegabytes);
+	}
+	catch (std::runtime_error &)
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
+STREAMPLAYER_API int32_t __stdcall StopArchiving(uint32_t streamNum)
+{
+	try
+	{
+		player.StopArchiving(streamNum);
+	}
+	catch (std::runtime_error &)
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
+STREAMPLAYER_API int32_t __stdcall StartFrameRing(uint32_t streamNum, const char* name,
+	int32_t* slotCount, int32_t* slotKilobytes)
+{
+	try
+	{
+		player.StartFrameRing(streamNum, name, slotCount, slotKilobytes);
+	}
+	catch (std::runtime_error &)
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
+STREAMPLAYER_API int32_t __stdcall StopFrameRing(uint32_t streamNum)
+{
+	try
+	{
+		player.StopFrameRing(streamNum);
+	}
+	catch (std::runtime_error &)
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
+STREAMPLAYER_API int32_t __stdcall SetFrameCallback(uint32_t streamNum,
+	FFmpeg::Facade::FrameDecodedCallback frameDecodedCallback)
+{
+	try
+	{
+		player.SetFrameCallback(streamNum, frameDecodedCallback);
+	}
+	catch (std::runtime_error &)
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
+STREAMPLAYER_API int32_t __stdcall RetainFrame(void* handle, void** retainedHandle)
+{
+	try
+	{
+		*retainedHandle = FFmpeg::Facade::FrameDispatcher::Retain(handle);
+	}
+	catch (std::runtime_error &)
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
+STREAMPLAYER_API int32_t __stdcall ReleaseFrame(void* handle)
+{
+	FFmpeg::Facade::FrameDispatcher::Release(handle);
+
+	return 0;
+}
+
+STREAMPLAYER_API int32_t __stdcall SetupMotionDetection(int32_t* enabled, int32_t* startDelay, int32_t* stopDelay)
+{
+	try
+	{
+		player.SetupMotionDetection(enabled, startDelay, stopDelay);
+	}
+	catch (std::runtime_error &)
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
+STREAMPLAYER_API int32_t __stdcall SetupMotionZone(uint32_t streamNum, int32_t* zoneNum,
+	int32_t* left, int32_t* top, int32_t* right, int32_t* bottom, int32_t* threshold)
+{
+	try
+	{
+		player.SetupMotionZone(streamNum, zoneNum, left, top, right, bottom, threshold);
+	}
+	catch (std::runtime_error &)
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
+STREAMPLAYER_API int32_t __stdcall SetupStreamSelection(int32_t* maxWidth, int32_t* maxHeight,
+	int32_t* maxKilobitsPerSecond, const char* codecName)
+{
+	try
+	{
+		player.SetupStreamSelection(maxWidth, maxHeight, maxKilobitsPerSecond,
+			codecName != nullptr ? codecName : "");
+	}
+	catch (std::runtime_error &)
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
+STREAMPLAYER_API int32_t __stdcall SetupProfileSwitch(int32_t* widthThreshold)
+{
+	try
+	{
+		player.SetupProfileSwitch(widthThreshold);
+	}
+	catch (std::runtime_error &)
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
+STREAMPLAYER_API int32_t __stdcall SetupScheduler(int32_t* enabled, int32_t* workerCount)
+{
+	try
+	{
+		player.SetupScheduler(enabled, workerCount);
+	}
+	catch (std::runtime_error &)
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
+STREAMPLAYER_API int32_t __stdcall SetupNetworkReactor(int32_t* enabled, int32_t* threadCount)
+{
+	try
+	{
+		player.SetupNetworkReactor(enabled, threadCount);
+	}
+	catch (std::runtime_error &)
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
+STREAMPLAYER_API int32_t __stdcall SetupWatchdog(int32_t* stallTimeoutInMilliseconds, int32_t* retryDelayInMilliseconds,
+	int32_t* maxRetryDelayInMilliseconds, int32_t* maxAttempts)
+{
+	try
+	{
+		player.SetupWatchdog(stallTimeoutInMilliseconds, retryDelayInMilliseconds, maxRetryDelayInMilliseconds, maxAttempts);
+	}
+	catch (std::runtime_error &)
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
+STREAMPLAYER_API int32_t __stdcall SetupDecoderPool(int32_t* enabled, int32_t* memoryBudgetInMegabytes)
+{
+	try
+	{
+		player.SetupDecoderPool(enabled, memoryBudgetInMegabytes);
+	}
+	catch (std::runtime_error &)
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
+STREAMPLAYER_API int32_t __stdcall GetParkedDecoderCount(int32_t* count)
+{
+	try
+	{
+		player.GetParkedDecoderCount(count);
+	}
+	catch (std::runtime_error &)
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
+STREAMPLAYER_API int32_t __stdcall SetupTransport(uint32_t streamNum, FFmpeg::Facade::TransportProfile* profilePtr)
+{
+	try
+	{
+		player.SetupTransport(streamNum, profilePtr);
+	}
+	catch (std::runtime_error &)
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
+STREAMPLAYER_API int32_t __stdcall SetBackupUrls(uint32_t streamNum, const char** urls, int32_t* count)
+{
+	try
+	{
+		if (*count < 0)
+			return 1;
+
+		player.SetBackupUrls(streamNum, std::vector<std::string>(urls, urls + *count));
+	}
+	catch (std::runtime_error &)
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
+STREAMPLAYER_API int32_t __stdcall SetupVisibility(uint32_t streamNum, int32_t* visible, int32_t* priority)
+{
+	try
+	{
+		player.SetupVisibility(streamNum, visible, priority);
+	}
+	catch (std::runtime_error &)
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
+STREAMPLAYER_API int32_t __stdcall SetStandby(uint32_t streamNum, int32_t* standby)
+{
+	try
+	{
+		player.SetStandby(streamNum, standby);
+	}
+	catch (std::runtime_error &)
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
+STREAMPLAYER_API int32_t __stdcall GetPriorityStats(FFmpeg::Facade::PriorityStats* statsPtr)
+{
+	try
+	{
+		player.GetPriorityStats(statsPtr);
+	}
+	catch (std::runtime_error &)
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
+STREAMPLAYER_API int32_t __stdcall SetupFrameSkipping(int32_t* enabled)
+{
+	try
+	{
+		player.SetupFrameSkipping(enabled);
+	}
+	catch (std::runtime_error &)
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
+STREAMPLAYER_API int32_t __stdcall GetStreamStats(uint32_t streamNum, FFmpeg::Facade::StreamStats* statsPtr)
+{
+	try
+	{
+		player.GetStreamStats(streamNum, statsPtr);
+	}
+	catch (std::runtime_error &)
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
+STREAMPLAYER_API int32_t __stdcall SetupFrameFormat(int32_t* format)
+{
+	try
+	{
+		player.SetupFrameFormat(format);
+	}
+	catch (std::runtime_error &)
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
+STREAMPLAYER_API int32_t __stdcall SetupFrameOutput(int32_t* enabled)
+{
+	try
+	{
+		player.SetupFrameOutput(enabled);
+	}
+	catch (std::runtime_error &)
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
+STREAMPLAYER_API int32_t __stdcall SetupMotionVectors(int32_t* enabled, int32_t* skipPixelOutput)
+{
+	try
+	{
+		player.SetupMotionVectors(enabled, skipPixelOutput);
+	}
+	catch (std::runtime_error &)
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
+STREAMPLAYER_API int32_t __stdcall SetMotionCallbacks(FFmpeg::Facade::MotionStartedCallback motionStartedCallback,
+	FFmpeg::Facade::MotionStoppedCallback motionStoppedCallback)
+{
+	try
+	{
+		player.SetMotionCallbacks(motionStartedCallback, motionStoppedCallback);
+	}
+	catch (std::runtime_error &)
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
 STREAMPLAYER_API int32_t __stdcall Stop()
 {
     try
@@ -134,6 +701,13 @@ STREAMPLAYER_API int32_t __stdcall Stop()
     return 0;
 }
 
+STREAMPLAYER_API int32_t __stdcall RequestStop()
+{
+	player.RequestStop();
+
+	return 0;
+}
+
 STREAMPLAYER_API int32_t __stdcall Uninitialize()
 {
     try